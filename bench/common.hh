@@ -0,0 +1,384 @@
+#ifndef BENCH_COMMON_HH
+#define BENCH_COMMON_HH
+
+/*
+ * Helpers shared by the benchmarks: IPCMessageServices counting or capturing
+ * what FlowTable sends, builders for the netlink messages the kernel would
+ * send and a source feeding them to FlowTable, and timing and memory
+ * measurement.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/neighbour.h>
+
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "FlowTable.h"
+#include "SyncQueue.h"
+#include "types/MatchKey.hh"
+#ifdef FPM_ENABLED
+#include "FPMServer.hh"
+#endif /* FPM_ENABLED */
+
+#define MSG_BUFFER_SIZE 256
+
+using namespace std;
+
+/* IPCMessageService that only counts the messages sent through it. */
+class CountingIPC : public IPCMessageService {
+    public:
+        CountingIPC() {
+            this->count = 0;
+        }
+
+        void listen(const string &, IPCMessageFactory *,
+                    IPCMessageProcessor *, bool) {
+        }
+
+        bool send(const string &, const string &, IPCMessage &) {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->count++;
+            this->cond.notify_all();
+            return true;
+        }
+
+        /* Wait until 'target' messages have been sent in total. */
+        bool wait_for(uint64_t target, int timeout) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            boost::system_time deadline = boost::get_system_time() +
+                                          boost::posix_time::seconds(timeout);
+            while (this->count < target) {
+                if (!this->cond.timed_wait(lock, deadline)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        uint64_t sent() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->count;
+        }
+
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        uint64_t count;
+};
+
+/*
+ * IPCMessageService keeping track of the flows the RouteMods sent through it
+ * would leave in the datapath, as a datapath would: adding a flow that is
+ * already there replaces it, deleting one that is not there does nothing.
+ * Both are counted, as FlowTable should not send either.
+ *
+ * With 'track' false, RouteMods are only counted by type.
+ */
+class CaptureIPC : public IPCMessageService {
+    public:
+        CaptureIPC(bool track) {
+            this->track = track;
+            this->count = 0;
+            this->adds = 0;
+            this->deletes = 0;
+            this->replaced = 0;
+            this->missing = 0;
+        }
+
+        void listen(const string &, IPCMessageFactory *,
+                    IPCMessageProcessor *, bool) {
+        }
+
+        bool send(const string &, const string &, IPCMessage &msg) {
+            if (msg.get_type() != ROUTE_MOD) {
+                return false;
+            }
+            RouteMod& rm = static_cast<RouteMod&>(msg);
+
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            if (rm.get_mod() == RMT_ADD) {
+                this->adds++;
+                if (this->track &&
+                    !this->flows.insert(MatchKey(rm.get_matches())).second) {
+                    this->replaced++;
+                }
+            } else if (rm.get_mod() == RMT_DELETE) {
+                this->deletes++;
+                if (this->track &&
+                    this->flows.erase(MatchKey(rm.get_matches())) == 0) {
+                    this->missing++;
+                }
+            }
+
+            this->count++;
+            this->cond.notify_all();
+            return true;
+        }
+
+        /* Wait until 'target' RouteMods have been sent in total. */
+        bool wait_for(uint64_t target, int timeout) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            boost::system_time deadline = boost::get_system_time() +
+                                          boost::posix_time::seconds(timeout);
+            while (this->count < target) {
+                if (!this->cond.timed_wait(lock, deadline)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        uint64_t sent() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->count;
+        }
+
+        /* Number of flows installed, counted from RouteMods if not tracked */
+        uint64_t installed() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->track ? this->flows.size()
+                               : this->adds - this->deletes;
+        }
+
+        /* Adds of installed flows and deletes of missing ones */
+        uint64_t errors() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->replaced + this->missing;
+        }
+
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        bool track;
+        boost::unordered_set<MatchKey> flows;
+        uint64_t count;
+        uint64_t adds;
+        uint64_t deletes;
+        uint64_t replaced;
+        uint64_t missing;
+};
+
+/* A batch of netlink messages, stored back to back. */
+typedef vector<char> MessageBatch;
+
+/*
+ * UpdateSource handing FlowTable the batches of netlink messages pushed to
+ * it, each message to 'filter', as they would come from the kernel.
+ */
+class FeedSource : public UpdateSource {
+    public:
+        FeedSource(rtnl_filter_t filter) {
+            this->filter = filter;
+            this->pushed = 0;
+            this->fed = 0;
+        }
+
+        /* The batch must be kept until drain() returns. */
+        void push(const MessageBatch* batch) {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->pushed++;
+            this->queue.push(batch);
+        }
+
+        /* Wait until every batch pushed has been handed to FlowTable. */
+        void drain() {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            while (this->fed < this->pushed) {
+                this->cond.wait(lock);
+            }
+        }
+
+        void run() {
+            while (true) {
+                const MessageBatch* batch;
+                this->queue.wait_and_pop(batch);
+
+                size_t offset = 0;
+                while (offset < batch->size()) {
+                    struct nlmsghdr *n = (struct nlmsghdr *) &(*batch)[offset];
+                    offset += NLMSG_ALIGN(n->nlmsg_len);
+                    this->filter(NULL, n, NULL);
+                }
+
+                boost::lock_guard<boost::mutex> lock(this->mutex);
+                this->fed++;
+                this->cond.notify_all();
+            }
+        }
+
+    private:
+        rtnl_filter_t filter;
+        SyncQueue<const MessageBatch*> queue;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        uint64_t pushed;
+        uint64_t fed;
+};
+
+/* Filters passing route messages on to FlowTable, as netlink or FPM would. */
+inline int feed_route(const struct sockaddr_nl *, struct nlmsghdr *n,
+                      void *) {
+    return FlowTable::updateRouteTable(n);
+}
+
+#ifdef FPM_ENABLED
+inline int feed_fpm_route(const struct sockaddr_nl *, struct nlmsghdr *n,
+                          void *) {
+    uint32_t buf[(sizeof(fpm_msg_hdr_t) + MSG_BUFFER_SIZE) / 4];
+    fpm_msg_hdr_t *hdr = (fpm_msg_hdr_t *) buf;
+    hdr->version = FPM_PROTO_VERSION;
+    hdr->msg_type = FPM_MSG_TYPE_NETLINK;
+    hdr->msg_len = htons(fpm_data_len_to_msg_len(n->nlmsg_len));
+    memcpy(fpm_msg_data(hdr), n, n->nlmsg_len);
+
+    FPMServer::process_fpm_msg(hdr);
+    return 0;
+}
+#endif /* FPM_ENABLED */
+
+inline void add_attr(struct nlmsghdr *n, int type, const void *data,
+                     int len) {
+    struct rtattr *rta = (struct rtattr *) ((char *) n +
+                                            NLMSG_ALIGN(n->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+inline void append(MessageBatch& batch, const struct nlmsghdr *n) {
+    const char *data = (const char *) n;
+    batch.insert(batch.end(), data, data + NLMSG_ALIGN(n->nlmsg_len));
+}
+
+inline void add_neighbour(MessageBatch& batch, int family, const void *addr,
+                          int ifindex, const uint8_t *mac,
+                          int state = NUD_REACHABLE) {
+    char buf[MSG_BUFFER_SIZE];
+    memset(buf, 0, sizeof(buf));
+
+    struct nlmsghdr *n = (struct nlmsghdr *) buf;
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    n->nlmsg_type = RTM_NEWNEIGH;
+
+    struct ndmsg *nd = (struct ndmsg *) NLMSG_DATA(n);
+    nd->ndm_family = family;
+    nd->ndm_ifindex = ifindex;
+    nd->ndm_state = state;
+
+    add_attr(n, NDA_DST, addr, family == AF_INET ? 4 : 16);
+    add_attr(n, NDA_LLADDR, mac, IFHWADDRLEN);
+    append(batch, n);
+}
+
+inline void add_route(MessageBatch& batch, int type, int family,
+                      const void *dst, int dst_len, const void *gw,
+                      int ifindex, int flags = 0) {
+    char buf[MSG_BUFFER_SIZE];
+    memset(buf, 0, sizeof(buf));
+
+    struct nlmsghdr *n = (struct nlmsghdr *) buf;
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    n->nlmsg_type = type;
+    n->nlmsg_flags = flags;
+
+    struct rtmsg *rtm = (struct rtmsg *) NLMSG_DATA(n);
+    rtm->rtm_family = family;
+    rtm->rtm_dst_len = dst_len;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_type = RTN_UNICAST;
+
+    int len = family == AF_INET ? 4 : 16;
+    add_attr(n, RTA_DST, dst, len);
+    add_attr(n, RTA_GATEWAY, gw, len);
+    add_attr(n, RTA_OIF, &ifindex, sizeof(ifindex));
+    append(batch, n);
+}
+
+/* Gateway 'i' of the given family. */
+inline void gateway_addr(int family, int i, uint8_t *addr) {
+    memset(addr, 0, 16);
+    if (family == AF_INET) {
+        uint32_t a = htonl(0x0aff0000 + i);          /* 10.255.0.0/16 */
+        memcpy(addr, &a, 4);
+    } else {
+        addr[0] = 0x20; addr[1] = 0x01;              /* 2001:db8:ffff::/64 */
+        addr[2] = 0x0d; addr[3] = 0xb8;
+        addr[4] = 0xff; addr[5] = 0xff;
+        addr[14] = i >> 8; addr[15] = i & 0xff;
+    }
+}
+
+/* Route 'i' of the given family: a /24 from 11.0.0.0 on, or a /48 from
+ * 2400::/16 on. */
+inline int route_addr(int family, int i, uint8_t *addr) {
+    memset(addr, 0, 16);
+    if (family == AF_INET) {
+        uint32_t a = htonl(0x0b000000 + (i << 8));
+        memcpy(addr, &a, 4);
+        return 24;
+    }
+
+    addr[0] = 0x24;
+    addr[2] = i >> 24; addr[3] = i >> 16;
+    addr[4] = i >> 8; addr[5] = i & 0xff;
+    return 48;
+}
+
+/* Neighbours 'first' to 'first' + 'count' - 1, in the given state. */
+inline void build_neighbours(MessageBatch& batch, int family, int count,
+                             int ifindex, int first = 0,
+                             int state = NUD_REACHABLE) {
+    uint8_t addr[16];
+    uint8_t mac[IFHWADDRLEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+    for (int i = first; i < first + count; i++) {
+        gateway_addr(family, i, addr);
+        mac[1] = family == AF_INET ? 4 : 6;
+        mac[4] = i >> 8;
+        mac[5] = i & 0xff;
+        add_neighbour(batch, family, addr, ifindex, mac, state);
+    }
+}
+
+/* Routes 0 to 'count' - 1, route 'i' through gateway ('i' + 'shift') modulo
+ * 'gateways'. 'flags' are the netlink flags of the messages, NLM_F_REPLACE
+ * for routes replacing the ones already announced. */
+inline void build_routes(MessageBatch& batch, int type, int family,
+                         int count, int gateways, int ifindex,
+                         int shift = 0, int flags = 0) {
+    uint8_t dst[16], gw[16];
+
+    for (int i = 0; i < count; i++) {
+        int dst_len = route_addr(family, i, dst);
+        gateway_addr(family, (i + shift) % gateways, gw);
+        add_route(batch, type, family, dst, dst_len, gw, ifindex, flags);
+    }
+}
+
+inline double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Resident set size, in kB. */
+inline long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+#endif /* BENCH_COMMON_HH */
@@ -0,0 +1,537 @@
+/*
+ * Microbenchmarks for the hot paths of rflib and rfclient.
+ *
+ * Each benchmark is run with a growing number of iterations until it takes
+ * at least the minimum time, and its result is printed as one JSON object
+ * per line, so that results can be stored and compared across releases:
+ *
+ *   {"benchmark": "ipaddress.format.ipv4", "iterations": 4000000,
+ *    "seconds": 0.52, "ns_per_op": 130.1, "ops_per_sec": 7686395}
+ *
+ * FlowTable benchmarks feed netlink messages to FlowTable as route_load
+ * does, on the loopback interface, and need no root privileges.
+ *
+ * Usage: micro [-f filter] [-t min_seconds] [-l]
+ *   -f  only run the benchmarks whose name contains 'filter'
+ *   -t  minimum time per benchmark, 0.5s by default
+ *   -l  list the benchmarks and exit
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "common.hh"
+#include "SyncQueue.h"
+#include "RouteTable.hh"
+#include "ipc/MongoIPC.h"
+#include "ipc/RFProtocol.h"
+#include "ipc/RFProtocolFactory.h"
+
+#define DEFAULT_MIN_TIME 0.5
+
+/* Upper bound on the iterations of a benchmark */
+#define MAX_ITERATIONS (1ULL << 32)
+
+/* Number of distinct inputs, cycled through */
+#define SAMPLES 1024
+
+/* Number of neighbours known to FlowTable */
+#define GATEWAYS 64
+
+/* Time to wait for FlowTable to send the RouteMods of a run */
+#define FLOWTABLE_TIMEOUT 600
+
+/* A benchmark runs 'n' iterations and returns the time they took, which
+ * leaves out any setup. */
+typedef double (*BenchFunc)(uint64_t n);
+
+struct Benchmark {
+    const char *name;
+    BenchFunc run;
+};
+
+/* Keeps the compiler from optimizing work away. */
+static volatile size_t sink;
+
+static char ipv4_text[SAMPLES][IPV4_STRLEN];
+static char ipv6_text[SAMPLES][IPV6_STRLEN];
+static char mac_text[SAMPLES][MAC_STRLEN];
+static vector<IPAddress> ipv4_addrs, ipv6_addrs;
+static vector<MACAddress> mac_addrs;
+
+static void generate_samples() {
+    srand(1);
+    for (int i = 0; i < SAMPLES; i++) {
+        uint8_t data[16];
+        for (int j = 0; j < 16; j++) {
+            data[j] = rand();
+        }
+        /* Some zero words, as in most IPv6 addresses */
+        memset(data + 4, 0, 2 * (rand() % 5));
+
+        ipv4_addrs.push_back(IPAddress(IPV4, data));
+        ipv6_addrs.push_back(IPAddress(IPV6, data));
+        mac_addrs.push_back(MACAddress(data));
+        format_ipv4(data, ipv4_text[i]);
+        format_ipv6(data, ipv6_text[i]);
+        format_mac(data, mac_text[i]);
+    }
+}
+
+static RouteMod sample_route_mod() {
+    RouteMod rm;
+    rm.set_mod(RMT_ADD);
+    rm.set_id(0x12345678);
+    rm.add_match(Match(RFMT_IPV4, ipv4_addrs[0], IPAddress(IPV4, 24)));
+    rm.add_match(Match(RFMT_VRF, (uint32_t) 1));
+    rm.add_action(Action(RFAT_SET_ETH_SRC, mac_addrs[0]));
+    rm.add_action(Action(RFAT_SET_ETH_DST, mac_addrs[1]));
+    rm.add_action(Action(RFAT_OUTPUT, (uint32_t) 2));
+    rm.add_option(Option(RFOT_PRIORITY, (uint16_t) 0x8018));
+    return rm;
+}
+
+/* IPAddress and MACAddress */
+
+static double ipaddress_parse_ipv4(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += IPAddress(IPV4, ipv4_text[i % SAMPLES]).toUint32();
+    }
+    return now() - start;
+}
+
+static double ipaddress_parse_ipv6(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += IPAddress(IPV6, ipv6_text[i % SAMPLES]).getLength();
+    }
+    return now() - start;
+}
+
+static double ipaddress_from_bytes(uint64_t n) {
+    uint8_t data[16] = { 10, 0, 0, 1 };
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        data[3] = i;
+        sink += IPAddress(IPV4, data).toUint32();
+    }
+    return now() - start;
+}
+
+static double ipaddress_format_ipv4(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += ipv4_addrs[i % SAMPLES].toString().size();
+    }
+    return now() - start;
+}
+
+static double ipaddress_format_ipv6(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += ipv6_addrs[i % SAMPLES].toString().size();
+    }
+    return now() - start;
+}
+
+static double macaddress_parse(uint64_t n) {
+    uint8_t data[IFHWADDRLEN];
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        MACAddress(mac_text[i % SAMPLES]).toArray(data);
+        sink += data[0];
+    }
+    return now() - start;
+}
+
+static double macaddress_format(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += mac_addrs[i % SAMPLES].toString().size();
+    }
+    return now() - start;
+}
+
+/* TLVs */
+
+static double match_ipv4(uint64_t n) {
+    IPAddress mask(IPV4, 24);
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += Match(RFMT_IPV4, ipv4_addrs[i % SAMPLES], mask).getLength();
+    }
+    return now() - start;
+}
+
+static double match_ipv6(uint64_t n) {
+    IPAddress mask(IPV6, 48);
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += Match(RFMT_IPV6, ipv6_addrs[i % SAMPLES], mask).getLength();
+    }
+    return now() - start;
+}
+
+static double match_ethernet(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += Match(RFMT_ETHERNET, mac_addrs[i % SAMPLES]).getLength();
+    }
+    return now() - start;
+}
+
+static double action_output(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += Action(RFAT_OUTPUT, (uint32_t) i).getLength();
+    }
+    return now() - start;
+}
+
+static double action_set_eth_dst(uint64_t n) {
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += Action(RFAT_SET_ETH_DST, mac_addrs[i % SAMPLES]).getLength();
+    }
+    return now() - start;
+}
+
+/* IPC messages */
+
+static double routemod_to_bson(uint64_t n) {
+    RouteMod rm = sample_route_mod();
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        const char *data = rm.to_BSON();
+        sink += data[0];
+        delete[] data;
+    }
+    return now() - start;
+}
+
+static double routemod_from_bson(uint64_t n) {
+    RouteMod rm = sample_route_mod();
+    const char *data = rm.to_BSON();
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        RouteMod copy;
+        copy.from_BSON(data);
+        sink += copy.get_id();
+    }
+    double elapsed = now() - start;
+    delete[] data;
+    return elapsed;
+}
+
+static double envelope_put(uint64_t n) {
+    RouteMod rm = sample_route_mod();
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += putInEnvelope("rfclient", "rfserver", rm).objsize();
+    }
+    return now() - start;
+}
+
+static double envelope_take(uint64_t n) {
+    RouteMod rm = sample_route_mod();
+    RFProtocolFactory factory;
+    mongo::BSONObj envelope = putInEnvelope("rfclient", "rfserver", rm);
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        IPCMessage *msg = takeFromEnvelope(envelope, &factory);
+        sink += msg->get_type();
+        delete msg;
+    }
+    return now() - start;
+}
+
+/* Queues, from a single thread: the cost of the locking and storage. */
+
+static double syncqueue_push_pop(uint64_t n) {
+    SyncQueue<pair<uint32_t, uint32_t> > queue;
+    pair<uint32_t, uint32_t> item;
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        queue.push(make_pair((uint32_t) i, (uint32_t) i));
+        queue.wait_and_pop(item);
+        sink += item.first;
+    }
+    return now() - start;
+}
+
+static double batchqueue_push_pop(uint64_t n) {
+    BatchQueue<pair<RouteModType, RouteEntry> > queue;
+    BatchQueue<pair<RouteModType, RouteEntry> >::Batch batch;
+    pair<RouteModType, RouteEntry> item(RMT_ADD, RouteEntry());
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        queue.push(item);
+        if (i % BATCH_BLOCK_SIZE == BATCH_BLOCK_SIZE - 1 || i == n - 1) {
+            queue.wait_and_pop_all(batch);
+            sink += batch.size();
+        }
+    }
+    return now() - start;
+}
+
+/* Route index */
+
+static void route_entry(int i, RouteEntry& re) {
+    uint8_t dst[16], gw[16];
+    route_addr(AF_INET, i, dst);
+    gateway_addr(AF_INET, i % GATEWAYS, gw);
+    re.address = IPAddress(IPV4, dst);
+    re.netmask = IPAddress(IPV4, 24);
+    re.gateway = IPAddress(IPV4, gw);
+}
+
+static double routetable_insert(uint64_t n) {
+    RouteTable table;
+    vector<RouteEntry> entries(n);
+    for (uint64_t i = 0; i < n; i++) {
+        route_entry(i, entries[i]);
+    }
+
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += table.insert(entries[i], 1, ROUTE_INSTALLED);
+    }
+    return now() - start;
+}
+
+static double routetable_find(uint64_t n) {
+    RouteTable table;
+    vector<RouteEntry> entries(SAMPLES);
+    for (int i = 0; i < SAMPLES; i++) {
+        route_entry(i, entries[i]);
+        table.insert(entries[i], 1, ROUTE_INSTALLED);
+    }
+
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        sink += table.find(entries[i % SAMPLES]);
+    }
+    return now() - start;
+}
+
+static double routetable_erase(uint64_t n) {
+    RouteTable table;
+    vector<uint32_t> ids(n);
+    for (uint64_t i = 0; i < n; i++) {
+        RouteEntry re;
+        route_entry(i, re);
+        ids[i] = table.insert(re, 1, ROUTE_INSTALLED);
+    }
+
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        table.erase(ids[i]);
+    }
+    return now() - start;
+}
+
+/* FlowTable, fed with netlink messages and sending RouteMods to a counting
+ * IPCMessageService. */
+
+static CountingIPC* flowtable_ipc = NULL;
+static boost::thread flowtable_resolver;
+static int flowtable_ifindex = 0;
+
+static void flowtable_setup() {
+    if (flowtable_ipc != NULL) {
+        return;
+    }
+
+    flowtable_ifindex = if_nametoindex("lo");
+    if (flowtable_ifindex == 0) {
+        perror("if_nametoindex");
+        exit(EXIT_FAILURE);
+    }
+
+    Interface iface;
+    iface.port = 1;
+    iface.ifindex = flowtable_ifindex;
+    iface.name = "lo";
+    iface.hwaddress = MACAddress("02:00:00:00:00:01");
+    iface.active = true;
+    FlowTable::setInterfaces(vector<Interface>(1, iface));
+
+    static PortState ports;
+    flowtable_ipc = new CountingIPC();
+    FlowTable::init(1, flowtable_ipc, &ports, NULL);
+    flowtable_resolver = boost::thread(&FlowTable::GWResolverCb);
+
+    MessageBatch neighbours;
+    build_neighbours(neighbours, AF_INET, GATEWAYS, flowtable_ifindex);
+    size_t offset = 0;
+    while (offset < neighbours.size()) {
+        struct nlmsghdr *n = (struct nlmsghdr *) &neighbours[offset];
+        FlowTable::updateHostTable(NULL, n, NULL);
+        offset += NLMSG_ALIGN(n->nlmsg_len);
+    }
+    flowtable_ipc->wait_for(GATEWAYS, FLOWTABLE_TIMEOUT);
+}
+
+/* Feed the given routes and wait for their RouteMods. Returns the time it
+ * took. */
+static double flowtable_feed(const MessageBatch& batch, uint64_t n) {
+    uint64_t target = flowtable_ipc->sent() + n;
+    double start = now();
+
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        struct nlmsghdr *msg = (struct nlmsghdr *) &batch[offset];
+        FlowTable::updateRouteTable(msg);
+        offset += NLMSG_ALIGN(msg->nlmsg_len);
+    }
+
+    if (!flowtable_ipc->wait_for(target, FLOWTABLE_TIMEOUT)) {
+        fprintf(stderr, "FlowTable did not send the expected RouteMods\n");
+        exit(EXIT_FAILURE);
+    }
+    return now() - start;
+}
+
+static double flowtable_route_add(uint64_t n) {
+    MessageBatch add, del;
+    flowtable_setup();
+    build_routes(add, RTM_NEWROUTE, AF_INET, n, GATEWAYS, flowtable_ifindex);
+    build_routes(del, RTM_DELROUTE, AF_INET, n, GATEWAYS, flowtable_ifindex);
+
+    double elapsed = flowtable_feed(add, n);
+    flowtable_feed(del, n);
+    return elapsed;
+}
+
+static double flowtable_route_delete(uint64_t n) {
+    MessageBatch add, del;
+    flowtable_setup();
+    build_routes(add, RTM_NEWROUTE, AF_INET, n, GATEWAYS, flowtable_ifindex);
+    build_routes(del, RTM_DELROUTE, AF_INET, n, GATEWAYS, flowtable_ifindex);
+
+    flowtable_feed(add, n);
+    return flowtable_feed(del, n);
+}
+
+static double flowtable_find_host(uint64_t n) {
+    vector<IPAddress> gateways;
+    flowtable_setup();
+    for (int i = 0; i < GATEWAYS; i++) {
+        uint8_t addr[16];
+        gateway_addr(AF_INET, i, addr);
+        gateways.push_back(IPAddress(IPV4, addr));
+    }
+
+    uint8_t mac[IFHWADDRLEN];
+    double start = now();
+    for (uint64_t i = 0; i < n; i++) {
+        FlowTable::findHost(gateways[i % GATEWAYS]).toArray(mac);
+        sink += mac[5];
+    }
+    return now() - start;
+}
+
+static const Benchmark benchmarks[] = {
+    { "ipaddress.parse.ipv4", ipaddress_parse_ipv4 },
+    { "ipaddress.parse.ipv6", ipaddress_parse_ipv6 },
+    { "ipaddress.from_bytes", ipaddress_from_bytes },
+    { "ipaddress.format.ipv4", ipaddress_format_ipv4 },
+    { "ipaddress.format.ipv6", ipaddress_format_ipv6 },
+    { "macaddress.parse", macaddress_parse },
+    { "macaddress.format", macaddress_format },
+    { "match.ipv4", match_ipv4 },
+    { "match.ipv6", match_ipv6 },
+    { "match.ethernet", match_ethernet },
+    { "action.output", action_output },
+    { "action.set_eth_dst", action_set_eth_dst },
+    { "routemod.to_bson", routemod_to_bson },
+    { "routemod.from_bson", routemod_from_bson },
+    { "envelope.put", envelope_put },
+    { "envelope.take", envelope_take },
+    { "syncqueue.push_pop", syncqueue_push_pop },
+    { "batchqueue.push_pop", batchqueue_push_pop },
+    { "routetable.insert", routetable_insert },
+    { "routetable.find", routetable_find },
+    { "routetable.erase", routetable_erase },
+    { "flowtable.route.add", flowtable_route_add },
+    { "flowtable.route.delete", flowtable_route_delete },
+    { "flowtable.find_host", flowtable_find_host },
+    { NULL, NULL }
+};
+
+static void run(const Benchmark& bench, double min_time) {
+    uint64_t n = 1;
+    double elapsed;
+
+    while (true) {
+        elapsed = bench.run(n);
+        if (elapsed >= min_time || n >= MAX_ITERATIONS) {
+            break;
+        }
+
+        /* Aim a little past the minimum time, growing by 100x at most. */
+        double factor = elapsed > 0 ? 1.2 * min_time / elapsed : 100;
+        n = (uint64_t) (n * (factor > 100 ? 100 : factor)) + 1;
+    }
+
+    printf("{\"benchmark\": \"%s\", \"iterations\": %llu, "
+           "\"seconds\": %.6f, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f}\n",
+           bench.name, (unsigned long long) n, elapsed, elapsed * 1e9 / n,
+           n / elapsed);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    double min_time = DEFAULT_MIN_TIME;
+    bool list = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:t:l")) != -1) {
+        switch (c) {
+            case 'f':
+                filter = optarg;
+                break;
+            case 't':
+                min_time = atof(optarg);
+                break;
+            case 'l':
+                list = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f filter] [-t min_seconds] "
+                        "[-l]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* FlowTable logs every route update to cout. */
+    ofstream devnull("/dev/null");
+    streambuf *log = cout.rdbuf(devnull.rdbuf());
+
+    generate_samples();
+
+    for (const Benchmark *bench = benchmarks; bench->name != NULL; bench++) {
+        if (filter != NULL && strstr(bench->name, filter) == NULL) {
+            continue;
+        }
+        if (list) {
+            printf("%s\n", bench->name);
+        } else {
+            run(*bench, min_time);
+        }
+    }
+
+    if (flowtable_ipc != NULL) {
+        flowtable_resolver.interrupt();
+        flowtable_resolver.join();
+    }
+
+    cout.rdbuf(log);
+    return EXIT_SUCCESS;
+}
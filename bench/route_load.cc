@@ -0,0 +1,152 @@
+/*
+ * Load a full IPv4 and IPv6 routing table into FlowTable and measure how fast
+ * it is turned into RouteMods.
+ *
+ * Routes and neighbours are fed to FlowTable as the netlink messages the
+ * kernel would send, all of them on the loopback interface. Nothing is
+ * installed in the kernel, RouteMods are only counted, and no root privileges
+ * are needed.
+ *
+ * The memory taken by the route tables is reported once all routes are
+ * loaded.
+ *
+ * Usage: route_load [-4 ipv4_routes] [-6 ipv6_routes] [-g gateways]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "common.hh"
+
+#define DEFAULT_IPV4_ROUTES 200000
+#define DEFAULT_IPV6_ROUTES 200000
+#define DEFAULT_GATEWAYS 64
+
+/* Time to wait for FlowTable to catch up with a phase */
+#define PHASE_TIMEOUT 600
+
+/*
+ * Feed a batch of messages to FlowTable, and wait until it has sent the
+ * 'expected' RouteMods that should come out of it.
+ */
+static bool run_phase(const char *name, CountingIPC& ipc,
+                      const MessageBatch& batch, int expected,
+                      bool neighbours) {
+    uint64_t target = ipc.sent() + expected;
+    long rss = rss_kb();
+    double start = now();
+
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        struct nlmsghdr *n = (struct nlmsghdr *) &batch[offset];
+        if (neighbours) {
+            FlowTable::updateHostTable(NULL, n, NULL);
+        } else {
+            FlowTable::updateRouteTable(n);
+        }
+        offset += NLMSG_ALIGN(n->nlmsg_len);
+    }
+    double parsed = now();
+
+    if (!ipc.wait_for(target, PHASE_TIMEOUT)) {
+        fprintf(stderr, "%s: timed out with %lu of %d RouteMods sent\n",
+                name, (unsigned long) (ipc.sent() + expected - target),
+                expected);
+        return false;
+    }
+    double done = now();
+
+    printf("%-16s %8d msgs  parse %8.3fs  total %8.3fs  %10.0f msgs/s  "
+           "rss %+8ld kB\n", name, expected, parsed - start, done - start,
+           expected / (done - start), rss_kb() - rss);
+    return true;
+}
+
+/* Memory used by the route tables once loaded. */
+static void print_route_stats() {
+    size_t routes, bytes;
+    FlowTable::routeStats(routes, bytes);
+    printf("%-16s %8zu routes  %10zu bytes  %8zu bytes per 100k routes\n",
+           "route table", routes, bytes,
+           routes == 0 ? 0 : (size_t) (bytes * 100000.0 / routes));
+}
+
+int main(int argc, char *argv[]) {
+    int ipv4_routes = DEFAULT_IPV4_ROUTES;
+    int ipv6_routes = DEFAULT_IPV6_ROUTES;
+    int gateways = DEFAULT_GATEWAYS;
+    int c;
+
+    while ((c = getopt(argc, argv, "4:6:g:")) != -1) {
+        switch (c) {
+            case '4':
+                ipv4_routes = atoi(optarg);
+                break;
+            case '6':
+                ipv6_routes = atoi(optarg);
+                break;
+            case 'g':
+                gateways = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-4 ipv4_routes] [-6 ipv6_routes] "
+                        "[-g gateways]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (gateways < 1 || gateways > 65535) {
+        fprintf(stderr, "Number of gateways must be within 1..65535\n");
+        return EXIT_FAILURE;
+    }
+
+    int ifindex = if_nametoindex("lo");
+    if (ifindex == 0) {
+        perror("if_nametoindex");
+        return EXIT_FAILURE;
+    }
+
+    /* FlowTable logs every route update to cout. */
+    ofstream devnull("/dev/null");
+    streambuf *log = cout.rdbuf(devnull.rdbuf());
+
+    Interface iface;
+    iface.port = 1;
+    iface.ifindex = ifindex;
+    iface.name = "lo";
+    iface.hwaddress = MACAddress("02:00:00:00:00:01");
+    iface.active = true;
+
+    vector<Interface> interfaces(1, iface);
+    FlowTable::setInterfaces(interfaces);
+
+    CountingIPC ipc;
+    PortState ports;
+    FlowTable::init(1, &ipc, &ports, NULL);
+    boost::thread resolver(&FlowTable::GWResolverCb);
+
+    MessageBatch neigh4, neigh6, add4, add6, del4, del6;
+    build_neighbours(neigh4, AF_INET, gateways, ifindex);
+    build_neighbours(neigh6, AF_INET6, gateways, ifindex);
+    build_routes(add4, RTM_NEWROUTE, AF_INET, ipv4_routes, gateways, ifindex);
+    build_routes(add6, RTM_NEWROUTE, AF_INET6, ipv6_routes, gateways, ifindex);
+    build_routes(del4, RTM_DELROUTE, AF_INET, ipv4_routes, gateways, ifindex);
+    build_routes(del6, RTM_DELROUTE, AF_INET6, ipv6_routes, gateways, ifindex);
+
+    bool ok = run_phase("ipv4 neighbours", ipc, neigh4, gateways, true) &&
+              run_phase("ipv6 neighbours", ipc, neigh6, gateways, true) &&
+              run_phase("ipv4 add", ipc, add4, ipv4_routes, false) &&
+              run_phase("ipv6 add", ipc, add6, ipv6_routes, false);
+    if (ok) {
+        print_route_stats();
+    }
+    ok = ok && run_phase("ipv6 delete", ipc, del6, ipv6_routes, false) &&
+         run_phase("ipv4 delete", ipc, del4, ipv4_routes, false);
+
+    resolver.interrupt();
+    resolver.join();
+    cout.rdbuf(log);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
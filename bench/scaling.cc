@@ -0,0 +1,333 @@
+/*
+ * Scaling scenarios for FlowTable, run end to end through its own threads.
+ *
+ * FlowTable::run() reads neighbours and routes from in-process sources, fed
+ * with the netlink messages the kernel would send or, in builds with
+ * FPM_ENABLED and with -F, with the FPM frames the routing daemon would send.
+ * RouteMods go to an in-memory IPCMessageService that keeps track of the
+ * flows they leave installed, which are checked after every phase. Nothing
+ * is installed in the kernel and no root privileges are needed.
+ *
+ * Scenarios:
+ *   scale     add and delete 1k, 10k, 100k and so on up to -m routes
+ *   flap      withdraw and announce routes again, then move them between
+ *             gateways, -r times over
+ *   gateways  -G gateways failing at once and coming back, with their routes
+ *
+ * Each phase reports the messages fed, the RouteMods they should turn into
+ * and how fast FlowTable got there, the flows installed, the memory taken by
+ * the route tables and the growth of the resident set. Tracking flows takes
+ * memory of its own, which -c avoids by only counting RouteMods.
+ *
+ * Usage: scaling [-s scenario] [-m max_routes] [-g gateways] [-G gateways]
+ *                [-r rounds] [-c] [-F]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.hh"
+
+#define DEFAULT_MAX_ROUTES 1000000
+#define DEFAULT_GATEWAYS 64
+#define DEFAULT_FAILING_GATEWAYS 10000
+#define DEFAULT_ROUNDS 10
+
+/* Routes used by the flap and gateways scenarios, at most */
+#define SCENARIO_ROUTES 100000
+
+/* FlowTable evicts hosts beyond this, which would throw off the counts. */
+#define MAX_GATEWAYS 16384
+
+/* Time to wait for FlowTable to catch up with a phase */
+#define PHASE_TIMEOUT 600
+
+/* FlowTable logs to stdout, results go to the original one. */
+static FILE* report;
+
+static CaptureIPC* ipc;
+static FeedSource* neighbours;
+static FeedSource* routes;
+static int ifindex;
+
+/* Gateways added to the host table so far */
+static int gateways_known = 0;
+
+/*
+ * Feed a batch of messages to FlowTable, and wait until it has sent the
+ * 'expected' RouteMods that should come out of it. 'flows' is how many flows
+ * the phase installs, or withdraws if negative.
+ */
+static bool run_phase(const char *name, FeedSource* source,
+                      const MessageBatch& batch, int msgs, uint64_t expected,
+                      long flows) {
+    uint64_t target = ipc->sent() + expected;
+    uint64_t installed = ipc->installed() + flows;
+    uint64_t errors = ipc->errors();
+    long rss = rss_kb();
+    double start = now();
+
+    source->push(&batch);
+    if (!ipc->wait_for(target, PHASE_TIMEOUT)) {
+        fprintf(stderr, "%s: timed out with %llu of %llu RouteMods sent\n",
+                name, (unsigned long long) (ipc->sent() + expected - target),
+                (unsigned long long) expected);
+        exit(EXIT_FAILURE);
+    }
+    source->drain();
+    double elapsed = now() - start;
+
+    size_t count, bytes;
+    FlowTable::routeStats(count, bytes);
+    fprintf(report, "%-22s %8d msgs %8llu mods %8.3fs %9.0f msgs/s "
+            "%9.0f mods/s %8llu flows  table %7zu kB  rss %+8ld kB\n",
+            name, msgs, (unsigned long long) expected, elapsed,
+            msgs / elapsed, expected / elapsed,
+            (unsigned long long) ipc->installed(), bytes / 1024,
+            rss_kb() - rss);
+    fflush(report);
+
+    if (ipc->installed() != installed || ipc->errors() != errors) {
+        fprintf(stderr, "%s: expected %llu flows, got %llu with %llu "
+                "replaced or missing\n", name, (unsigned long long) installed,
+                (unsigned long long) ipc->installed(),
+                (unsigned long long) (ipc->errors() - errors));
+        return false;
+    }
+    return true;
+}
+
+/* Make sure the first 'count' gateways are in the host table. */
+static bool add_gateways(int count) {
+    if (count <= gateways_known) {
+        return true;
+    }
+
+    int added = count - gateways_known;
+    MessageBatch batch;
+    build_neighbours(batch, AF_INET, added, ifindex, gateways_known);
+    gateways_known = count;
+    return run_phase("neighbours add", neighbours, batch, added, added,
+                     added);
+}
+
+/* Withdraw and announce again each route in turn, 'rounds' times. */
+static void build_flaps(MessageBatch& batch, int count, int gateways,
+                        int rounds) {
+    uint8_t dst[16], gw[16];
+
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < count; i++) {
+            int dst_len = route_addr(AF_INET, i, dst);
+            gateway_addr(AF_INET, i % gateways, gw);
+            add_route(batch, RTM_DELROUTE, AF_INET, dst, dst_len, gw,
+                      ifindex);
+            add_route(batch, RTM_NEWROUTE, AF_INET, dst, dst_len, gw,
+                      ifindex);
+        }
+    }
+}
+
+static bool run_scale(int max_routes, int gateways) {
+    if (!add_gateways(gateways)) {
+        return false;
+    }
+
+    for (int count = 1000; count <= max_routes; count *= 10) {
+        MessageBatch add, del;
+        build_routes(add, RTM_NEWROUTE, AF_INET, count, gateways, ifindex);
+        build_routes(del, RTM_DELROUTE, AF_INET, count, gateways, ifindex);
+
+        char add_name[32], del_name[32];
+        snprintf(add_name, sizeof(add_name), "scale %d add", count);
+        snprintf(del_name, sizeof(del_name), "scale %d delete", count);
+        if (!run_phase(add_name, routes, add, count, count, count) ||
+            !run_phase(del_name, routes, del, count, count, -count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_flap(int max_routes, int gateways, int rounds) {
+    int count = min(max_routes, SCENARIO_ROUTES);
+    if (!add_gateways(gateways)) {
+        return false;
+    }
+
+    MessageBatch add, del, flaps;
+    build_routes(add, RTM_NEWROUTE, AF_INET, count, gateways, ifindex);
+    build_routes(del, RTM_DELROUTE, AF_INET, count, gateways, ifindex);
+    build_flaps(flaps, count, gateways, rounds);
+
+    /* Each round moves the routes to the next gateway and back, as
+     * "ip route replace" does. Every move takes a RouteMod to delete the old
+     * flow and one to add the new one. */
+    MessageBatch moves;
+    for (int round = 0; round < rounds; round++) {
+        build_routes(moves, RTM_NEWROUTE, AF_INET, count, gateways, ifindex,
+                     1, NLM_F_REPLACE);
+        build_routes(moves, RTM_NEWROUTE, AF_INET, count, gateways, ifindex,
+                     0, NLM_F_REPLACE);
+    }
+
+    int flapped = 2 * rounds * count;
+    if (!run_phase("flap routes add", routes, add, count, count, count) ||
+        !run_phase("flap withdraw/announce", routes, flaps, flapped, flapped,
+                   0)) {
+        return false;
+    }
+
+    /* With one gateway, routes have nowhere to move to. */
+    int moved = 2 * rounds * count;
+    if (gateways > 1 &&
+        !run_phase("flap next-hop moves", routes, moves, moved, 2 * moved,
+                   0)) {
+        return false;
+    }
+
+    return run_phase("flap routes delete", routes, del, count, count, -count);
+}
+
+static bool run_gateways(int max_routes, int gateways) {
+    int count = min(max_routes, SCENARIO_ROUTES);
+    if (!add_gateways(gateways)) {
+        return false;
+    }
+
+    MessageBatch add, del, failed, resolved;
+    build_routes(add, RTM_NEWROUTE, AF_INET, count, gateways, ifindex);
+    build_routes(del, RTM_DELROUTE, AF_INET, count, gateways, ifindex);
+    build_neighbours(failed, AF_INET, gateways, ifindex, 0, NUD_FAILED);
+    build_neighbours(resolved, AF_INET, gateways, ifindex);
+
+    /* A gateway failing withdraws its host flow and the flows of its routes,
+     * and they all come back with it. */
+    int flows = gateways + count;
+    return run_phase("gateways routes add", routes, add, count, count,
+                     count) &&
+           run_phase("gateways fail", neighbours, failed, gateways, flows,
+                     -flows) &&
+           run_phase("gateways resolve", neighbours, resolved, gateways,
+                     flows, flows) &&
+           run_phase("gateways routes delete", routes, del, count, count,
+                     -count);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-s scale|flap|gateways] [-m max_routes] "
+            "[-g gateways] [-G gateways] [-r rounds] [-c] [-F]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *scenario = NULL;
+    int max_routes = DEFAULT_MAX_ROUTES;
+    int gateways = DEFAULT_GATEWAYS;
+    int failing = DEFAULT_FAILING_GATEWAYS;
+    int rounds = DEFAULT_ROUNDS;
+    bool track = true;
+    bool fpm = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:m:g:G:r:cF")) != -1) {
+        switch (c) {
+            case 's':
+                scenario = optarg;
+                break;
+            case 'm':
+                max_routes = atoi(optarg);
+                break;
+            case 'g':
+                gateways = atoi(optarg);
+                break;
+            case 'G':
+                failing = atoi(optarg);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            case 'c':
+                track = false;
+                break;
+            case 'F':
+                fpm = true;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (gateways < 1 || gateways > MAX_GATEWAYS ||
+        failing < 1 || failing > MAX_GATEWAYS) {
+        fprintf(stderr, "The number of gateways must be between 1 and %d\n",
+                MAX_GATEWAYS);
+        return EXIT_FAILURE;
+    }
+    if (scenario != NULL && strcmp(scenario, "scale") != 0 &&
+        strcmp(scenario, "flap") != 0 && strcmp(scenario, "gateways") != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (max_routes < 1 || max_routes > 0xffffff || rounds < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+#ifndef FPM_ENABLED
+    if (fpm) {
+        fprintf(stderr, "FPM support was not built in\n");
+        return EXIT_FAILURE;
+    }
+#endif /* FPM_ENABLED */
+
+    ifindex = if_nametoindex("lo");
+    if (ifindex == 0) {
+        perror("if_nametoindex");
+        return EXIT_FAILURE;
+    }
+
+    /* FlowTable logs every route update. */
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (report == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("Failed to set up the report");
+        return EXIT_FAILURE;
+    }
+
+    Interface iface;
+    iface.port = 1;
+    iface.ifindex = ifindex;
+    iface.name = "lo";
+    iface.hwaddress = MACAddress("02:00:00:00:00:01");
+    iface.active = true;
+    FlowTable::setInterfaces(vector<Interface>(1, iface));
+
+    PortState ports;
+    ipc = new CaptureIPC(track);
+    neighbours = new FeedSource(FlowTable::updateHostTable);
+#ifdef FPM_ENABLED
+    routes = new FeedSource(fpm ? feed_fpm_route : feed_route);
+#else
+    routes = new FeedSource(feed_route);
+#endif /* FPM_ENABLED */
+
+    FlowTable::init(1, ipc, &ports, NULL);
+    boost::thread flowtable(&FlowTable::run, neighbours, routes);
+
+    bool all = scenario == NULL;
+    bool ok = true;
+    if (ok && (all || strcmp(scenario, "scale") == 0)) {
+        ok = run_scale(max_routes, gateways);
+    }
+    if (ok && (all || strcmp(scenario, "flap") == 0)) {
+        ok = run_flap(max_routes, gateways, rounds);
+    }
+    if (ok && (all || strcmp(scenario, "gateways") == 0)) {
+        ok = run_gateways(max_routes, failing);
+    }
+
+    FlowTable::interrupt();
+    flowtable.join();
+
+    fclose(report);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
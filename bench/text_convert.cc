@@ -0,0 +1,288 @@
+/*
+ * Measure conversions per second of MAC addresses, IP addresses and integers
+ * to and from text, with the TextConversion module and with the iostream and
+ * libc based code it replaced. Every result is checked against the old code.
+ *
+ * Usage: text_convert [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "types/TextConversion.h"
+
+#define DEFAULT_ITERATIONS 1000000
+
+/* Number of distinct inputs, cycled through */
+#define SAMPLES 4096
+
+using namespace std;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Keeps the compiler from optimizing conversions away. */
+static volatile size_t sink;
+
+static int mismatches = 0;
+
+static void check(const char *name, const string& expected,
+                  const string& result) {
+    if (expected != result) {
+        if (mismatches++ < 10) {
+            fprintf(stderr, "%s: expected '%s', got '%s'\n", name,
+                    expected.c_str(), result.c_str());
+        }
+    }
+}
+
+/* The code that TextConversion replaced */
+
+static string old_format_mac(const uint8_t *mac) {
+    stringstream ss;
+    ss << hex << setfill('0');
+    for (int i = 0; i < 6; i++) {
+        ss << setw(2) << (int) mac[i];
+        if (i < 5)
+            ss << ':';
+    }
+    return ss.str();
+}
+
+static void old_parse_mac(const string& address, uint8_t *mac) {
+    char sc;
+    int byte;
+    stringstream ss(address);
+    ss << hex;
+    for (int i = 0; i < 6; i++) {
+        ss >> byte;
+        ss >> sc;
+        mac[i] = (uint8_t) byte;
+    }
+}
+
+static string old_format_ip(int family, const uint8_t *addr) {
+    size_t len = family == AF_INET ? INET_ADDRSTRLEN : INET6_ADDRSTRLEN;
+    char *dst = new char[len];
+    inet_ntop(family, addr, dst, len);
+    string result(dst);
+    delete[] dst;
+    return result;
+}
+
+static string old_format_uint64(uint64_t value) {
+    ostringstream ost;
+    ost << value;
+    return ost.str();
+}
+
+static uint64_t old_parse_uint64(const string& str) {
+    uint64_t value = 0;
+    istringstream i(str);
+    i >> value;
+    return value;
+}
+
+struct Samples {
+    vector<uint8_t> macs;
+    vector<uint8_t> ipv4s;
+    vector<uint8_t> ipv6s;
+    vector<uint64_t> ints;
+    vector<string> mac_text, ipv4_text, ipv6_text, int_text;
+};
+
+static void generate(Samples& s) {
+    srand(1);
+    s.macs.resize(SAMPLES * 6);
+    s.ipv4s.resize(SAMPLES * 4);
+    s.ipv6s.resize(SAMPLES * 16);
+    s.ints.resize(SAMPLES);
+
+    for (int i = 0; i < SAMPLES; i++) {
+        for (int j = 0; j < 6; j++) {
+            s.macs[i * 6 + j] = rand();
+        }
+        for (int j = 0; j < 4; j++) {
+            /* Mix of one, two and three digit octets */
+            s.ipv4s[i * 4 + j] = rand() % (j % 2 ? 256 : 100);
+        }
+
+        /* Runs of zero words of random lengths, and some IPv4-mapped
+         * addresses. */
+        uint8_t *a = &s.ipv6s[i * 16];
+        for (int j = 0; j < 8; j++) {
+            uint16_t word = rand() % 3 == 0 ? 0 : rand() >> (rand() % 16);
+            a[2 * j] = word >> 8;
+            a[2 * j + 1] = word & 0xff;
+        }
+        if (i % 16 == 0) {
+            memset(a, 0, 10);
+            a[10] = a[11] = 0xff;
+        }
+
+        s.ints[i] = ((uint64_t) rand() << 32 | rand()) >> (rand() % 64);
+    }
+
+    for (int i = 0; i < SAMPLES; i++) {
+        s.mac_text.push_back(old_format_mac(&s.macs[i * 6]));
+        s.ipv4_text.push_back(old_format_ip(AF_INET, &s.ipv4s[i * 4]));
+        s.ipv6_text.push_back(old_format_ip(AF_INET6, &s.ipv6s[i * 16]));
+        s.int_text.push_back(old_format_uint64(s.ints[i]));
+    }
+}
+
+static void report(const char *name, int n, double t_old, double t_new) {
+    printf("%-14s %12.0f old/s  %12.0f new/s  x%6.1f\n", name,
+           n / t_old, n / t_new, t_old / t_new);
+}
+
+int main(int argc, char *argv[]) {
+    int n = DEFAULT_ITERATIONS;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+            case 'n':
+                n = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    Samples s;
+    generate(s);
+
+    char buf[IPV6_STRLEN];
+    uint8_t addr[16], old_addr[16];
+    uint64_t value;
+    double t0, t1, t2;
+
+    /* Results are checked on a first pass over all the samples, so that
+     * checking does not weigh on the timings. */
+    for (int i = 0; i < SAMPLES; i++) {
+        format_mac(&s.macs[i * 6], buf);
+        check("mac format", s.mac_text[i], buf);
+        format_ipv4(&s.ipv4s[i * 4], buf);
+        check("ipv4 format", s.ipv4_text[i], buf);
+        format_ipv6(&s.ipv6s[i * 16], buf);
+        check("ipv6 format", s.ipv6_text[i], buf);
+        format_uint64(s.ints[i], buf);
+        check("uint64 format", s.int_text[i], buf);
+
+        old_parse_mac(s.mac_text[i], old_addr);
+        if (!parse_mac(s.mac_text[i].c_str(), addr) ||
+            memcmp(addr, old_addr, 6) != 0) {
+            check("mac parse", s.mac_text[i], "");
+        }
+        inet_pton(AF_INET, s.ipv4_text[i].c_str(), old_addr);
+        if (!parse_ipv4(s.ipv4_text[i].c_str(), addr) ||
+            memcmp(addr, old_addr, 4) != 0) {
+            check("ipv4 parse", s.ipv4_text[i], "");
+        }
+        inet_pton(AF_INET6, s.ipv6_text[i].c_str(), old_addr);
+        if (!parse_ipv6(s.ipv6_text[i].c_str(), addr) ||
+            memcmp(addr, old_addr, 16) != 0) {
+            check("ipv6 parse", s.ipv6_text[i], "");
+        }
+        if (!parse_uint64(s.int_text[i].c_str(), value) ||
+            value != old_parse_uint64(s.int_text[i])) {
+            check("uint64 parse", s.int_text[i], "");
+        }
+    }
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += old_format_mac(&s.macs[(i % SAMPLES) * 6]).size();
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += format_mac(&s.macs[(i % SAMPLES) * 6], buf);
+    t2 = now();
+    report("mac format", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++) {
+        old_parse_mac(s.mac_text[i % SAMPLES], addr);
+        sink += addr[0];
+    }
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += parse_mac(s.mac_text[i % SAMPLES].c_str(), addr);
+    t2 = now();
+    report("mac parse", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += old_format_ip(AF_INET, &s.ipv4s[(i % SAMPLES) * 4]).size();
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += format_ipv4(&s.ipv4s[(i % SAMPLES) * 4], buf);
+    t2 = now();
+    report("ipv4 format", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += inet_pton(AF_INET, s.ipv4_text[i % SAMPLES].c_str(), addr);
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += parse_ipv4(s.ipv4_text[i % SAMPLES].c_str(), addr);
+    t2 = now();
+    report("ipv4 parse", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += old_format_ip(AF_INET6, &s.ipv6s[(i % SAMPLES) * 16]).size();
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += format_ipv6(&s.ipv6s[(i % SAMPLES) * 16], buf);
+    t2 = now();
+    report("ipv6 format", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += inet_pton(AF_INET6, s.ipv6_text[i % SAMPLES].c_str(), addr);
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += parse_ipv6(s.ipv6_text[i % SAMPLES].c_str(), addr);
+    t2 = now();
+    report("ipv6 parse", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += old_format_uint64(s.ints[i % SAMPLES]).size();
+    t1 = now();
+    for (int i = 0; i < n; i++)
+        sink += format_uint64(s.ints[i % SAMPLES], buf);
+    t2 = now();
+    report("uint64 format", n, t1 - t0, t2 - t1);
+
+    t0 = now();
+    for (int i = 0; i < n; i++)
+        sink += old_parse_uint64(s.int_text[i % SAMPLES]);
+    t1 = now();
+    for (int i = 0; i < n; i++) {
+        parse_uint64(s.int_text[i % SAMPLES].c_str(), value);
+        sink += value;
+    }
+    t2 = now();
+    report("uint64 parse", n, t1 - t0, t2 - t1);
+
+    if (mismatches != 0) {
+        fprintf(stderr, "%d results differ from the old code\n", mismatches);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
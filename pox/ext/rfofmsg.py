@@ -1,3 +1,4 @@
+import copy
 import binascii
 import logging
 from socket import inet_aton
@@ -91,10 +92,18 @@ def create_flow_mod(routemod):
             ofm_match_tp(ofm, OFPFW_TP_DST, 0, match.get_value())
         elif match._type == RFMT_IN_PORT:
             ofm_match_port(ofm, OFPFW_IN_PORT, match.get_value())
+        elif match._type == RFMT_INGRESS:
+            # Expanded by create_flow_mods
+            pass
+        elif match._type == RFMT_VRF:
+            # OpenFlow 1.0 has a single table and no metadata. rfserver only
+            # builds the ingress points of a route from ports of its VRF, so
+            # the flows of different VRFs are told apart by in_port.
+            pass
         elif match.optional():
-            log.debug("Dropping unsupported Match (type: %s)" % option._type)
+            log.debug("Dropping unsupported Match (type: %s)" % match._type)
         else:
-            log.warning("Failed to serialise Match (type: %s)" % option._type)
+            log.warning("Failed to serialise Match (type: %s)" % match._type)
             return None
 
 
@@ -110,9 +119,9 @@ def create_flow_mod(routemod):
             ofm.actions.append(ofp_action_dl_addr(type=OFPAT_SET_DL_DST,
                                                   dl_addr=EthAddr(value)))
         elif action.optional():
-            log.debug("Dropping unsupported Action (type: %s)" % option._type)
+            log.debug("Dropping unsupported Action (type: %s)" % action._type)
         else:
-            log.warning("Failed to serialise Action (type: %s)" % option._type)
+            log.warning("Failed to serialise Action (type: %s)" % action._type)
             return None
 
     for option in routemod.get_options():
@@ -130,3 +139,37 @@ def create_flow_mod(routemod):
             return None
 
     return ofm
+
+def create_flow_mods(routemod):
+    """Build the flow_mods for a RouteMod.
+
+    OpenFlow 1.0 cannot match on a set of ingress points, so a RouteMod with
+    an RFMT_INGRESS match becomes one flow_mod per (ethernet_dst, in_port).
+    Any other RouteMod becomes a single flow_mod.
+    """
+    ofm = create_flow_mod(routemod)
+    if ofm is None:
+        return []
+
+    points = None
+    vrf = 0
+    for match in routemod.get_matches():
+        if match['type'] == RFMT_INGRESS:
+            points = Match.from_dict(match).get_value()
+        elif match['type'] == RFMT_VRF:
+            vrf = Match.from_dict(match).get_value()
+    if points is None:
+        if vrf != 0:
+            # Without ingress points the flow would take traffic of all VRFs
+            log.warning("Dropping RouteMod for VRF %d with no ingress "
+                        "points" % vrf)
+            return []
+        return [ofm]
+
+    ofms = []
+    for (eth_addr, in_port) in points:
+        point_ofm = copy.deepcopy(ofm)
+        ofm_match_dl(point_ofm, OFPFW_DL_DST, eth_addr)
+        ofm_match_port(point_ofm, OFPFW_IN_PORT, in_port)
+        ofms.append(point_ofm)
+    return ofms
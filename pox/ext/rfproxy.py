@@ -12,7 +12,10 @@ import rflib.ipc.MongoIPC as MongoIPC
 from rflib.ipc.RFProtocol import *
 from rflib.ipc.RFProtocolFactory import RFProtocolFactory
 from rflib.defs import *
+from rflib.dpconfig import *
 from rfofmsg import *
+from rfshadow import *
+import rfrelay
 
 FAILURE = 0
 SUCCESS = 1
@@ -30,6 +33,7 @@ class Table:
             del self.vs_to_dp[old_vs_port]
         self.dp_to_vs[(dp_id, dp_port)] = (vs_id, vs_port)
         self.vs_to_dp[(vs_id, vs_port)] = (dp_id, dp_port)
+        rfrelay.relay.update_dp_port(dp_id, dp_port, vs_id, vs_port)
 
     def dp_port_to_vs_port(self, dp_id, dp_port):
         try:
@@ -52,6 +56,7 @@ class Table:
             id_, port = self.vs_to_dp[key]
             if id_ == dp_id:
                 del self.vs_to_dp[key]
+        rfrelay.relay.delete_dp(dp_id)
 
     # We're not considering the case of this table becoming invalid when a
     # datapath goes down. When the datapath comes back, the server recreates
@@ -67,6 +72,20 @@ ID = 0
 ipc = MongoIPC.MongoIPCMessageService(MONGO_ADDRESS, MONGO_DB_NAME, str(ID),
                                       threading.Thread, time.sleep)
 table = Table()
+# Datapath configurations waiting for a barrier reply:
+# (dp_id, barrier xid) -> (ct_id, DatapathConfig xid)
+pending_configs = {}
+
+# Datapath configurations in resync mode waiting for the flow stats of the
+# switch: (dp_id, stats request xid) -> DatapathConfig
+pending_resyncs = {}
+
+# Batches of flow_mods waiting for a barrier reply:
+# (dp_id, barrier xid) -> [flow_mods, their xids, errors]
+flow_batches = {}
+
+# Whether flush_relay() is scheduled to run
+relay_flush_pending = False
 
 # Logging
 log = core.getLogger("rfproxy")
@@ -84,27 +103,144 @@ def send_of_msg(dp_id, ofmsg):
     else:
         return FAILURE
 
-def send_packet_out(dp_id, port, data):
-    msg = ofp_packet_out()
-    msg.actions.append(ofp_action_output(port=port))
-    msg.data = data
-    msg.in_port = OFPP_NONE
-    topology = core.components['topology']
-    switch = topology.getEntityByID(dp_id)
-    if switch is not None and switch.connected:
-        try:
-            switch.send(msg)
-        except:
-            return FAILURE
-        return SUCCESS
-    else:
-        return FAILURE
+def flush_relay():
+    """Write the packet_outs relayed since the last flush, one write per
+    datapath."""
+    global relay_flush_pending
+    relay_flush_pending = False
+    for (dp_id, data) in rfrelay.relay.flush():
+        send_of_msg(dp_id, data)
+
+def send_flow_batch(dp_id, ofmsgs):
+    """Send flow_mods to a datapath in a single write, followed by a barrier.
+    RFServer is told how many were installed once the barrier reply arrives.
+
+    OpenFlow 1.0 has no bundles, so a batch is not atomic: flow_mods that
+    fail are counted as errors and the others stay installed."""
+    barrier = ofp_barrier_request()
+    xids = set([ofmsg.xid for ofmsg in ofmsgs])
+    flow_batches[(dp_id, barrier.xid)] = [len(ofmsgs), xids, 0]
+
+    data = b"".join([ofmsg.pack() for ofmsg in ofmsgs]) + barrier.pack()
+    if send_of_msg(dp_id, data) != SUCCESS:
+        del flow_batches[(dp_id, barrier.xid)]
+        return False
+    return True
+
+shadow = FlowShadow(send_flow_batch)
+
+def configure_datapath(msg):
+    """Apply a DatapathConfig transaction, and acknowledge it once the switch
+    has processed all of it.
+
+    With DC_RESYNC, the flow table of the switch is read first, and the rest
+    of the transaction is applied once the flow stats arrive."""
+    dp_id = msg.get_dp_id()
+    operations = mask_to_operations(msg.get_operations())
+    if DC_RESYNC not in operations:
+        apply_datapath_config(msg, operations)
+        return
+
+    request = ofp_stats_request(body=ofp_flow_stats_request())
+    pending_resyncs[(dp_id, request.xid)] = msg
+    if send_of_msg(dp_id, request) != SUCCESS:
+        del pending_resyncs[(dp_id, request.xid)]
+        log.info("Error reading flow table of datapath (dp_id=%s)",
+                 format_id(dp_id))
+
+def apply_datapath_config(msg, operations):
+    ct_id, dp_id = msg.get_ct_id(), msg.get_dp_id()
+
+    ofmsgs = []
+    for operation_id in operations:
+        if operation_id == DC_RESYNC:
+            continue
+        elif operation_id == DC_SWEEP:
+            ofmsgs.extend(shadow.sweep(dp_id))
+            continue
+        rm = config_routemod(ct_id, dp_id, operation_id)
+        flow_mods = create_flow_mods(rm)
+        if operation_id == DC_CLEAR_FLOW_TABLE:
+            # A strict delete would only remove the flow that matches
+            # everything at the lowest priority
+            for ofm in flow_mods:
+                ofm.command = OFPFC_DELETE
+            ofmsgs.extend(flow_mods)
+            # Nothing may be installed before the table is cleared
+            ofmsgs.append(ofp_barrier_request())
+        else:
+            ofmsgs.extend(flow_mods)
+
+    barrier = ofp_barrier_request()
+    ofmsgs.append(barrier)
+    pending_configs[(dp_id, barrier.xid)] = (ct_id, msg.get_xid())
+
+    # Flow_mods go through the shadow, which must be flushed before each
+    # barrier so that the barrier covers them
+    flows = 0
+    for ofmsg in ofmsgs:
+        if isinstance(ofmsg, ofp_barrier_request):
+            shadow.flush(dp_id)
+            if send_of_msg(dp_id, ofmsg) != SUCCESS:
+                del pending_configs[(dp_id, barrier.xid)]
+                log.info("Error configuring datapath (dp_id=%s)",
+                         format_id(dp_id))
+                return
+        elif shadow.submit(dp_id, ofmsg):
+            flows += 1
+    log.info("Configuring datapath (dp_id=%s, flows=%d)", format_id(dp_id),
+             flows)
 
 # Event handlers
+def on_barrier_in(event):
+    batch = flow_batches.pop((event.dpid, event.xid), None)
+    if batch is not None:
+        flows, xids, errors = batch
+        msg = FlowBatchAck(ct_id=ID, dp_id=event.dpid, flows=flows,
+                           errors=errors)
+        ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
+        return
+
+    config = pending_configs.pop((event.dpid, event.xid), None)
+    if config is None:
+        return
+
+    ct_id, xid = config
+    msg = DatapathConfigAck(ct_id=ct_id, dp_id=event.dpid, xid=xid)
+    ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
+    log.info("Datapath configured (dp_id=%s)", format_id(event.dpid))
+
+def on_error_in(event):
+    for ((dp_id, barrier_xid), batch) in flow_batches.items():
+        if dp_id == event.dpid and event.xid in batch[1]:
+            batch[2] += 1
+            return
+
+def on_flow_stats(event):
+    dp_id = event.connection.dpid
+    msg = pending_resyncs.pop((dp_id, event.ofp[0].xid), None)
+    if msg is not None:
+        flows = shadow.load(dp_id, event.stats)
+        log.info("Resynchronizing datapath (dp_id=%s, flows=%d)",
+                 format_id(dp_id), flows)
+        apply_datapath_config(msg, mask_to_operations(msg.get_operations()))
+        return
+
+    missing, unexpected = shadow.diff(dp_id, event.stats)
+    if missing or unexpected:
+        log.info("Flow table differs from shadow (dp_id=%s, missing=%d, "
+                 "unexpected=%d)", format_id(dp_id), len(missing),
+                 len(unexpected))
+
 def on_datapath_up(event):
     topology = core.components['topology']
     dp_id = event.dpid
 
+    # RFVS is not configured through a DatapathConfig, clear it here
+    if is_rfvs(dp_id):
+        shadow.submit(dp_id, ofp_flow_mod(match=ofp_match(),
+                                          command=OFPFC_DELETE))
+
     ports = topology.getEntityByID(dp_id).ports
     for port in ports:
         if port <= OFPP_MAX:
@@ -119,22 +255,33 @@ def on_datapath_down(event):
     log.info("Datapath is down (dp_id=%s)", format_id(dp_id))
 
     table.delete_dp(dp_id)
+    shadow.forget(dp_id)
+    for key in flow_batches.keys():
+        if key[0] == dp_id:
+            del flow_batches[key]
+    for key in pending_configs.keys():
+        if key[0] == dp_id:
+            del pending_configs[key]
+    for key in pending_resyncs.keys():
+        if key[0] == dp_id:
+            del pending_resyncs[key]
 
     msg = DatapathDown(ct_id=ID, dp_id=dp_id)
     ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
 
 def on_packet_in(event):
-    packet = event.parsed
+    global relay_flush_pending
     dp_id = event.dpid
     in_port = event.port
+    ethertype = rfrelay.relay.ethertype(event.data)
 
     # Drop all LLDP packets
-    if packet.type == ethernet.LLDP_TYPE:
+    if ethertype == ethernet.LLDP_TYPE:
         return
 
     # If we have a mapping packet, inform RFServer through a Map message
-    if packet.type == RF_ETH_PROTO:
-        vm_id, vm_port = struct.unpack("QB", packet.raw[14:])
+    if ethertype == RF_ETH_PROTO:
+        vm_id, vm_port = struct.unpack("QB", event.data[14:])
 
         log.info("Received mapping packet (vm_id=%s, vm_port=%d, vs_id=%s, vs_port=%d)",
                  format_id(vm_id), vm_port, event.dpid, event.port)
@@ -144,24 +291,17 @@ def on_packet_in(event):
         ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
         return
 
-    # If the packet came from RFVS, redirect it to the right switch port
-    if is_rfvs(event.dpid):
-        dp_port = table.vs_port_to_dp_port(dp_id, in_port)
-        if dp_port is not None:
-            dp_id, dp_port = dp_port
-            send_packet_out(dp_id, dp_port, event.data)
-        else:
-            log.debug("Unmapped RFVS port (vs_id=%s, vs_port=%d)",
-                      format_id(dp_id), in_port)
-    # If the packet came from a switch, redirect it to the right RFVS port
-    else:
-        vs_port = table.dp_port_to_vs_port(dp_id, in_port)
-        if vs_port is not None:
-            vs_id, vs_port = vs_port
-            send_packet_out(vs_id, vs_port, event.data)
-        else:
-            log.debug("Unmapped datapath port (dp_id=%s, dp_port=%d)",
-                      format_id(dp_id), in_port)
+    # Packets from RFVS go to the associated switch port, packets from a
+    # switch to the associated RFVS port. They are queued and written once
+    # the packet-ins received in the same burst have been handled.
+    if not rfrelay.relay.relay(dp_id, in_port, event.data, is_rfvs(dp_id)):
+        log.debug("Unmapped %s port (dp_id=%s, port=%d)",
+                  "RFVS" if is_rfvs(dp_id) else "datapath",
+                  format_id(dp_id), in_port)
+        return
+    if not relay_flush_pending:
+        relay_flush_pending = True
+        core.callLater(flush_relay)
 
 # IPC message Processing
 class RFProcessor(IPC.IPCMessageProcessor):
@@ -169,16 +309,26 @@ class RFProcessor(IPC.IPCMessageProcessor):
         topology = core.components['topology']
         type_ = msg.get_type()
         if type_ == ROUTE_MOD:
+            ofmsgs = []
             try:
-                ofmsg = create_flow_mod(msg)
+                ofmsgs = create_flow_mods(msg)
             except Warning as e:
-                log.info("Error creating FlowMod: {}" % str(e))
-            if send_of_msg(msg.get_id(), ofmsg) == SUCCESS:
-                log.info("routemod sent to datapath (dp_id=%s)",
-                         format_id(msg.get_id()))
+                log.info("Error creating FlowMod: %s" % str(e))
+            # Flow_mods are sent once they have been held for
+            # SHADOW_WINDOW, unless they turn out not to change anything
+            flows = 0
+            for ofmsg in ofmsgs:
+                if shadow.submit(msg.get_id(), ofmsg):
+                    flows += 1
+            if ofmsgs:
+                log.info("routemod queued for datapath (dp_id=%s, flows=%d, "
+                         "suppressed=%d)", format_id(msg.get_id()), flows,
+                         len(ofmsgs) - flows)
             else:
-                log.info("Error sending routemod to datapath (dp_id=%s)",
+                log.info("Error converting routemod for datapath (dp_id=%s)",
                          format_id(msg.get_id()))
+        if type_ == DATAPATH_CONFIG:
+            configure_datapath(msg)
         if type_ == DATA_PLANE_MAP:
             table.update_dp_port(msg.get_dp_id(), msg.get_dp_port(),
                                  msg.get_vs_id(), msg.get_vs_port())
@@ -187,8 +337,15 @@ class RFProcessor(IPC.IPCMessageProcessor):
 
 # Initialization
 def launch ():
+    # RFServer decides whether the flow table of a switch that connects is
+    # cleared or resynchronized
+    core.openflow.clear_flows_on_connect = False
     core.openflow.addListenerByName("ConnectionUp", on_datapath_up)
     core.openflow.addListenerByName("ConnectionDown", on_datapath_down)
     core.openflow.addListenerByName("PacketIn", on_packet_in)
+    core.openflow.addListenerByName("BarrierIn", on_barrier_in)
+    core.openflow.addListenerByName("ErrorIn", on_error_in)
+    core.openflow.addListenerByName("FlowStatsReceived", on_flow_stats)
     ipc.listen(RFSERVER_RFPROXY_CHANNEL, RFProtocolFactory(), RFProcessor(), False)
-    log.info("RFProxy running.")
+    log.info("RFProxy running (native packet relay: %s).",
+             "yes" if rfrelay.native else "no")
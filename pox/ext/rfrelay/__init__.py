@@ -0,0 +1,74 @@
+"""Packet relay between datapath ports and RFVS ports.
+
+Uses the native module built from relay_c when it is available (run
+relay_c/build_linux), and a Python implementation with the same interface
+otherwise.
+
+Packet-ins are queued with relay() and turned into packet_outs for the
+associated port. flush() returns them grouped by destination datapath, so
+that each switch gets a single write per burst.
+"""
+
+import struct
+
+from pox.openflow.libopenflow_01 import *
+
+try:
+    import relay as relayc
+except ImportError:
+    relayc = None
+
+class PyRelay:
+    def __init__(self):
+        self.dp_to_vs = {}
+        self.vs_to_dp = {}
+        self.pending = {}
+        self.relayed = 0
+        self.unmapped = 0
+        self.batches = 0
+
+    def update_dp_port(self, dp_id, dp_port, vs_id, vs_port):
+        # If there was a mapping for this DP port, reset it
+        if (dp_id, dp_port) in self.dp_to_vs:
+            del self.vs_to_dp[self.dp_to_vs[(dp_id, dp_port)]]
+        self.dp_to_vs[(dp_id, dp_port)] = (vs_id, vs_port)
+        self.vs_to_dp[(vs_id, vs_port)] = (dp_id, dp_port)
+
+    def delete_dp(self, dp_id):
+        for key in self.dp_to_vs.keys():
+            if key[0] == dp_id:
+                del self.dp_to_vs[key]
+        for (key, value) in self.vs_to_dp.items():
+            if value[0] == dp_id:
+                del self.vs_to_dp[key]
+        self.pending.pop(dp_id, None)
+
+    def ethertype(self, data):
+        if len(data) < 14:
+            return -1
+        return struct.unpack("!H", data[12:14])[0]
+
+    def relay(self, dp_id, in_port, data, from_vs):
+        table = self.vs_to_dp if from_vs else self.dp_to_vs
+        dest = table.get((dp_id, in_port))
+        if dest is None:
+            self.unmapped += 1
+            return False
+        msg = ofp_packet_out(in_port=OFPP_NONE, data=data)
+        msg.actions.append(ofp_action_output(port=dest[1]))
+        self.pending.setdefault(dest[0], []).append(msg.pack())
+        self.relayed += 1
+        return True
+
+    def flush(self):
+        result = [(dp_id, b"".join(msgs))
+                  for (dp_id, msgs) in self.pending.items()]
+        self.batches += len(result)
+        self.pending = {}
+        return result
+
+    def stats(self):
+        return (self.relayed, self.unmapped, self.batches)
+
+relay = relayc if relayc is not None else PyRelay()
+native = relayc is not None
@@ -0,0 +1,211 @@
+/*
+ * Native packet relay for RFProxy.
+ *
+ * Control traffic between the datapaths and RFVS is relayed by RFProxy as
+ * packet_outs, using the association between datapath ports and RFVS ports.
+ * This module keeps a copy of that association, looks up where each
+ * packet-in must go and builds the packet_outs, appending them to one buffer
+ * per destination so that all those produced in a burst are written to each
+ * switch at once.
+ *
+ * The association itself is managed by RFProxy, which mirrors every change
+ * made to its Table here.
+ */
+
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#define OFP_VERSION 0x01
+#define OFPT_PACKET_OUT 13
+#define OFPAT_OUTPUT 0
+#define OFPP_NONE 0xffff
+#define OFP_NO_BUFFER 0xffffffff
+
+#define ETH_TYPE_OFFSET 12
+
+typedef std::pair<uint64_t, uint32_t> Port;
+
+/* Association between datapath ports and RFVS ports, in both directions */
+static std::map<Port, Port> dp_to_vs;
+static std::map<Port, Port> vs_to_dp;
+
+/* Packet_outs waiting to be written, per destination datapath */
+static std::map<uint64_t, std::string> pending;
+
+static uint32_t next_xid = 0x10000000;
+
+static unsigned long long relayed = 0;
+static unsigned long long unmapped = 0;
+static unsigned long long batches = 0;
+
+struct packet_out {
+    uint8_t version;
+    uint8_t type;
+    uint16_t length;
+    uint32_t xid;
+    uint32_t buffer_id;
+    uint16_t in_port;
+    uint16_t actions_len;
+    /* ofp_action_output */
+    uint16_t action_type;
+    uint16_t action_len;
+    uint16_t port;
+    uint16_t max_len;
+} __attribute__((packed));
+
+static void append_packet_out(std::string& buf, uint32_t port,
+                              const char* data, int len) {
+    struct packet_out msg;
+
+    msg.version = OFP_VERSION;
+    msg.type = OFPT_PACKET_OUT;
+    msg.length = htons(sizeof(msg) + len);
+    msg.xid = htonl(next_xid++);
+    msg.buffer_id = htonl(OFP_NO_BUFFER);
+    msg.in_port = htons(OFPP_NONE);
+    msg.actions_len = htons(8);
+    msg.action_type = htons(OFPAT_OUTPUT);
+    msg.action_len = htons(8);
+    msg.port = htons(port);
+    msg.max_len = 0;
+
+    buf.append((const char*) &msg, sizeof(msg));
+    buf.append(data, len);
+}
+
+static PyObject* r_update_dp_port(PyObject* self, PyObject* args) {
+    unsigned long long dp_id, vs_id;
+    unsigned int dp_port, vs_port;
+    if (!PyArg_ParseTuple(args, "KIKI", &dp_id, &dp_port, &vs_id, &vs_port))
+        return NULL;
+
+    /* If there was a mapping for this datapath port, reset it */
+    Port dp(dp_id, dp_port);
+    std::map<Port, Port>::iterator iter = dp_to_vs.find(dp);
+    if (iter != dp_to_vs.end()) {
+        vs_to_dp.erase(iter->second);
+    }
+
+    Port vs(vs_id, vs_port);
+    dp_to_vs[dp] = vs;
+    vs_to_dp[vs] = dp;
+    Py_RETURN_NONE;
+}
+
+static PyObject* r_delete_dp(PyObject* self, PyObject* args) {
+    unsigned long long dp_id;
+    if (!PyArg_ParseTuple(args, "K", &dp_id))
+        return NULL;
+
+    std::map<Port, Port>::iterator iter = dp_to_vs.begin();
+    while (iter != dp_to_vs.end()) {
+        if (iter->first.first == dp_id) {
+            dp_to_vs.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+
+    iter = vs_to_dp.begin();
+    while (iter != vs_to_dp.end()) {
+        if (iter->second.first == dp_id) {
+            vs_to_dp.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+
+    pending.erase(dp_id);
+    Py_RETURN_NONE;
+}
+
+static PyObject* r_ethertype(PyObject* self, PyObject* args) {
+    const char* data;
+    int len;
+    if (!PyArg_ParseTuple(args, "s#", &data, &len))
+        return NULL;
+
+    if (len < ETH_TYPE_OFFSET + 2) {
+        return PyInt_FromLong(-1);
+    }
+    const uint8_t* p = (const uint8_t*) data + ETH_TYPE_OFFSET;
+    return PyInt_FromLong((p[0] << 8) | p[1]);
+}
+
+static PyObject* r_relay(PyObject* self, PyObject* args) {
+    unsigned long long dp_id;
+    unsigned int in_port;
+    const char* data;
+    int len;
+    int from_vs;
+    if (!PyArg_ParseTuple(args, "KIs#i", &dp_id, &in_port, &data, &len,
+                          &from_vs))
+        return NULL;
+
+    const std::map<Port, Port>& table = from_vs ? vs_to_dp : dp_to_vs;
+    std::map<Port, Port>::const_iterator iter;
+    iter = table.find(Port(dp_id, in_port));
+    if (iter == table.end()) {
+        unmapped++;
+        Py_RETURN_FALSE;
+    }
+
+    append_packet_out(pending[iter->second.first], iter->second.second,
+                      data, len);
+    relayed++;
+    Py_RETURN_TRUE;
+}
+
+static PyObject* r_flush(PyObject* self, PyObject* args) {
+    PyObject* result = PyList_New(0);
+    if (result == NULL)
+        return NULL;
+
+    std::map<uint64_t, std::string>::iterator iter = pending.begin();
+    for (; iter != pending.end(); iter++) {
+        PyObject* item = Py_BuildValue("(Ks#)", iter->first,
+                                       iter->second.data(),
+                                       (int) iter->second.size());
+        if (item == NULL || PyList_Append(result, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+        batches++;
+    }
+    pending.clear();
+    return result;
+}
+
+static PyObject* r_stats(PyObject* self, PyObject* args) {
+    return Py_BuildValue("(KKK)", relayed, unmapped, batches);
+}
+
+static PyMethodDef relaymethods[] = {
+    {"update_dp_port", r_update_dp_port, METH_VARARGS,
+     "Associate a datapath port with an RFVS port."},
+    {"delete_dp", r_delete_dp, METH_VARARGS,
+     "Forget the associations and pending packets of a datapath."},
+    {"ethertype", r_ethertype, METH_VARARGS,
+     "Ethertype of a raw Ethernet frame, or -1 if it is too short."},
+    {"relay", r_relay, METH_VARARGS,
+     "Queue a packet-in for the port it is associated with. Returns False "
+     "if the port is not associated."},
+    {"flush", r_flush, METH_NOARGS,
+     "Return the queued packet_outs as a list of (dp_id, data)."},
+    {"stats", r_stats, METH_NOARGS,
+     "Return (packets relayed, packets unmapped, batches flushed)."},
+    {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC initrelay(void) {
+    Py_InitModule("relay", relaymethods);
+}
@@ -0,0 +1,8 @@
+from distutils.core import setup, Extension
+
+main = Extension("relay", ["relay.cpp"])
+
+setup (name = 'relay',
+       version = '1.0',
+       description = 'Native packet relay for RFProxy',
+       ext_modules = [main])
@@ -0,0 +1,215 @@
+import threading
+from collections import OrderedDict
+
+from pox.core import core
+from pox.openflow.libopenflow_01 import *
+
+from rflib.defs import *
+
+log = core.getLogger("rfproxy")
+
+# Seconds that flow_mods are held before being sent to a datapath, so that a
+# flow added and removed again in the meantime never reaches the switch
+SHADOW_WINDOW = 0.05
+
+# Flow_mods queued for a datapath beyond which they are sent without waiting
+# for the window to end
+MAX_BATCH = 512
+
+def flow_key(flow):
+    """Key of a flow_mod or flow stats entry: its match and priority."""
+    return (flow.match.pack(flow_mod=True), flow.priority)
+
+def actions_key(flow):
+    return "".join([action.pack() for action in flow.actions])
+
+class FlowShadow:
+    """Shadow of the flows installed on each datapath.
+
+    Flow_mods go through submit(), which drops those that would not change
+    the switch: adding a flow that is already installed with the same
+    actions, or deleting one that is not installed. Flow_mods are queued for
+    SHADOW_WINDOW seconds, and an add and a delete of the same flow within
+    that window cancel out. The queue of a datapath is handed to the send
+    function as one batch.
+
+    Only permanent flows added with OFPFC_ADD and removed with
+    OFPFC_DELETE_STRICT are tracked. Any other flow_mod is sent right after
+    the queue is flushed, and the shadow forgets what that flow_mod may have
+    changed. A non-strict delete of all flows leaves the table empty, and
+    fully known.
+
+    Until the flow table of a datapath has been cleared through us, flows we
+    do not know about may be installed, so deletes are never dropped.
+
+    Instead of being cleared, the flow table can be loaded from the flow
+    stats of the datapath. The flows loaded this way are stale until a
+    flow_mod for them is submitted, and sweep() removes those that are still
+    stale.
+    """
+
+    def __init__(self, send):
+        # Function taking (dp_id, list of flow_mods) and returning whether
+        # they were sent
+        self.send = send
+        self.lock = threading.RLock()
+        # dp_id -> {flow key: actions key}
+        self.flows = {}
+        # Datapaths whose flow table is fully known
+        self.complete = set()
+        # dp_id -> {flow key: flow stats entry} of flows loaded from the
+        # datapath and not submitted since
+        self.stale = {}
+        # dp_id -> OrderedDict of flow key -> flow_mod waiting to be sent
+        self.queues = {}
+        self.timers = {}
+        self.suppressed = 0
+
+    def submit(self, dp_id, ofm):
+        """Queue a flow_mod for a datapath. Returns False if it was dropped
+        because it would not change the switch."""
+        with self.lock:
+            if dp_id in self.stale:
+                self.stale[dp_id].pop(flow_key(ofm), None)
+
+            if not self._tracked(ofm):
+                self.flush(dp_id)
+                if ofm.command in (OFPFC_ADD, OFPFC_MODIFY_STRICT,
+                                   OFPFC_DELETE_STRICT):
+                    self.flows.get(dp_id, {}).pop(flow_key(ofm), None)
+                    self.complete.discard(dp_id)
+                else:
+                    self.forget(dp_id)
+                if self.send(dp_id, [ofm]) and \
+                   ofm.command == OFPFC_DELETE and ofm.match == ofp_match():
+                    self.reset(dp_id)
+                return True
+
+            key = flow_key(ofm)
+            flows = self.flows.setdefault(dp_id, {})
+            queue = self.queues.setdefault(dp_id, OrderedDict())
+            queued = queue.pop(key, None)
+
+            if ofm.command == OFPFC_ADD:
+                if flows.get(key) == actions_key(ofm):
+                    # Already installed, cancel whatever was queued
+                    self.suppressed += 1
+                    return False
+                if queued is not None and queued.command == OFPFC_ADD and \
+                   actions_key(queued) == actions_key(ofm):
+                    queue[key] = queued
+                    self.suppressed += 1
+                    return False
+                queue[key] = ofm
+            else:
+                if key not in flows and dp_id in self.complete:
+                    # Not installed, any queued add is simply cancelled
+                    self.suppressed += 1
+                    return False
+                queue[key] = ofm
+
+            if len(queue) >= MAX_BATCH:
+                self.flush(dp_id)
+            elif dp_id not in self.timers:
+                timer = threading.Timer(SHADOW_WINDOW, self.flush, (dp_id,))
+                timer.daemon = True
+                self.timers[dp_id] = timer
+                timer.start()
+            return True
+
+    def flush(self, dp_id):
+        """Send all the flow_mods queued for a datapath now."""
+        with self.lock:
+            timer = self.timers.pop(dp_id, None)
+            if timer is not None:
+                timer.cancel()
+            queue = self.queues.pop(dp_id, None)
+            if not queue:
+                return
+
+            if not self.send(dp_id, queue.values()):
+                log.info("Error sending %d flow_mods to datapath (dp_id=%s)",
+                         len(queue), format_id(dp_id))
+                return
+
+            flows = self.flows.setdefault(dp_id, {})
+            for (key, ofm) in queue.items():
+                if ofm.command == OFPFC_ADD:
+                    flows[key] = actions_key(ofm)
+                else:
+                    flows.pop(key, None)
+
+    def reset(self, dp_id):
+        """Record that the flow table of a datapath has just been cleared."""
+        with self.lock:
+            self._drop_queue(dp_id)
+            self.flows[dp_id] = {}
+            self.stale.pop(dp_id, None)
+            self.complete.add(dp_id)
+
+    def load(self, dp_id, stats):
+        """Replace the shadow of a datapath with the flow stats it reported,
+        marking every flow as stale. Returns the number of flows loaded.
+
+        Flows with a timeout are left alone, as they are not tracked."""
+        with self.lock:
+            self._drop_queue(dp_id)
+            flows = {}
+            stale = {}
+            for flow in stats:
+                if flow.idle_timeout != 0 or flow.hard_timeout != 0:
+                    continue
+                key = flow_key(flow)
+                flows[key] = actions_key(flow)
+                stale[key] = flow
+            self.flows[dp_id] = flows
+            self.stale[dp_id] = stale
+            self.complete.add(dp_id)
+            return len(flows)
+
+    def sweep(self, dp_id):
+        """Return the flow_mods deleting the flows of a datapath that are
+        still stale, and stop tracking staleness for it."""
+        with self.lock:
+            stale = self.stale.pop(dp_id, {})
+            return [ofp_flow_mod(command=OFPFC_DELETE_STRICT,
+                                 match=flow.match, priority=flow.priority)
+                    for flow in stale.values()]
+
+    def forget(self, dp_id):
+        """Forget everything about a datapath, e.g. when it disconnects."""
+        with self.lock:
+            self._drop_queue(dp_id)
+            self.flows.pop(dp_id, None)
+            self.stale.pop(dp_id, None)
+            self.complete.discard(dp_id)
+
+    def diff(self, dp_id, stats):
+        """Compare the shadow with the flow stats reported by a datapath.
+
+        Returns a tuple of two lists of flow keys: flows missing from the
+        switch, and flows on the switch that the shadow does not know or
+        knows with other actions.
+        """
+        with self.lock:
+            flows = self.flows.get(dp_id, {})
+            seen = set()
+            unexpected = []
+            for flow in stats:
+                key = flow_key(flow)
+                seen.add(key)
+                if flows.get(key) != actions_key(flow):
+                    unexpected.append(key)
+            missing = [key for key in flows if key not in seen]
+            return (missing, unexpected)
+
+    def _tracked(self, ofm):
+        if ofm.idle_timeout != 0 or ofm.hard_timeout != 0:
+            return False
+        return ofm.command in (OFPFC_ADD, OFPFC_DELETE_STRICT)
+
+    def _drop_queue(self, dp_id):
+        timer = self.timers.pop(dp_id, None)
+        if timer is not None:
+            timer.cancel()
+        self.queues.pop(dp_id, None)
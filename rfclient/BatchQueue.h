@@ -0,0 +1,106 @@
+#ifndef __BATCH_QUEUE_H__
+#define __BATCH_QUEUE_H__
+
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition.hpp>
+
+/* Number of items per block of a batch */
+#define BATCH_BLOCK_SIZE 256
+
+/* Number of free blocks kept for reuse. Blocks released beyond this are
+ * freed, so that a one-off burst does not pin its memory. */
+#define BATCH_MAX_FREE_BLOCKS 256
+
+/**
+ * Queue handing items over from producers to a single consumer in batches.
+ *
+ * Items are copied into fixed-size blocks, filled one after the other. The
+ * consumer takes all the blocks filled so far at once, and hands them back
+ * when it is done with them, on its next call. Blocks are recycled rather
+ * than freed, so once the queue has seen a burst, queueing an item no longer
+ * touches the heap.
+ */
+template<typename T>
+class BatchQueue {
+    public:
+        struct Block {
+            T items[BATCH_BLOCK_SIZE];
+            size_t count;
+        };
+        typedef std::vector<Block*> Batch;
+
+    private:
+        typedef boost::mutex MutexType;
+        typedef boost::unique_lock<MutexType> ScopedLock;
+        typedef boost::condition ConditionType;
+
+        Batch blocks_;
+        Batch free_;
+        mutable MutexType mutex_;
+        ConditionType condition_;
+
+        /* Must be called with mutex_ held. */
+        void release(Batch& batch) {
+            typename Batch::iterator iter = batch.begin();
+            for (; iter != batch.end(); iter++) {
+                if (free_.size() < BATCH_MAX_FREE_BLOCKS) {
+                    free_.push_back(*iter);
+                } else {
+                    delete *iter;
+                }
+            }
+            batch.clear();
+        }
+    public:
+        ~BatchQueue() {
+            typename Batch::iterator iter = blocks_.begin();
+            for (; iter != blocks_.end(); iter++) {
+                delete *iter;
+            }
+            for (iter = free_.begin(); iter != free_.end(); iter++) {
+                delete *iter;
+            }
+        }
+
+        bool empty() const {
+            ScopedLock lock(mutex_);
+            return blocks_.empty();
+        }
+
+        void push(const T& t) {
+            ScopedLock lock(mutex_);
+            bool empty = blocks_.empty();
+            if (empty || blocks_.back()->count == BATCH_BLOCK_SIZE) {
+                Block* block;
+                if (free_.empty()) {
+                    block = new Block();
+                } else {
+                    block = free_.back();
+                    free_.pop_back();
+                }
+                block->count = 0;
+                blocks_.push_back(block);
+            }
+            Block* block = blocks_.back();
+            block->items[block->count++] = t;
+            lock.unlock();
+            if (empty) {
+                condition_.notify_one();
+            }
+        }
+
+        /* Hand back the blocks of 'batch', wait until an item is queued,
+         * then move all the blocks filled so far to 'batch'. */
+        void wait_and_pop_all(Batch& batch) {
+            ScopedLock lock(mutex_);
+            release(batch);
+            while (blocks_.empty()) {
+                condition_.wait(lock);
+            }
+            batch.swap(blocks_);
+        }
+};
+
+#endif /* __BATCH_QUEUE_H__ */
@@ -110,6 +110,11 @@ int FPMServer::accept_conn(int listen_sock) {
 
     while (1) {
         trace(1, "Waiting for client connection...");
+        if (UpdateSource::waitForInput(listen_sock) < 0) {
+            err_msg("Failed to wait for connections: %s", strerror(errno));
+            continue;
+        }
+
         client_len = sizeof(client_addr);
         sock = accept(listen_sock, (struct sockaddr *) &client_addr,
                         &client_len);
@@ -156,6 +161,10 @@ FPMServer::read_fpm_msg(char *buf, size_t buf_len) {
         }
 
         trace(3, "Looking to read %d bytes", need_len);
+        if (UpdateSource::waitForInput(glob->sock) < 0) {
+            err_msg("Failed to wait for data: %s", strerror(errno));
+            return NULL;
+        }
         bytes_read = read(glob->sock, cur, need_len);
 
         if (bytes_read <= 0) {
@@ -250,12 +259,21 @@ void FPMServer::start() {
     }
 
     /*
-     * Server forever.
+     * Serve until the thread is interrupted.
      */
-    while (1) {
-        glob->sock = FPMServer::accept_conn(glob->server_sock);
-        FPMServer::fpm_serve();
-        trace(1, "Done serving client");
+    try {
+        while (1) {
+            glob->sock = FPMServer::accept_conn(glob->server_sock);
+            FPMServer::fpm_serve();
+            close(glob->sock);
+            trace(1, "Done serving client");
+        }
+    } catch (boost::thread_interrupted&) {
+        if (glob->sock > 0) {
+            close(glob->sock);
+        }
+        close(glob->server_sock);
+        throw;
     }
 }
 
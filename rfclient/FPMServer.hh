@@ -2,10 +2,12 @@
 #define RFCLIENT_FPMSERVER_H_
 
 #include "fpm.h"
+#include "UpdateSource.hh"
 
 class FPMServer {
     public:
         static void start();
+        static void process_fpm_msg(fpm_msg_hdr_t* hdr);
 
     private:
         static int create_listen_sock(int port, int* sock_p);
@@ -13,7 +15,16 @@ class FPMServer {
         static void fpm_serve();
         static void print_nhlfe(const nhlfe_msg_t *msg);
         static fpm_msg_hdr_t* read_fpm_msg (char* buf, size_t buf_len);
-        static void process_fpm_msg(fpm_msg_hdr_t* hdr);
+};
+
+/**
+ * Routes pushed by the routing daemon over its FPM connection.
+ */
+class FPMSource : public UpdateSource {
+    public:
+        void run() {
+            FPMServer::start();
+        }
 };
 
 #endif /* RFCLIENT_FPMSERVER_H_ */
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstring>
+
+#include "FlowSnapshot.hh"
+
+#define SNAPSHOT_MAGIC 0x52465353 /* "RFSS" */
+#define SNAPSHOT_VERSION 1
+
+/* Number of records in a new snapshot file. The file is doubled in size
+ * whenever it fills up. */
+#define SNAPSHOT_INITIAL_ENTRIES 4096
+
+struct snapshot_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t vm_id;
+    uint32_t capacity;
+    uint32_t reserved[3];
+};
+
+bool FlowRecord::operator==(const FlowRecord& other) const {
+    return (this->version == other.version) and
+        (this->prefix_len == other.prefix_len) and
+        (this->vrf == other.vrf) and
+        (this->port == other.port) and
+        (memcmp(this->address, other.address, sizeof(this->address)) == 0) and
+        (memcmp(this->src_hwaddress, other.src_hwaddress,
+                sizeof(this->src_hwaddress)) == 0) and
+        (memcmp(this->dst_hwaddress, other.dst_hwaddress,
+                sizeof(this->dst_hwaddress)) == 0);
+}
+
+FlowSnapshot::FlowSnapshot() {
+    this->fd = -1;
+    this->base = NULL;
+    this->length = 0;
+    this->capacity = 0;
+    this->stale_time = 0;
+}
+
+FlowSnapshot::~FlowSnapshot() {
+    this->close();
+}
+
+/**
+ * Map the snapshot file at 'path', creating it if needed, and load the flows
+ * left by the previous run as stale.
+ *
+ * A file written by a different VM, or in an unknown format, is discarded.
+ *
+ * Returns 0 on success, or -1 if the file cannot be used. In that case
+ * FlowTable runs without a snapshot, as if graceful restart was disabled.
+ */
+int FlowSnapshot::open(const string& path, uint64_t vm_id,
+                       unsigned int stale_time) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    struct snapshot_header header;
+    struct stat st;
+
+    this->stale_time = stale_time;
+    this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd < 0) {
+        perror("FlowSnapshot");
+        return -1;
+    }
+
+    bool valid = false;
+    if (fstat(this->fd, &st) < 0) {
+        st.st_size = 0;
+    } else if (st.st_size >= (off_t) sizeof(header) &&
+        pread(this->fd, &header, sizeof(header), 0) == sizeof(header)) {
+        valid = header.magic == SNAPSHOT_MAGIC &&
+                header.version == SNAPSHOT_VERSION &&
+                header.record_size == sizeof(FlowRecord) &&
+                header.vm_id == vm_id && header.capacity > 0 &&
+                st.st_size >= (off_t) (sizeof(header) +
+                                       header.capacity * sizeof(FlowRecord));
+    }
+
+    if (!valid) {
+        if (st.st_size > 0) {
+            fprintf(stderr, "Discarding unusable snapshot %s\n", path.c_str());
+        }
+        if (ftruncate(this->fd, 0) < 0 ||
+            this->map_file(SNAPSHOT_INITIAL_ENTRIES) < 0) {
+            this->close();
+            return -1;
+        }
+
+        struct snapshot_header* hdr = (struct snapshot_header*) this->base;
+        hdr->magic = SNAPSHOT_MAGIC;
+        hdr->version = SNAPSHOT_VERSION;
+        hdr->record_size = sizeof(FlowRecord);
+        hdr->vm_id = vm_id;
+        return 0;
+    }
+
+    if (this->map_file(header.capacity) < 0) {
+        this->close();
+        return -1;
+    }
+
+    FlowRecord* recs = this->entries();
+    this->freeSlots.clear();
+    for (uint32_t i = this->capacity; i > 0; i--) {
+        FlowRecord& rec = recs[i - 1];
+        bool sane = rec.used == 1 &&
+                    ((rec.version == IPV4 && rec.prefix_len <= 32) ||
+                     (rec.version == IPV6 && rec.prefix_len <= 128));
+        string k = key(rec);
+
+        if (!sane || this->slots.find(k) != this->slots.end()) {
+            rec.used = 0;
+            this->freeSlots.push_back(i - 1);
+            continue;
+        }
+
+        this->slots[k] = i - 1;
+        this->staleRecords[k] = rec;
+    }
+
+    fprintf(stdout, "Loaded %zu flows from snapshot %s\n",
+            this->staleRecords.size(), path.c_str());
+    return 0;
+}
+
+void FlowSnapshot::close() {
+    if (this->base != NULL) {
+        msync(this->base, this->length, MS_SYNC);
+        munmap(this->base, this->length);
+        this->base = NULL;
+    }
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+    this->length = 0;
+    this->capacity = 0;
+    this->slots.clear();
+    this->staleRecords.clear();
+    this->freeSlots.clear();
+}
+
+unsigned int FlowSnapshot::get_stale_time() const {
+    return this->stale_time;
+}
+
+/**
+ * Build the record for a flow, from the same arguments that are used to build
+ * its RouteMod.
+ */
+FlowRecord FlowSnapshot::record(const IPAddress& addr, const IPAddress& mask,
+                                const Interface& iface,
+                                const MACAddress& gateway, uint32_t vrf) {
+    FlowRecord rec;
+    memset(&rec, 0, sizeof(rec));
+
+    rec.version = addr.getVersion();
+    rec.prefix_len = mask.toPrefixLen();
+    rec.port = iface.port;
+    rec.vrf = vrf;
+    addr.toArray(rec.address);
+    iface.hwaddress.toArray(rec.src_hwaddress);
+    gateway.toArray(rec.dst_hwaddress);
+    return rec;
+}
+
+/**
+ * Check whether the given flow is still installed from the previous run.
+ *
+ * Returns true if an identical flow was installed and has not been confirmed
+ * yet, in which case it is now considered current and does not need to be
+ * sent again. Returns false otherwise.
+ */
+bool FlowSnapshot::adopt(const FlowRecord& rec) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+
+    map<string, FlowRecord>::iterator iter;
+    iter = this->staleRecords.find(key(rec));
+    if (iter == this->staleRecords.end() || !(iter->second == rec)) {
+        return false;
+    }
+
+    this->staleRecords.erase(iter);
+    return true;
+}
+
+/**
+ * Record that the given flow has been sent to RFServer, replacing any flow
+ * previously stored with the same match.
+ */
+void FlowSnapshot::store(const FlowRecord& rec) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    if (this->base == NULL) {
+        return;
+    }
+
+    const string k = key(rec);
+    this->staleRecords.erase(k);
+
+    uint32_t slot;
+    map<string, uint32_t>::iterator iter = this->slots.find(k);
+    if (iter != this->slots.end()) {
+        slot = iter->second;
+    } else {
+        if (this->freeSlots.empty() && this->grow() < 0) {
+            fprintf(stderr, "Snapshot is full, flow will not survive a "
+                    "restart\n");
+            return;
+        }
+        slot = this->freeSlots.back();
+        this->freeSlots.pop_back();
+        this->slots[k] = slot;
+    }
+
+    /* Only mark the slot as used once the rest of the record is in place. */
+    FlowRecord& entry = this->entries()[slot];
+    FlowRecord copy = rec;
+    copy.used = entry.used;
+    entry = copy;
+    entry.used = 1;
+}
+
+/**
+ * Record that the flow with the same match as the given one has been
+ * withdrawn.
+ */
+void FlowSnapshot::erase(const FlowRecord& rec) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    if (this->base == NULL) {
+        return;
+    }
+
+    const string k = key(rec);
+    this->staleRecords.erase(k);
+
+    map<string, uint32_t>::iterator iter = this->slots.find(k);
+    if (iter == this->slots.end()) {
+        return;
+    }
+
+    this->entries()[iter->second].used = 0;
+    this->freeSlots.push_back(iter->second);
+    this->slots.erase(iter);
+}
+
+/**
+ * End the stale period. Every flow from the previous run that has not been
+ * adopted is appended to 'stale', and is no longer eligible for adoption.
+ *
+ * The records are kept in the snapshot until the flows are withdrawn.
+ *
+ * Returns the number of stale flows.
+ */
+size_t FlowSnapshot::expire(vector<FlowRecord>& stale) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+
+    map<string, FlowRecord>::iterator iter = this->staleRecords.begin();
+    for (; iter != this->staleRecords.end(); iter++) {
+        stale.push_back(iter->second);
+    }
+
+    size_t count = this->staleRecords.size();
+    this->staleRecords.clear();
+
+    if (this->base != NULL) {
+        msync(this->base, this->length, MS_ASYNC);
+    }
+    return count;
+}
+
+FlowRecord* FlowSnapshot::entries() const {
+    return (FlowRecord*) ((char*) this->base + sizeof(struct snapshot_header));
+}
+
+/**
+ * (Re)map the snapshot file, sized to hold 'capacity' records. The file is
+ * extended with zeroes, which are free slots.
+ */
+int FlowSnapshot::map_file(uint32_t capacity) {
+    size_t length = sizeof(struct snapshot_header) +
+                    capacity * sizeof(FlowRecord);
+
+    struct stat st;
+    if (fstat(this->fd, &st) < 0) {
+        perror("FlowSnapshot");
+        return -1;
+    }
+    if (st.st_size < (off_t) length && ftruncate(this->fd, length) < 0) {
+        perror("FlowSnapshot");
+        return -1;
+    }
+
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      this->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("FlowSnapshot");
+        return -1;
+    }
+
+    this->base = base;
+    this->length = length;
+    this->capacity = capacity;
+    ((struct snapshot_header*) base)->capacity = capacity;
+
+    for (uint32_t i = capacity; i > 0; i--) {
+        if (this->entries()[i - 1].used == 0) {
+            this->freeSlots.push_back(i - 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Double the number of slots in the snapshot. Must be called with the mutex
+ * held, and only when there are no free slots left.
+ */
+int FlowSnapshot::grow() {
+    uint32_t capacity = this->capacity * 2;
+    void* old_base = this->base;
+    size_t old_length = this->length;
+
+    msync(old_base, old_length, MS_SYNC);
+    munmap(old_base, old_length);
+    this->base = NULL;
+
+    if (this->map_file(capacity) < 0) {
+        /* Put the previous mapping back so that existing records can still
+         * be updated. */
+        this->map_file(this->capacity);
+        return -1;
+    }
+    return 0;
+}
+
+string FlowSnapshot::key(const FlowRecord& rec) {
+    char buf[sizeof(rec.vrf) + sizeof(rec.address) + 2];
+
+    memcpy(buf, &rec.vrf, sizeof(rec.vrf));
+    buf[sizeof(rec.vrf)] = rec.version;
+    memcpy(buf + sizeof(rec.vrf) + 1, rec.address, sizeof(rec.address));
+    buf[sizeof(buf) - 1] = rec.prefix_len;
+    return string(buf, sizeof(buf));
+}
@@ -0,0 +1,94 @@
+#ifndef FLOWSNAPSHOT_HH
+#define FLOWSNAPSHOT_HH
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "types/IPAddress.h"
+#include "types/MACAddress.h"
+#include "Interface.hh"
+
+#define DEFAULT_SNAPSHOT_PATH "/var/lib/rfclient/flows.snapshot"
+
+/* Seconds that flows installed by a previous run are kept after a restart,
+ * waiting to be confirmed by the kernel or the routing daemon. */
+#define DEFAULT_STALE_TIME 60
+
+using namespace std;
+
+/**
+ * One flow sent to RFServer, as stored in the snapshot file.
+ *
+ * This holds everything that ends up in the RouteMod, so that two records
+ * comparing equal mean the flow on the switch does not need to be rewritten.
+ */
+struct FlowRecord {
+    uint8_t used;
+    uint8_t version;
+    uint8_t prefix_len;
+    uint8_t reserved;
+    uint32_t port;
+    uint8_t address[16];
+    uint8_t src_hwaddress[IFHWADDRLEN];
+    uint8_t dst_hwaddress[IFHWADDRLEN];
+    uint32_t vrf;
+
+    bool operator==(const FlowRecord& other) const;
+};
+
+/**
+ * Memory-mapped record of the flows this client has installed.
+ *
+ * Every RouteMod sent to RFServer is mirrored in the snapshot file, one slot
+ * per flow, so the file always describes what the switch holds on our behalf.
+ * The data is written straight to the mapping, which the kernel keeps even if
+ * rfclient crashes.
+ *
+ * On startup, the records left by the previous run are loaded as stale. A flow
+ * that is installed again with identical contents is adopted and not sent
+ * again. Once the stale period is over, whatever has not been adopted is
+ * handed back so that it can be withdrawn.
+ *
+ * All methods are thread-safe.
+ */
+class FlowSnapshot {
+    public:
+        FlowSnapshot();
+        ~FlowSnapshot();
+
+        int open(const string& path, uint64_t vm_id, unsigned int stale_time);
+        void close();
+
+        unsigned int get_stale_time() const;
+
+        static FlowRecord record(const IPAddress& addr, const IPAddress& mask,
+                                 const Interface& iface,
+                                 const MACAddress& gateway, uint32_t vrf);
+
+        bool adopt(const FlowRecord& rec);
+        void store(const FlowRecord& rec);
+        void erase(const FlowRecord& rec);
+        size_t expire(vector<FlowRecord>& stale);
+
+    private:
+        mutable boost::mutex mutex;
+        int fd;
+        void* base;
+        size_t length;
+        uint32_t capacity;
+        unsigned int stale_time;
+
+        map<string, uint32_t> slots;
+        map<string, FlowRecord> staleRecords;
+        vector<uint32_t> freeSlots;
+
+        FlowRecord* entries() const;
+        int map_file(uint32_t capacity);
+        int grow();
+        static string key(const FlowRecord& rec);
+};
+
+#endif /* FLOWSNAPSHOT_HH */
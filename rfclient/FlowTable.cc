@@ -24,6 +24,17 @@ using namespace std;
 
 #define EMPTY_MAC_ADDRESS "00:00:00:00:00:00"
 
+/* UDP port that neighbour discovery probes are sent to (discard) */
+#define ND_PROBE_PORT 9
+
+/* Upper bound on the number of neighbours we keep track of. Beyond this, the
+ * least recently confirmed hosts that no route depends on are evicted. */
+#define MAX_HOST_ENTRIES 16384
+
+/* Neighbour states in which the kernel holds a usable link-layer address */
+#define NUD_RESOLVED (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | NUD_PROBE \
+                      | NUD_STALE | NUD_DELAY)
+
 const MACAddress FlowTable::MAC_ADDR_NONE(EMPTY_MAC_ADDRESS);
 
 int FlowTable::family = AF_UNSPEC;
@@ -34,168 +45,910 @@ int FlowTable::lroute = 0;
 
 boost::thread FlowTable::GWResolver;
 boost::thread FlowTable::HTPolling;
+boost::thread FlowTable::RTPolling;
+boost::thread FlowTable::Reconciler;
 struct rtnl_handle FlowTable::rthNeigh;
 
-#ifdef FPM_ENABLED
-  boost::thread FlowTable::FPMClient;
-#else
-  boost::thread FlowTable::RTPolling;
+#ifndef FPM_ENABLED
   struct rtnl_handle FlowTable::rth;
 #endif /* FPM_ENABLED */
 
-map<string, Interface> FlowTable::interfaces;
-vector<uint32_t>* FlowTable::down_ports;
+/* Interface records are never modified once added, so entries can refer to
+ * them by handle. Handle 0 stands for no interface. A record is only freed,
+ * and its handle reused, once it has dropped out of the index, no route or
+ * host refers to it and no entry on its way to those tables has it pinned.
+ * interfacesMutex protects the index, the pins and the set of records, and
+ * must be taken before routeTableMutex. Records are read and deleted with
+ * recordsMutex held, which comes after every other lock. */
+boost::mutex interfacesMutex;
+boost::mutex recordsMutex;
+const Interface FlowTable::NO_INTERFACE;
+const Interface* FlowTable::interfaceRecords[MAX_INTERFACE_HANDLES] = {
+    &FlowTable::NO_INTERFACE
+};
+uint32_t FlowTable::interfacePins[MAX_INTERFACE_HANDLES];
+uint32_t FlowTable::interfaceCount = 1;
+InterfaceIndex FlowTable::interfaceIndex(new vector<InterfaceHandle>());
+list<InterfaceHandle> FlowTable::retiredInterfaces;
+vector<InterfaceHandle> FlowTable::freeInterfaces;
+PortState* FlowTable::ports;
+FlowSnapshot* FlowTable::snapshot;
 IPCMessageService* FlowTable::ipc;
 uint64_t FlowTable::vm_id;
 
 typedef std::pair<RouteModType,RouteEntry> PendingRoute;
-SyncQueue<PendingRoute> FlowTable::pendingRoutes;
-list<RouteEntry> FlowTable::routeTable;
+BatchQueue<PendingRoute> FlowTable::pendingRoutes;
+
+/* Lock ordering: routeTableMutex must be taken after interfacesMutex, and
+ * before tablesMutex and hostTableMutex. It protects the route indexes of all
+ * tables. The set of tables is only changed with both routeTableMutex and
+ * tablesMutex held, so holding either is enough to look it up. */
+boost::mutex routeTableMutex;
+boost::mutex tablesMutex;
+map<uint32_t, FlowTable*> FlowTable::tables;
+
+/* Whether the kernel state has been dumped, after which the routes of tables
+ * followed later on are dumped by addTable(). */
+static bool routesDumped = false;
+
 boost::mutex hostTableMutex;
 map<string, HostEntry> FlowTable::hostTable;
+list<string> FlowTable::hostAge;
+map<string, list<string>::iterator> FlowTable::hostAgeIndex;
 
 boost::mutex ndMutex;
-map<string, int> FlowTable::pendingNeighbours;
+set<string> FlowTable::pendingNeighbours;
+vector<struct sockaddr_storage> FlowTable::ndProbes;
+int FlowTable::ndSocket4 = -1;
+int FlowTable::ndSocket6 = -1;
 
 // TODO: implement a way to pause the flow table updates when the VM is not
 //       associated with a valid datapath
 
-void FlowTable::HTPollingCb() {
-    rtnl_listen(&rthNeigh, FlowTable::updateHostTable, NULL);
+/**
+ * Set up the flow table without touching netlink or starting any thread.
+ * start() does this itself; benchmarks call it directly and feed netlink
+ * messages to updateRouteTable() and updateHostTable(), or through run().
+ */
+void FlowTable::init(uint64_t vm_id, IPCMessageService* ipc, PortState* ports,
+                     FlowSnapshot* snapshot) {
+    FlowTable::vm_id = vm_id;
+    FlowTable::ipc = ipc;
+    FlowTable::ports = ports;
+    FlowTable::snapshot = snapshot;
+
+    FlowTable::addTable(RT_TABLE_MAIN, 0);
 }
 
-#ifndef FPM_ENABLED
-void FlowTable::RTPollingCb() {
-    rtnl_listen(&rth, FlowTable::updateRouteTable, NULL);
+FlowTable::FlowTable(uint32_t table, uint32_t vrf) {
+    this->table = table;
+    this->vrf = vrf;
 }
-#endif /* FPM_ENABLED */
 
-void FlowTable::start(uint64_t vm_id, map<string, Interface> interfaces,
-                      IPCMessageService* ipc, vector<uint32_t>* down_ports) {
-    FlowTable::vm_id = vm_id;
-    FlowTable::interfaces = interfaces;
-    FlowTable::ipc = ipc;
-    FlowTable::down_ports = down_ports;
+/**
+ * Start following the given kernel routing table, tagging its flows with
+ * 'vrf'. Does nothing if the table is already followed.
+ *
+ * Routes the kernel already holds in a table followed after startup are read
+ * again, as their updates have been ignored until then.
+ */
+void FlowTable::addTable(uint32_t table, uint32_t vrf) {
+    bool dump;
+    {
+        boost::lock_guard<boost::mutex> rlock(routeTableMutex);
+        boost::lock_guard<boost::mutex> tlock(tablesMutex);
+        if (FlowTable::tables.find(table) != FlowTable::tables.end()) {
+            return;
+        }
+        FlowTable::tables[table] = new FlowTable(table, vrf);
+        dump = routesDumped;
+    }
+    std::cout << "Following routing table " << table << " (vrf=" << vrf
+              << ")" << std::endl;
 
+    if (dump) {
+        FlowTable::dumpRoutes(table);
+    }
+}
+
+/**
+ * Get the instance for the given kernel routing table, or NULL if we do not
+ * follow that table.
+ *
+ * Must be called with routeTableMutex or tablesMutex held.
+ */
+FlowTable* FlowTable::getTable(uint32_t table) {
+    map<uint32_t, FlowTable*>::iterator iter = FlowTable::tables.find(table);
+    if (iter == FlowTable::tables.end()) {
+        return NULL;
+    }
+    return iter->second;
+}
+
+/**
+ * Start tracking the kernel tables.
+ *
+ * If 'snapshot' is not NULL, it holds the flows installed by a previous run.
+ * Those that the current kernel state (or the routing daemon) confirms within
+ * the stale period are adopted as is; the rest are withdrawn afterwards.
+ */
+void FlowTable::start(uint64_t vm_id, IPCMessageService* ipc,
+                      PortState* ports, FlowSnapshot* snapshot) {
+    FlowTable::init(vm_id, ipc, ports, snapshot);
+
+    /* Subscribe before dumping, so that no update is lost in between. */
     rtnl_open(&rthNeigh, RTMGRP_NEIGH);
-    HTPolling = boost::thread(&FlowTable::HTPollingCb);
+#ifndef FPM_ENABLED
+    rtnl_open(&rth, RTMGRP_IPV4_MROUTE | RTMGRP_IPV4_ROUTE
+                  | RTMGRP_IPV6_MROUTE | RTMGRP_IPV6_ROUTE);
+#endif /* FPM_ENABLED */
+    FlowTable::dumpKernelState();
 
+    NetlinkSource neighbours(&rthNeigh, FlowTable::updateHostTable);
 #ifdef FPM_ENABLED
     std::cout << "FPM interface enabled\n";
-    FPMClient = boost::thread(&FPMServer::start);
+    FPMSource routes;
 #else
     std::cout << "Netlink interface enabled\n";
-    rtnl_open(&rth, RTMGRP_IPV4_MROUTE | RTMGRP_IPV4_ROUTE
-                  | RTMGRP_IPV6_MROUTE | RTMGRP_IPV6_ROUTE);
-    RTPolling = boost::thread(&FlowTable::RTPollingCb);
+    NetlinkSource routes(&rth, FlowTable::updateRouteTable);
 #endif /* FPM_ENABLED */
 
+    FlowTable::run(&neighbours, &routes);
+}
+
+/**
+ * Follow the updates of the given sources, each read on a thread of its own,
+ * and resolve the gateways of the routes they bring in. init() must have been
+ * called first.
+ *
+ * Returns once interrupt() has been called and all the threads have stopped,
+ * which takes up to UPDATE_POLL_TIMEOUT milliseconds for the sources.
+ */
+void FlowTable::run(UpdateSource* neighbours, UpdateSource* routes) {
+    HTPolling = boost::thread(&UpdateSource::run, neighbours);
+    RTPolling = boost::thread(&UpdateSource::run, routes);
+
+    if (FlowTable::snapshot != NULL) {
+        Reconciler = boost::thread(&FlowTable::ReconcilerCb);
+    }
+
     GWResolver = boost::thread(&FlowTable::GWResolverCb);
     GWResolver.join();
+
+    HTPolling.join();
+    RTPolling.join();
+    if (Reconciler.joinable()) {
+        Reconciler.join();
+    }
 }
 
 void FlowTable::clear() {
-    FlowTable::routeTable.clear();
-    boost::lock_guard<boost::mutex> lock(hostTableMutex);
+    boost::lock_guard<boost::mutex> rlock(routeTableMutex);
+    map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+    for (; table != FlowTable::tables.end(); table++) {
+        table->second->routes.clear();
+    }
+    boost::lock_guard<boost::mutex> hlock(hostTableMutex);
     FlowTable::hostTable.clear();
+    FlowTable::hostAge.clear();
+    FlowTable::hostAgeIndex.clear();
+}
+
+/**
+ * Get the number of routes held, installed or parked, in all tables, and an
+ * estimate of the memory they take.
+ */
+void FlowTable::routeStats(size_t& routes, size_t& bytes) {
+    boost::lock_guard<boost::mutex> lock(routeTableMutex);
+    routes = 0;
+    bytes = 0;
+
+    map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+    for (; table != FlowTable::tables.end(); table++) {
+        routes += table->second->routes.size();
+        bytes += table->second->routes.memory();
+    }
 }
 
 void FlowTable::interrupt() {
     HTPolling.interrupt();
+    Reconciler.interrupt();
     GWResolver.interrupt();
-#ifdef FPM_ENABLED
-    FPMClient.interrupt();
-#else
     RTPolling.interrupt();
-#endif /* FPM_ENABLED */
 }
 
 void FlowTable::GWResolverCb() {
+    /* Routes are parsed on the stack and copied into the blocks of
+     * pendingRoutes, which are taken from there all at once and handed back
+     * on the next call. */
+    BatchQueue<PendingRoute>::Batch batch;
+
     while (true) {
         boost::this_thread::interruption_point();
 
-        PendingRoute pr;
-        FlowTable::pendingRoutes.wait_and_pop(pr);
+        FlowTable::pendingRoutes.wait_and_pop_all(batch);
 
-        bool existingEntry = false;
-        std::list<RouteEntry>::iterator iter = FlowTable::routeTable.begin();
-        for (; iter != FlowTable::routeTable.end(); iter++) {
-            if (pr.second == *iter) {
-                existingEntry = true;
-                break;
+        /* Let go of the route table after each block, so that neighbour
+         * updates are not held up while a full table is being loaded. */
+        BatchQueue<PendingRoute>::Batch::iterator block = batch.begin();
+        for (; block != batch.end(); block++) {
+            {
+                boost::lock_guard<boost::mutex> lock(routeTableMutex);
+
+                for (size_t i = 0; i < (*block)->count; i++) {
+                    const PendingRoute& pr = (*block)->items[i];
+                    FlowTable* ft = FlowTable::getTable(pr.second.table);
+                    if (ft == NULL) {
+                        continue;
+                    }
+
+                    if (pr.first == RMT_ADD) {
+                        ft->addRoute(pr.second);
+                    } else if (pr.first == RMT_DELETE) {
+                        ft->removeRoute(pr.second);
+                    } else {
+                        fprintf(stderr, "Received unexpected RouteModType "
+                                "(%d)\n", pr.first);
+                    }
+                }
+            }
+
+            /* The routes of the block are in the route tables now, or
+             * dropped: their interfaces need not be pinned any longer. */
+            boost::lock_guard<boost::mutex> lock(interfacesMutex);
+            for (size_t i = 0; i < (*block)->count; i++) {
+                FlowTable::interfacePins[(*block)->items[i].second.interface]--;
             }
         }
 
-        if (existingEntry && pr.first == RMT_ADD) {
-            fprintf(stdout, "Received duplicate route addition for route %s\n",
-                    pr.second.address.toString().c_str());
-            continue;
+        /* Probe all the gateways this batch is waiting for at once. */
+        FlowTable::flushND();
+    }
+}
+
+void FlowTable::ReconcilerCb() {
+    boost::this_thread::sleep(boost::posix_time::seconds(
+            FlowTable::snapshot->get_stale_time()));
+    FlowTable::reconcile();
+}
+
+/**
+ * Read the neighbours the kernel already knows about and, unless routes are
+ * fed by FPM, the routes it already holds.
+ *
+ * Without this, anything learnt before rfclient (re)started would never be
+ * installed. Quagga replays its whole RIB when the FPM connection comes up,
+ * so routes need not be dumped in that case.
+ */
+void FlowTable::dumpKernelState() {
+    struct rtnl_handle rthDump;
+
+    if (rtnl_open(&rthDump, 0) < 0) {
+        fprintf(stderr, "Cannot open netlink socket to dump kernel state\n");
+        return;
+    }
+
+    if (rtnl_wilddump_request(&rthDump, AF_UNSPEC, RTM_GETNEIGH) < 0 ||
+        rtnl_dump_filter(&rthDump, FlowTable::updateHostTable,
+                         NULL, NULL, NULL) < 0) {
+        fprintf(stderr, "Failed to dump the neighbour table\n");
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(routeTableMutex);
+        routesDumped = true;
+    }
+
+#ifndef FPM_ENABLED
+    if (rtnl_wilddump_request(&rthDump, AF_UNSPEC, RTM_GETROUTE) < 0 ||
+        rtnl_dump_filter(&rthDump, FlowTable::updateRouteTable,
+                         NULL, NULL, NULL) < 0) {
+        fprintf(stderr, "Failed to dump the routing table\n");
+    }
+#endif /* FPM_ENABLED */
+
+    rtnl_close(&rthDump);
+}
+
+#ifndef FPM_ENABLED
+/* Hand the routes of the table given by 'arg' to updateRouteTable(). */
+static int dumpTableRoute(const struct sockaddr_nl *who, struct nlmsghdr *n,
+                          void *arg) {
+    struct rtmsg *rtm = (struct rtmsg *) NLMSG_DATA(n);
+    uint32_t table = rtm->rtm_table;
+
+    struct rtattr *rta = RTM_RTA(rtm);
+    int len = RTM_PAYLOAD(n);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == RTA_TABLE) {
+            table = *(uint32_t *) RTA_DATA(rta);
         }
+    }
 
-        if (!existingEntry && pr.first == RMT_DELETE) {
-            fprintf(stdout, "Received route removal for %s but route %s.\n",
-                    pr.second.address.toString().c_str(), "cannot be found");
-            continue;
+    if (table != *(uint32_t *) arg) {
+        return 0;
+    }
+    return FlowTable::updateRouteTable(who, n, NULL);
+}
+#endif /* FPM_ENABLED */
+
+/**
+ * Read the routes the kernel holds in the given table. With FPM, the routing
+ * daemon sends the routes of a VRF once it learns about the VRF device, so
+ * there is nothing to do.
+ */
+void FlowTable::dumpRoutes(uint32_t table) {
+#ifndef FPM_ENABLED
+    struct rtnl_handle rthDump;
+
+    if (rtnl_open(&rthDump, 0) < 0) {
+        fprintf(stderr, "Cannot open netlink socket to dump table %u\n",
+                table);
+        return;
+    }
+
+    if (rtnl_wilddump_request(&rthDump, AF_UNSPEC, RTM_GETROUTE) < 0 ||
+        rtnl_dump_filter(&rthDump, dumpTableRoute, &table, NULL, NULL) < 0) {
+        fprintf(stderr, "Failed to dump routing table %u\n", table);
+    }
+
+    rtnl_close(&rthDump);
+#else
+    (void) table;
+#endif /* FPM_ENABLED */
+}
+
+/**
+ * End the stale period that follows a restart: withdraw every flow from the
+ * previous run that has not been installed again in the meantime.
+ */
+void FlowTable::reconcile() {
+    vector<FlowRecord> stale;
+    FlowTable::snapshot->expire(stale);
+
+    vector<FlowRecord>::iterator iter = stale.begin();
+    for (; iter != stale.end(); iter++) {
+        IPAddress addr(iter->version, iter->address);
+        IPAddress mask(iter->version, (int) iter->prefix_len);
+        Interface iface;
+        iface.port = iter->port;
+        iface.hwaddress = MACAddress(iter->src_hwaddress);
+
+        FlowTable::sendToHw(RMT_DELETE, addr, mask, iface,
+                            FlowTable::MAC_ADDR_NONE, iter->vrf);
+    }
+
+    fprintf(stdout, "Reconciled flows with previous run, withdrew %zu\n",
+            stale.size());
+}
+
+/**
+ * Rebuild the RouteEntry of the route with the given id.
+ */
+RouteEntry FlowTable::routeEntry(uint32_t id) const {
+    RouteEntry re;
+    this->routes.entry(id, re);
+    re.table = this->table;
+    return re;
+}
+
+/**
+ * Install the given route, or park it until its gateway is resolved.
+ *
+ * Only one route is kept per prefix. Another route for a prefix that is
+ * already known takes its place if it goes through the same gateway with the
+ * same metric, if the kernel replaced the known route with it, or if the
+ * kernel prefers it. It is ignored otherwise.
+ *
+ * Must be called with routeTableMutex held.
+ */
+void FlowTable::addRoute(const RouteEntry& re) {
+    uint32_t id = this->routes.find(re);
+    if (id != NO_ROUTE) {
+        const RouteRecord& rec = this->routes.get(id);
+        bool installed = rec.flags & ROUTE_INSTALLED;
+        if (installed && this->routes.matches(id, re) &&
+            rec.interface == re.interface) {
+            fprintf(stdout, "Received duplicate route addition for route "
+                    "%s/%d\n", re.address.toString().c_str(),
+                    re.netmask.toPrefixLen());
+            return;
         }
 
-        const RouteEntry& re = pr.second;
-        if (pr.first != RMT_DELETE &&
-                findHost(re.address) == FlowTable::MAC_ADDR_NONE) {
-            /* Host is unresolved. Attempt to resolve it. */
-            if (resolveGateway(re.gateway, re.interface) < 0) {
-                /* If we can't resolve the gateway, put it to the end of the
-                 * queue. Routes with unresolvable gateways will constantly
-                 * loop through this code, popping and re-pushing. */
-                fprintf(stderr, "An error occurred while %s %s/%s.\n",
-                        "attempting to resolve", re.address.toString().c_str(),
-                        re.netmask.toString().c_str());
-                FlowTable::pendingRoutes.push(pr);
-                continue;
-            }
+        if (!this->routes.replaces(id, re)) {
+            fprintf(stdout, "Ignoring route %s/%d via %s, a preferred route "
+                    "is known\n", re.address.toString().c_str(),
+                    re.netmask.toPrefixLen(), re.gateway.toString().c_str());
+            return;
         }
 
-        if (FlowTable::sendToHw(pr.first, pr.second) < 0) {
-            fprintf(stderr, "An error occurred while pushing route %s/%s.\n",
-                    re.address.toString().c_str(),
+        if (installed) {
+            /* The next-hop for this prefix has changed. Withdraw the old
+             * flows first, as they may match on a different set of input
+             * ports. */
+            this->sendToHw(RMT_DELETE, this->routeEntry(id));
+        }
+        this->routes.erase(id);
+    }
+
+    uint32_t port = getInterface(re.interface).port;
+    if (is_port_down(port)) {
+        /* portUp() will install it. */
+        this->routes.insert(re, port, 0);
+        return;
+    }
+
+    if (findHost(re.gateway) == FlowTable::MAC_ADDR_NONE) {
+        /* Park the route until the neighbour shows up in the host table.
+         * neighbourResolved() will install it. */
+        this->routes.insert(re, port, 0);
+
+        if (resolveGateway(re.gateway, getInterface(re.interface)) < 0) {
+            fprintf(stderr, "An error occurred while %s %s/%s.\n",
+                    "attempting to resolve", re.address.toString().c_str(),
                     re.netmask.toString().c_str());
-            FlowTable::pendingRoutes.push(pr);
+        }
+        return;
+    }
+
+    if (this->sendToHw(RMT_ADD, re) < 0) {
+        fprintf(stderr, "An error occurred while pushing route %s/%s.\n",
+                re.address.toString().c_str(),
+                re.netmask.toString().c_str());
+        this->routes.insert(re, port, 0);
+        return;
+    }
+
+    this->routes.insert(re, port, ROUTE_INSTALLED);
+}
+
+/**
+ * Withdraw the given route from hardware, or forget it if it was parked.
+ *
+ * Must be called with routeTableMutex held.
+ */
+void FlowTable::removeRoute(const RouteEntry& re) {
+    uint32_t id = this->routes.find(re);
+    if (id == NO_ROUTE) {
+        fprintf(stdout, "Received route removal for %s but route %s.\n",
+                re.address.toString().c_str(), "cannot be found");
+        return;
+    }
+
+    /* Removal of a route for the prefix that addRoute() ignored. */
+    if (!this->routes.matches(id, re)) {
+        fprintf(stdout, "Received route removal for %s but route %s.\n",
+                re.address.toString().c_str(), "does not match");
+        return;
+    }
+
+    /* A parked route never made it to hardware, nothing to withdraw.
+     * Retrying cannot make a malformed route valid, so forget it anyway. */
+    if ((this->routes.get(id).flags & ROUTE_INSTALLED) &&
+        this->sendToHw(RMT_DELETE, this->routeEntry(id)) < 0) {
+        fprintf(stderr, "An error occurred while pushing route %s/%s.\n",
+                re.address.toString().c_str(),
+                re.netmask.toString().c_str());
+    }
+
+    this->routes.erase(id);
+}
+
+/**
+ * Install the given parked route if its port is up and its gateway resolved.
+ * Otherwise the route stays parked, and resolution of its gateway is started
+ * if needed. Returns 1 if it was installed, 0 otherwise.
+ *
+ * The route is installed right away rather than sent back through
+ * pendingRoutes, where a removal or a new next-hop for the same prefix may
+ * already be waiting and would then be undone by a stale copy.
+ *
+ * Must be called with routeTableMutex held.
+ */
+int FlowTable::installRoute(uint32_t id) {
+    if (this->routes.get(id).flags & ROUTE_INSTALLED) {
+        return 0;
+    }
+
+    RouteEntry re = this->routeEntry(id);
+    const Interface& iface = getInterface(re.interface);
+    if (is_port_down(iface.port)) {
+        return 0;
+    }
+
+    if (findHost(re.gateway) == FlowTable::MAC_ADDR_NONE) {
+        if (resolveGateway(re.gateway, iface) < 0) {
+            fprintf(stderr, "An error occurred while %s %s/%s.\n",
+                    "attempting to resolve", re.address.toString().c_str(),
+                    re.netmask.toString().c_str());
+        }
+        return 0;
+    }
+
+    if (this->sendToHw(RMT_ADD, re) < 0) {
+        fprintf(stderr, "An error occurred while pushing route %s/%s.\n",
+                re.address.toString().c_str(),
+                re.netmask.toString().c_str());
+        return 0;
+    }
+
+    this->routes.get(id).flags |= ROUTE_INSTALLED;
+    return 1;
+}
+
+/**
+ * Withdraw the given route from hardware and park it.
+ * Returns 1 if it was installed, 0 otherwise.
+ */
+int FlowTable::withdrawRoute(uint32_t id) {
+    if (!(this->routes.get(id).flags & ROUTE_INSTALLED)) {
+        return 0;
+    }
+
+    this->sendToHw(RMT_DELETE, this->routeEntry(id));
+    this->routes.get(id).flags &= ~ROUTE_INSTALLED;
+    return 1;
+}
+
+/**
+ * Install the routes of this table parked on the given neighbour. If the
+ * neighbour's details have changed, routes already installed through it are
+ * updated with the new destination address.
+ *
+ * Must be called with routeTableMutex held. Returns the number of routes
+ * installed.
+ */
+int FlowTable::gatewayResolved(const string& host, bool changed) {
+    vector<uint32_t> ids;
+    this->routes.routesVia(host, ids);
+
+    int parked = 0;
+    vector<uint32_t>::iterator id = ids.begin();
+    for (; id != ids.end(); id++) {
+        if (this->routes.get(*id).flags & ROUTE_INSTALLED) {
+            if (changed) {
+                this->sendToHw(RMT_ADD, this->routeEntry(*id));
+            }
             continue;
         }
+        parked += this->installRoute(*id);
+    }
+
+    return parked;
+}
+
+/**
+ * Withdraw and park every route of this table installed through the given
+ * neighbour.
+ *
+ * Must be called with routeTableMutex held. Returns the number of routes
+ * withdrawn.
+ */
+int FlowTable::gatewayFailed(const string& host) {
+    vector<uint32_t> ids;
+    this->routes.routesVia(host, ids);
+
+    int withdrawn = 0;
+    vector<uint32_t>::iterator id = ids.begin();
+    for (; id != ids.end(); id++) {
+        withdrawn += this->withdrawRoute(*id);
+    }
+
+    return withdrawn;
+}
+
+/**
+ * Withdraw and park every route of this table going out of the given port.
+ *
+ * Must be called with routeTableMutex held. Returns the number of routes
+ * withdrawn.
+ */
+int FlowTable::withdrawPort(uint32_t port) {
+    vector<uint32_t> ids;
+    this->routes.routesOn(port, ids);
+
+    int withdrawn = 0;
+    vector<uint32_t>::iterator id = ids.begin();
+    for (; id != ids.end(); id++) {
+        withdrawn += this->withdrawRoute(*id);
+    }
+
+    return withdrawn;
+}
 
-        if (pr.first == RMT_ADD) {
-            FlowTable::routeTable.push_back(pr.second);
-        } else if (pr.first == RMT_DELETE) {
-            FlowTable::routeTable.remove(pr.second);
+/**
+ * Reinstall every route of this table going out of the given port. Parked
+ * routes are installed if their gateway is resolved, installed ones are sent
+ * again.
+ *
+ * Must be called with routeTableMutex held. Returns the number of routes
+ * reinstalled.
+ */
+int FlowTable::reinstallPort(uint32_t port) {
+    vector<uint32_t> ids;
+    this->routes.routesOn(port, ids);
+
+    int reinstalled = 0;
+    vector<uint32_t>::iterator id = ids.begin();
+    for (; id != ids.end(); id++) {
+        if (this->routes.get(*id).flags & ROUTE_INSTALLED) {
+            this->sendToHw(RMT_ADD, this->routeEntry(*id));
+            reinstalled++;
         } else {
-            fprintf(stderr, "Received unexpected RouteModType (%d)\n", pr.first);
+            reinstalled += this->installRoute(*id);
         }
     }
+
+    return reinstalled;
 }
 
 /**
- * Get the local interface corresponding to the given interface number.
+ * Withdraw every route and host flow going out of the given port. The routes
+ * are parked until the port comes back up.
  *
- * On success, overwrites given interface pointer with the active interface
- * and returns 0;
- * On error, prints to stderr with appropriate message and returns -1.
+ * 'epoch' is the port epoch observed when the port went down. If the port has
+ * changed state again since, this call is stale and does nothing; the handler
+ * for the newer transition takes care of it.
+ */
+void FlowTable::portDown(uint32_t port, uint32_t epoch) {
+    list<HostEntry> hosts;
+    int withdrawn = 0;
+
+    {
+        boost::lock_guard<boost::mutex> lock(routeTableMutex);
+        if (FlowTable::ports->epoch(port) != epoch) {
+            return;
+        }
+
+        map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+        for (; table != FlowTable::tables.end(); table++) {
+            withdrawn += table->second->withdrawPort(port);
+        }
+
+        boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+        map<string, HostEntry>::iterator iter = FlowTable::hostTable.begin();
+        for (; iter != FlowTable::hostTable.end(); iter++) {
+            if (getInterface(iter->second.interface).port == port) {
+                hosts.push_back(iter->second);
+            }
+        }
+    }
+
+    list<HostEntry>::iterator iter = hosts.begin();
+    for (; iter != hosts.end(); iter++) {
+        FlowTable::sendToHw(RMT_DELETE, *iter);
+    }
+
+    fprintf(stdout, "Port %u down, withdrew %d routes and %zu hosts\n",
+            port, withdrawn, hosts.size());
+}
+
+/**
+ * Reinstall every route and host flow going out of the given port.
+ *
+ * This is also called when a port is (re)associated with a datapath port, in
+ * which case the port may never have been down from our point of view, but
+ * the datapath flow table has been cleared.
+ *
+ * 'epoch' is the port epoch observed when the port came up; see portDown().
+ */
+void FlowTable::portUp(uint32_t port, uint32_t epoch) {
+    list<HostEntry> hosts;
+    int reinstalled = 0;
+
+    {
+        boost::lock_guard<boost::mutex> lock(routeTableMutex);
+        if (FlowTable::ports->epoch(port) != epoch) {
+            return;
+        }
+
+        map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+        for (; table != FlowTable::tables.end(); table++) {
+            reinstalled += table->second->reinstallPort(port);
+        }
+
+        boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+        map<string, HostEntry>::iterator iter = FlowTable::hostTable.begin();
+        for (; iter != FlowTable::hostTable.end(); iter++) {
+            if (getInterface(iter->second.interface).port == port) {
+                hosts.push_back(iter->second);
+            }
+        }
+    }
+
+    /* Probe the gateways of the routes that stay parked. */
+    FlowTable::flushND();
+
+    list<HostEntry>::iterator iter = hosts.begin();
+    for (; iter != hosts.end(); iter++) {
+        FlowTable::sendToHw(RMT_ADD, *iter);
+    }
+
+    fprintf(stdout, "Port %u up, reinstalling %d routes and %zu hosts\n",
+            port, reinstalled, hosts.size());
+}
+
+/**
+ * Check whether any route, in any table, goes through the given host.
+ *
+ * Must be called with routeTableMutex held.
+ */
+bool FlowTable::isGateway(const string& host) {
+    map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+    for (; table != FlowTable::tables.end(); table++) {
+        if (table->second->routes.isNextHop(host)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Replace the set of local interfaces.
+ *
+ * Interfaces whose attributes have not changed keep their handle. Others get
+ * a new record, so entries that refer to the previous one keep seeing the
+ * interface as it was when they were learnt, and are withdrawn accordingly.
  */
-int FlowTable::getInterface(const char *intf, const char *type,
-                            Interface& iface) {
-    map<string, Interface>::iterator it = interfaces.find(intf);
+void FlowTable::setInterfaces(const vector<Interface>& interfaces) {
+    boost::lock_guard<boost::mutex> lock(interfacesMutex);
+    const vector<InterfaceHandle>& previous = *FlowTable::interfaceIndex;
+
+    size_t size = 0;
+    vector<Interface>::const_iterator iter = interfaces.begin();
+    for (; iter != interfaces.end(); iter++) {
+        size = max(size, (size_t) iter->ifindex + 1);
+    }
+
+    vector<InterfaceHandle>* index = new vector<InterfaceHandle>(size, 0);
+    for (iter = interfaces.begin(); iter != interfaces.end(); iter++) {
+        if (iter->ifindex <= 0) {
+            continue;
+        }
+
+        InterfaceHandle handle = 0;
+        if ((size_t) iter->ifindex < previous.size()) {
+            handle = previous[iter->ifindex];
+        }
+        if (handle == 0 || !(*FlowTable::interfaceRecords[handle] == *iter)) {
+            handle = FlowTable::addInterface(*iter);
+        }
+        (*index)[iter->ifindex] = handle;
+    }
 
-    if (it == interfaces.end()) {
-        fprintf(stderr, "Interface %s not found, dropping %s entry\n",
-                intf, type);
+    /* Records that are no longer current may be reclaimed later on. */
+    for (size_t ifindex = 0; ifindex < previous.size(); ifindex++) {
+        InterfaceHandle handle = previous[ifindex];
+        if (handle != 0 && (ifindex >= size || (*index)[ifindex] != handle)) {
+            FlowTable::retiredInterfaces.push_back(handle);
+        }
+    }
+
+    FlowTable::interfaceIndex.reset(index);
+}
+
+/**
+ * Add a record for the given interface. Must be called with interfacesMutex
+ * held.
+ *
+ * Returns the handle of the record, or 0 if there is no room left.
+ */
+InterfaceHandle FlowTable::addInterface(const Interface& iface) {
+    InterfaceHandle handle;
+
+    if (FlowTable::interfaceCount < MAX_INTERFACE_HANDLES) {
+        handle = FlowTable::interfaceCount++;
+    } else {
+        if (FlowTable::freeInterfaces.empty()) {
+            FlowTable::reclaimInterfaces();
+        }
+        if (FlowTable::freeInterfaces.empty()) {
+            fprintf(stderr, "Too many interface records, ignoring %s\n",
+                    iface.name.c_str());
+            return 0;
+        }
+        handle = FlowTable::freeInterfaces.back();
+        FlowTable::freeInterfaces.pop_back();
+    }
+
+    const Interface* record = new Interface(iface);
+    boost::lock_guard<boost::mutex> lock(recordsMutex);
+    FlowTable::interfaceRecords[handle] = record;
+    return handle;
+}
+
+/**
+ * Free the records that dropped out of the index, that no route or host
+ * refers to and that no entry has pinned, and make their handles available
+ * again. Must be called with interfacesMutex held.
+ */
+void FlowTable::reclaimInterfaces() {
+    boost::lock_guard<boost::mutex> rlock(routeTableMutex);
+    boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+
+    vector<bool> used(MAX_INTERFACE_HANDLES, false);
+    map<string, HostEntry>::iterator host = FlowTable::hostTable.begin();
+    for (; host != FlowTable::hostTable.end(); host++) {
+        used[host->second.interface] = true;
+    }
+
+    list<InterfaceHandle>::iterator iter =
+        FlowTable::retiredInterfaces.begin();
+    while (iter != FlowTable::retiredInterfaces.end()) {
+        InterfaceHandle handle = *iter;
+        bool inUse = used[handle] || FlowTable::interfacePins[handle] != 0;
+
+        map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+        for (; !inUse && table != FlowTable::tables.end(); table++) {
+            inUse = table->second->routes.usesInterface(handle);
+        }
+        if (inUse) {
+            iter++;
+            continue;
+        }
+
+        const Interface* record = FlowTable::interfaceRecords[handle];
+        {
+            boost::lock_guard<boost::mutex> lock(recordsMutex);
+            FlowTable::interfaceRecords[handle] = &FlowTable::NO_INTERFACE;
+        }
+        delete record;
+        FlowTable::freeInterfaces.push_back(handle);
+        iter = FlowTable::retiredInterfaces.erase(iter);
+    }
+
+    std::cout << "Reclaimed " << FlowTable::freeInterfaces.size()
+              << " interface records" << std::endl;
+}
+
+/**
+ * Get the interface an entry refers to. A copy is returned, as the record
+ * may be freed once the entry is gone.
+ */
+Interface FlowTable::getInterface(InterfaceHandle handle) {
+    boost::lock_guard<boost::mutex> lock(recordsMutex);
+    return *FlowTable::interfaceRecords[handle];
+}
+
+/**
+ * Let go of the handle of an entry that findInterface() returned, once the
+ * entry has made it to the route or host table, or has been dropped.
+ */
+void FlowTable::releaseInterface(InterfaceHandle handle) {
+    boost::lock_guard<boost::mutex> lock(interfacesMutex);
+    FlowTable::interfacePins[handle]--;
+}
+
+/**
+ * Get the handle of the local interface with the given kernel index, for an
+ * entry on its way to the route or host table. The handle is pinned, so that
+ * its record cannot be reclaimed in the meantime, until releaseInterface()
+ * is called.
+ *
+ * On success, overwrites 'handle' and returns 0;
+ * On error, prints to stderr with appropriate message and returns -1.
+ */
+int FlowTable::findInterface(int ifindex, const char *type,
+                             InterfaceHandle& handle) {
+    boost::lock_guard<boost::mutex> lock(interfacesMutex);
+    const vector<InterfaceHandle>& index = *FlowTable::interfaceIndex;
+
+    if (ifindex <= 0 || (size_t) ifindex >= index.size() ||
+        index[ifindex] == 0) {
+        fprintf(stderr, "Interface %d not found, dropping %s entry\n",
+                ifindex, type);
         return -1;
     }
 
-    if (not it->second.active) {
-        fprintf(stderr, "Interface %s inactive, dropping %s entry\n",
-                intf, type);
+    /* Records only go away with interfacesMutex held. */
+    if (not FlowTable::interfaceRecords[index[ifindex]]->active) {
+        fprintf(stderr, "Interface %d inactive, dropping %s entry\n",
+                ifindex, type);
         return -1;
     }
 
-    iface = it->second;
+    handle = index[ifindex];
+    FlowTable::interfacePins[handle]++;
     return 0;
 }
 
@@ -209,11 +962,6 @@ int rta_to_ip(unsigned char family, const void *ip, IPAddress& result) {
         return -1;
     }
 
-    if (result.toString() == "") {
-        fprintf(stderr, "Blank IP address. Dropping Route\n");
-        return -1;
-    }
-
     return 0;
 }
 
@@ -221,28 +969,18 @@ int FlowTable::updateHostTable(const struct sockaddr_nl *, struct nlmsghdr *n, v
     struct ndmsg *ndmsg_ptr = (struct ndmsg *) NLMSG_DATA(n);
     struct rtattr *rtattr_ptr;
 
-    char intf[IF_NAMESIZE + 1];
-    memset(intf, 0, IF_NAMESIZE + 1);
-
     boost::this_thread::interruption_point();
 
-    if (if_indextoname((unsigned int) ndmsg_ptr->ndm_ifindex, (char *) intf) == NULL) {
-        perror("HostTable");
+    if (n->nlmsg_type != RTM_NEWNEIGH && n->nlmsg_type != RTM_DELNEIGH) {
         return 0;
     }
 
-    /*
-    if (ndmsg_ptr->ndm_state != NUD_REACHABLE) {
-        cout << "ndm_state: " << (uint16_t) ndmsg_ptr->ndm_state << endl;
-        return 0;
-    }
-    */
+    HostEntry hentry;
+    hentry.state = ndmsg_ptr->ndm_state;
 
-    boost::scoped_ptr<HostEntry> hentry(new HostEntry());
-
-    char mac[2 * IFHWADDRLEN + 5 + 1];
-    memset(mac, 0, 2 * IFHWADDRLEN + 5 + 1);
+    const uint8_t *mac = NULL;
 
+    bool has_address = false;
     rtattr_ptr = (struct rtattr *) RTM_RTA(ndmsg_ptr);
     int rtmsg_len = RTM_PAYLOAD(n);
 
@@ -250,15 +988,15 @@ int FlowTable::updateHostTable(const struct sockaddr_nl *, struct nlmsghdr *n, v
         switch (rtattr_ptr->rta_type) {
         case RTA_DST: {
             if (rta_to_ip(ndmsg_ptr->ndm_family, RTA_DATA(rtattr_ptr),
-                          hentry->address) < 0) {
+                          hentry.address) < 0) {
                 return 0;
             }
+            has_address = true;
             break;
         }
         case NDA_LLADDR:
-            if (strncpy(mac, ether_ntoa(((ether_addr *) RTA_DATA(rtattr_ptr))), sizeof(mac)) == NULL) {
-                perror("HostTable");
-                return 0;
+            if (RTA_PAYLOAD(rtattr_ptr) == IFHWADDRLEN) {
+                mac = (const uint8_t *) RTA_DATA(rtattr_ptr);
             }
             break;
         default:
@@ -266,55 +1004,267 @@ int FlowTable::updateHostTable(const struct sockaddr_nl *, struct nlmsghdr *n, v
         }
     }
 
-    hentry->hwaddress = MACAddress(mac);
-    if (getInterface(intf, "host", hentry->interface) != 0) {
+    if (!has_address) {
+        return 0;
+    }
+
+    string host = hentry.address.toString();
+
+    if (n->nlmsg_type == RTM_DELNEIGH) {
+        std::cout << "netlink->RTM_DELNEIGH: ip=" << host << "\n";
+        FlowTable::removeHost(host);
+        return 0;
+    }
+
+    if (ndmsg_ptr->ndm_state & NUD_FAILED) {
+        std::cout << "netlink->RTM_NEWNEIGH: ip=" << host
+                  << ", state=FAILED\n";
+        FlowTable::neighbourFailed(host);
+        return 0;
+    }
+
+    /* NUD_INCOMPLETE and friends: resolution is still in progress. */
+    if (!(ndmsg_ptr->ndm_state & NUD_RESOLVED)) {
         return 0;
     }
 
-    if (strlen(mac) == 0) {
+    if (mac == NULL) {
         fprintf(stderr, "Received host entry with blank mac. Ignoring\n");
         return 0;
     }
 
-    switch (n->nlmsg_type) {
-        case RTM_NEWNEIGH: {
-            FlowTable::sendToHw(RMT_ADD, *hentry);
+    hentry.hwaddress = MACAddress(mac);
+    if (findInterface(ndmsg_ptr->ndm_ifindex, "host",
+                      hentry.interface) != 0) {
+        return 0;
+    }
 
-            string host = hentry->address.toString();
-            {
-                // Add to host table
-                boost::lock_guard<boost::mutex> lock(hostTableMutex);
-                FlowTable::hostTable[host] = *hentry;
+    FlowTable::addHost(hentry);
+    FlowTable::releaseInterface(hentry.interface);
+    return 0;
+}
+
+/**
+ * Add or refresh a resolved neighbour.
+ *
+ * The kernel reports every NUD transition (REACHABLE <-> STALE <-> DELAY..)
+ * as a new neighbour message. The host flow is only pushed to hardware if the
+ * neighbour is new, or its link-layer address or interface has changed.
+ */
+void FlowTable::addHost(const HostEntry& he) {
+    string host = he.address.toString();
+    bool changed = true;
+
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        map<string, HostEntry>::iterator iter = FlowTable::hostTable.find(host);
+        if (iter != FlowTable::hostTable.end()) {
+            changed = !(iter->second == he);
+        }
+        FlowTable::hostTable[host] = he;
+        FlowTable::touchHost(host);
+    }
+
+    // If we have been attempting neighbour discovery for this host, then we
+    // can close the associated socket.
+    FlowTable::cancelND(host);
+
+    if (changed) {
+        FlowTable::sendToHw(RMT_ADD, he);
+        std::cout << "netlink->RTM_NEWNEIGH: ip=" << host << ", mac="
+                  << he.hwaddress.toString() << "\n";
+    }
+
+    FlowTable::neighbourResolved(host, changed);
+    FlowTable::evictHosts();
+}
+
+/**
+ * Handle the removal of a neighbour from the kernel table.
+ *
+ * The kernel garbage-collects neighbours that have not been used recently.
+ * Since forwarding happens in hardware, gateways in active use look idle to
+ * the kernel and get collected too; withdrawing their routes at this point
+ * would blackhole traffic. If any route depends on the host, we keep the
+ * entry and probe it again instead. Only a failed probe withdraws the routes.
+ */
+void FlowTable::removeHost(const string& host) {
+    HostEntry he;
+    bool gateway;
+
+    {
+        boost::lock_guard<boost::mutex> rlock(routeTableMutex);
+        {
+            boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+
+            map<string, HostEntry>::iterator iter;
+            iter = FlowTable::hostTable.find(host);
+            if (iter == FlowTable::hostTable.end()) {
+                return;
             }
-            {
-                // If we have been attempting neighbour discovery for this
-                // host, then we can close the associated socket.
-                boost::lock_guard<boost::mutex> lock(ndMutex);
-                map<string, int>::iterator iter = pendingNeighbours.find(host);
-                if (iter != pendingNeighbours.end()) {
-                    if (close(iter->second) == -1) {
-                        perror("pendingNeighbours");
-                    }
-                    pendingNeighbours.erase(host);
-                }
+            he = iter->second;
+
+            gateway = FlowTable::isGateway(host);
+            if (!gateway) {
+                FlowTable::hostTable.erase(iter);
+                FlowTable::forgetHost(host);
             }
+        }
 
-            std::cout << "netlink->RTM_NEWNEIGH: ip=" << host << ", mac=" << mac
-                      << std::endl;
-            break;
+        /* Withdraw the host before letting go of the route table, which
+         * keeps the record of its interface from being reclaimed. */
+        if (!gateway) {
+            FlowTable::cancelND(host);
+            FlowTable::sendToHw(RMT_DELETE, he);
+            return;
         }
-        /* TODO: enable this? It is causing serious problems. Why?
-        case RTM_DELNEIGH: {
-            std::cout << "netlink->RTM_DELNEIGH: ip=" << ip << ", mac=" << mac << std::endl;
-            FlowTable::sendToHw(RMT_DELETE, *hentry);
-            // TODO: delete from hostTable
-            boost::lock_guard<boost::mutex> lock(hostTableMutex);
-            break;
+    }
+
+    // Gateways stay in the host table until resolution fails.
+    if (resolveGateway(he.address, getInterface(he.interface)) < 0) {
+        fprintf(stderr, "Failed to probe gateway %s\n", host.c_str());
+    }
+    FlowTable::flushND();
+}
+
+/**
+ * Queue all routes parked on the given neighbour for installation. If the
+ * neighbour's details have changed, routes already installed through it are
+ * updated with the new destination address.
+ */
+void FlowTable::neighbourResolved(const string& host, bool changed) {
+    boost::lock_guard<boost::mutex> lock(routeTableMutex);
+
+    int parked = 0;
+    map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+    for (; table != FlowTable::tables.end(); table++) {
+        parked += table->second->gatewayResolved(host, changed);
+    }
+
+    if (parked > 0) {
+        fprintf(stdout, "Neighbour %s resolved, reinstalling %d routes\n",
+                host.c_str(), parked);
+    }
+}
+
+/**
+ * Withdraw the given neighbour and park every route that uses it as gateway.
+ */
+void FlowTable::neighbourFailed(const string& host) {
+    HostEntry he;
+    bool known = false;
+
+    boost::lock_guard<boost::mutex> lock(routeTableMutex);
+    {
+        boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+        map<string, HostEntry>::iterator iter = FlowTable::hostTable.find(host);
+        if (iter != FlowTable::hostTable.end()) {
+            he = iter->second;
+            known = true;
+            FlowTable::hostTable.erase(iter);
+            FlowTable::forgetHost(host);
         }
-        */
     }
 
-    return 0;
+    // Allow resolution to be attempted again the next time it is needed.
+    FlowTable::cancelND(host);
+
+    if (known) {
+        FlowTable::sendToHw(RMT_DELETE, he);
+    }
+
+    if (!FlowTable::isGateway(host)) {
+        return;
+    }
+
+    int withdrawn = 0;
+    map<uint32_t, FlowTable*>::iterator table = FlowTable::tables.begin();
+    for (; table != FlowTable::tables.end(); table++) {
+        withdrawn += table->second->gatewayFailed(host);
+    }
+
+    fprintf(stdout, "Neighbour %s failed, withdrew %d routes\n",
+            host.c_str(), withdrawn);
+}
+
+/**
+ * Keep the host table within MAX_HOST_ENTRIES by evicting the least recently
+ * confirmed hosts. Hosts used as gateways are never evicted.
+ */
+void FlowTable::evictHosts() {
+    list<HostEntry> evicted;
+    boost::lock_guard<boost::mutex> rlock(routeTableMutex);
+
+    {
+        boost::lock_guard<boost::mutex> hlock(hostTableMutex);
+
+        size_t candidates = FlowTable::hostAge.size();
+        while (FlowTable::hostTable.size() > MAX_HOST_ENTRIES
+               && candidates-- > 0) {
+            list<string>::iterator oldest = FlowTable::hostAge.begin();
+            string host = *oldest;
+
+            if (FlowTable::isGateway(host)) {
+                FlowTable::hostAge.splice(FlowTable::hostAge.end(),
+                                          FlowTable::hostAge, oldest);
+                continue;
+            }
+
+            map<string, HostEntry>::iterator iter;
+            iter = FlowTable::hostTable.find(host);
+            if (iter != FlowTable::hostTable.end()) {
+                evicted.push_back(iter->second);
+                FlowTable::hostTable.erase(iter);
+            }
+            FlowTable::forgetHost(host);
+        }
+    }
+
+    /* Hosts are withdrawn before the route table is let go of, which keeps
+     * the records of their interfaces from being reclaimed. */
+    list<HostEntry>::iterator iter = evicted.begin();
+    for (; iter != evicted.end(); iter++) {
+        FlowTable::sendToHw(RMT_DELETE, *iter);
+    }
+}
+
+/**
+ * Mark the given host as the most recently confirmed one.
+ *
+ * Must be called with hostTableMutex held.
+ */
+void FlowTable::touchHost(const string& host) {
+    map<string, list<string>::iterator>::iterator iter;
+    iter = FlowTable::hostAgeIndex.find(host);
+    if (iter != FlowTable::hostAgeIndex.end()) {
+        FlowTable::hostAge.splice(FlowTable::hostAge.end(),
+                                  FlowTable::hostAge, iter->second);
+    } else {
+        FlowTable::hostAgeIndex[host] = FlowTable::hostAge.insert(
+                FlowTable::hostAge.end(), host);
+    }
+}
+
+/**
+ * Remove the given host from the eviction order.
+ *
+ * Must be called with hostTableMutex held.
+ */
+void FlowTable::forgetHost(const string& host) {
+    map<string, list<string>::iterator>::iterator iter;
+    iter = FlowTable::hostAgeIndex.find(host);
+    if (iter != FlowTable::hostAgeIndex.end()) {
+        FlowTable::hostAge.erase(iter->second);
+        FlowTable::hostAgeIndex.erase(iter);
+    }
+}
+
+/**
+ * Stop any neighbour discovery in progress for the given host.
+ */
+void FlowTable::cancelND(const string& host) {
+    boost::lock_guard<boost::mutex> lock(ndMutex);
+    pendingNeighbours.erase(host);
 }
 
 #ifndef FPM_ENABLED
@@ -329,15 +1279,36 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
 
     boost::this_thread::interruption_point();
 
-    if (!((n->nlmsg_type == RTM_NEWROUTE || n->nlmsg_type == RTM_DELROUTE) &&
-          rtmsg_ptr->rtm_table == RT_TABLE_MAIN)) {
+    if (n->nlmsg_type != RTM_NEWROUTE && n->nlmsg_type != RTM_DELROUTE) {
         return 0;
     }
 
-    boost::scoped_ptr<RouteEntry> rentry(new RouteEntry());
+    /* Local, broadcast, multicast and unreachable routes have no meaning for
+     * the datapath. */
+    if (rtmsg_ptr->rtm_type != RTN_UNICAST) {
+        return 0;
+    }
 
-    char intf[IF_NAMESIZE + 1];
-    memset(intf, 0, IF_NAMESIZE + 1);
+    int version;
+    if (rtmsg_ptr->rtm_family == AF_INET) {
+        version = IPV4;
+    } else if (rtmsg_ptr->rtm_family == AF_INET6) {
+        version = IPV6;
+    } else {
+        return 0;
+    }
+
+    /* Routes without RTA_DST or RTA_GATEWAY (default and connected routes)
+     * need addresses of the right family. */
+    RouteEntry rentry;
+    rentry.address = IPAddress(version);
+    rentry.gateway = IPAddress(version);
+    bool has_gateway = false;
+
+    /* Tables above 255 are only reported in RTA_TABLE. */
+    uint32_t table = rtmsg_ptr->rtm_table;
+
+    int ifindex = 0;
 
     struct rtattr *rtattr_ptr;
     rtattr_ptr = (struct rtattr *) RTM_RTA(rtmsg_ptr);
@@ -347,18 +1318,25 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
         switch (rtattr_ptr->rta_type) {
         case RTA_DST:
             if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(rtattr_ptr),
-                          rentry->address) < 0) {
+                          rentry.address) < 0) {
                 return 0;
             }
             break;
         case RTA_GATEWAY:
             if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(rtattr_ptr),
-                          rentry->gateway) < 0) {
+                          rentry.gateway) < 0) {
                 return 0;
             }
+            has_gateway = true;
+            break;
+        case RTA_TABLE:
+            table = *((uint32_t *) RTA_DATA(rtattr_ptr));
             break;
         case RTA_OIF:
-            if_indextoname(*((int *) RTA_DATA(rtattr_ptr)), (char *) intf);
+            ifindex = *((int *) RTA_DATA(rtattr_ptr));
+            break;
+        case RTA_PRIORITY:
+            rentry.metric = *((uint32_t *) RTA_DATA(rtattr_ptr));
             break;
         case RTA_MULTIPATH: {
             struct rtnexthop *rtnhp_ptr = (struct rtnexthop *) RTA_DATA(
@@ -373,7 +1351,7 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
                 break;
             }
 
-            if_indextoname(rtnhp_ptr->rtnh_ifindex, (char *) intf);
+            ifindex = rtnhp_ptr->rtnh_ifindex;
 
             int attrlen = rtnhp_len - sizeof(struct rtnexthop);
 
@@ -383,9 +1361,10 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
                 for (; RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen))
                     if ((attr->rta_type == RTA_GATEWAY)) {
                         if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(attr),
-                                      rentry->gateway) < 0) {
+                                      rentry.gateway) < 0) {
                             return 0;
                         }
+                        has_gateway = true;
                         break;
                     }
             }
@@ -396,26 +1375,42 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
         }
     }
 
-    rentry->netmask = IPAddress(IPV4, rtmsg_ptr->rtm_dst_len);
+    {
+        boost::lock_guard<boost::mutex> lock(tablesMutex);
+        if (FlowTable::getTable(table) == NULL) {
+            return 0;
+        }
+    }
+    rentry.table = table;
 
-    if (getInterface(intf, "route", rentry->interface) != 0) {
+    /* Directly connected prefixes are covered by the host entries of the
+     * neighbours on them. */
+    if (!has_gateway) {
         return 0;
     }
 
-    string net = rentry->address.toString();
-    string mask = rentry->netmask.toString();
-    string gw = rentry->gateway.toString();
+    rentry.netmask = IPAddress(version, rtmsg_ptr->rtm_dst_len);
+    rentry.replace = (n->nlmsg_flags & NLM_F_REPLACE) != 0;
+
+    if (findInterface(ifindex, "route", rentry.interface) != 0) {
+        return 0;
+    }
+
+    char net[IPV6_STRLEN], mask[IPV6_STRLEN], gw[IPV6_STRLEN];
+    rentry.address.toString(net);
+    rentry.netmask.toString(mask);
+    rentry.gateway.toString(gw);
 
     switch (n->nlmsg_type) {
         case RTM_NEWROUTE:
             std::cout << "netlink->RTM_NEWROUTE: net=" << net << ", mask="
-                      << mask << ", gw=" << gw << std::endl;
-            FlowTable::pendingRoutes.push(PendingRoute(RMT_ADD, *rentry));
+                      << mask << ", gw=" << gw << "\n";
+            FlowTable::pendingRoutes.push(PendingRoute(RMT_ADD, rentry));
             break;
         case RTM_DELROUTE:
             std::cout << "netlink->RTM_DELROUTE: net=" << net << ", mask="
-                      << mask << ", gw=" << gw << std::endl;
-            FlowTable::pendingRoutes.push(PendingRoute(RMT_DELETE, *rentry));
+                      << mask << ", gw=" << gw << "\n";
+            FlowTable::pendingRoutes.push(PendingRoute(RMT_DELETE, rentry));
             break;
     }
 
@@ -423,51 +1418,116 @@ int FlowTable::updateRouteTable(struct nlmsghdr *n) {
 }
 
 /**
- * Begins the neighbour discovery process to the specified host.
+ * Queue a neighbour discovery probe for the specified host. The probe is an
+ * empty UDP datagram: sending it makes the kernel resolve the host (ARP or
+ * IPv6 ND), and the result shows up as a neighbour update.
  *
- * Returns an open socket on success, or -1 on error.
+ * Link-local IPv6 hosts are only reachable through the interface they were
+ * learnt on, which is why it must be given.
+ *
+ * Must be called with ndMutex held. Probes are sent by flushND().
+ *
+ * Returns 0 on success, or -1 on error.
  */
-int FlowTable::initiateND(const char *hostAddr) {
-    int s, flags;
+int FlowTable::initiateND(const IPAddress& host, const Interface& iface) {
     struct sockaddr_storage store;
     struct sockaddr_in *sin = (struct sockaddr_in*)&store;
     struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&store;
 
     memset(&store, 0, sizeof(store));
 
-    if (inet_pton(AF_INET, hostAddr, &sin->sin_addr) == 1) {
-        store.ss_family = AF_INET;
-    } else if (inet_pton(AF_INET6, hostAddr, &sin6->sin6_addr) == 1) {
-        store.ss_family = AF_INET6;
+    if (host.getVersion() == IPV4) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(ND_PROBE_PORT);
+        host.toArray((uint8_t *) &sin->sin_addr);
+    } else if (host.getVersion() == IPV6) {
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(ND_PROBE_PORT);
+        host.toArray(sin6->sin6_addr.s6_addr);
+        if (IN6_IS_ADDR_LINKLOCAL(&sin6->sin6_addr)) {
+            sin6->sin6_scope_id = iface.ifindex;
+        }
     } else {
-        fprintf(stderr, "Invalid IP address \"%s\" for resolution. Dropping\n",
-                hostAddr);
+        fprintf(stderr, "Invalid IP address for resolution. Dropping\n");
         return -1;
     }
 
-    if ((s = socket(store.ss_family, SOCK_STREAM, 0)) < 0) {
-        perror("socket() failed");
-        return -1;
+    FlowTable::ndProbes.push_back(store);
+    return 0;
+}
+
+/**
+ * Send all the queued neighbour discovery probes, with one system call per
+ * address family.
+ */
+void FlowTable::flushND() {
+    boost::lock_guard<boost::mutex> lock(ndMutex);
+    if (FlowTable::ndProbes.empty()) {
+        return;
     }
 
-    // Prevent the connect() call from blocking
-    flags = fcntl(s, F_GETFL, 0);
-    if (fcntl(s, F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror("fcntl() failed");
-        close(s);
-        return -1;
+    vector<struct mmsghdr> msgs4, msgs6;
+    vector<struct sockaddr_storage>::iterator iter;
+    for (iter = ndProbes.begin(); iter != ndProbes.end(); iter++) {
+        struct mmsghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_hdr.msg_name = &(*iter);
+
+        if (iter->ss_family == AF_INET) {
+            msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs4.push_back(msg);
+        } else {
+            msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+            msgs6.push_back(msg);
+        }
+    }
+
+    if (!msgs4.empty()) {
+        sendProbes(AF_INET, FlowTable::ndSocket4, msgs4);
+    }
+    if (!msgs6.empty()) {
+        sendProbes(AF_INET6, FlowTable::ndSocket6, msgs6);
     }
 
-    connect(s, (struct sockaddr *)&store, sizeof(store));
-    return s;
+    FlowTable::ndProbes.clear();
+}
+
+/**
+ * Send the given probes on the (lazily opened) probe socket for 'family'.
+ *
+ * Must be called with ndMutex held.
+ */
+void FlowTable::sendProbes(int family, int& sock,
+                           vector<struct mmsghdr>& msgs) {
+    if (sock < 0) {
+        sock = socket(family, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (sock < 0) {
+            perror("socket() failed");
+            return;
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < msgs.size()) {
+        int n = sendmmsg(sock, &msgs[sent], msgs.size() - sent, 0);
+        if (n < 0) {
+            /* Skip the probe that failed, e.g. an unreachable network. */
+            perror("sendmmsg() failed");
+            n = 1;
+        }
+        sent += n;
+    }
 }
 
 /**
  * Initiates the gateway resolution process for the given host.
  *
+ * The probe is only queued; callers outside GWResolver must call flushND()
+ * once they are done.
+ *
  * Returns:
  *  0 if address resolution is currently being performed
- * -1 on error (usually an issue with the socket)
+ * -1 on error
  */
 int FlowTable::resolveGateway(const IPAddress& gateway,
                               const Interface& iface) {
@@ -484,11 +1544,10 @@ int FlowTable::resolveGateway(const IPAddress& gateway,
     }
 
     // Otherwise, we should go ahead and begin the process.
-    int sock = initiateND(gateway_str.c_str());
-    if (sock == -1) {
+    if (initiateND(gateway, iface) < 0) {
         return -1;
     }
-    FlowTable::pendingNeighbours[gateway_str] = sock;
+    FlowTable::pendingNeighbours.insert(gateway_str);
 
     return 0;
 }
@@ -500,8 +1559,11 @@ int FlowTable::resolveGateway(const IPAddress& gateway,
  * returns its MAC Address. If the host is unresolved, this will return
  * FlowTable::MAC_ADDR_NONE. Neighbour Discovery is not performed by this
  * function.
+ *
+ * The address is returned by value, as the entry may be removed from the
+ * table as soon as the lock is released.
  */
-const MACAddress& FlowTable::findHost(const IPAddress& host) {
+MACAddress FlowTable::findHost(const IPAddress& host) {
     boost::lock_guard<boost::mutex> lock(hostTableMutex);
     map<string, HostEntry>::iterator iter;
     iter = FlowTable::hostTable.find(host.toString());
@@ -513,11 +1575,7 @@ const MACAddress& FlowTable::findHost(const IPAddress& host) {
 }
 
 bool FlowTable::is_port_down(uint32_t port) {
-    vector<uint32_t>::iterator it;
-    for (it=down_ports->begin() ; it < down_ports->end(); it++)
-        if (*it == port)
-            return true;
-    return false;
+    return FlowTable::ports->is_down(port);
 }
 
 int FlowTable::setEthernet(RouteMod& rm, const Interface& local_iface,
@@ -554,16 +1612,18 @@ int FlowTable::setIP(RouteMod& rm, const IPAddress& addr,
 int FlowTable::sendToHw(RouteModType mod, const RouteEntry& re) {
     const string gateway_str = re.gateway.toString();
     if (mod == RMT_DELETE) {
-        return sendToHw(mod, re.address, re.netmask, re.interface,
-                        FlowTable::MAC_ADDR_NONE);
+        return sendToHw(mod, re.address, re.netmask,
+                        getInterface(re.interface), FlowTable::MAC_ADDR_NONE,
+                        this->vrf);
     } else if (mod == RMT_ADD) {
-        const MACAddress& remoteMac = findHost(re.gateway);
+        const MACAddress remoteMac = findHost(re.gateway);
         if (remoteMac == FlowTable::MAC_ADDR_NONE) {
             fprintf(stderr, "Cannot Resolve %s\n", gateway_str.c_str());
             return -1;
         }
 
-        return sendToHw(mod, re.address, re.netmask, re.interface, remoteMac);
+        return sendToHw(mod, re.address, re.netmask,
+                        getInterface(re.interface), remoteMac, this->vrf);
     }
 
     fprintf(stderr, "Unhandled RouteModType (%d)\n", mod);
@@ -582,17 +1642,30 @@ int FlowTable::sendToHw(RouteModType mod, const HostEntry& he) {
         return -1;
     }
 
-    return sendToHw(mod, he.address, *mask.get(), he.interface, he.hwaddress);
+    const Interface& iface = getInterface(he.interface);
+    return sendToHw(mod, he.address, *mask.get(), iface, he.hwaddress,
+                    iface.vrf);
 }
 
 int FlowTable::sendToHw(RouteModType mod, const IPAddress& addr,
                          const IPAddress& mask, const Interface& local_iface,
-                         const MACAddress& gateway) {
-    if (is_port_down(local_iface.port)) {
+                         const MACAddress& gateway, uint32_t vrf) {
+    /* Withdrawals always go through; RFServer drops them if the port is no
+     * longer associated with a datapath. */
+    if (mod != RMT_DELETE && is_port_down(local_iface.port)) {
         fprintf(stderr, "Cannot send RouteMod for down port\n");
         return -1;
     }
 
+    /* Flows confirmed after a restart are already on the switch. */
+    FlowRecord rec;
+    if (FlowTable::snapshot != NULL) {
+        rec = FlowSnapshot::record(addr, mask, local_iface, gateway, vrf);
+        if (mod != RMT_DELETE && FlowTable::snapshot->adopt(rec)) {
+            return 0;
+        }
+    }
+
     RouteMod rm;
 
     rm.set_mod(mod);
@@ -605,11 +1678,24 @@ int FlowTable::sendToHw(RouteModType mod, const IPAddress& addr,
         return -1;
     }
 
+    /* Flows of the main table are left untagged. */
+    if (vrf != 0) {
+        rm.add_match(Match(RFMT_VRF, vrf));
+    }
+
     /* Add the output port. Even if we're removing the route, RFServer requires
      * the port to determine which datapath to send to. */
     rm.add_action(Action(RFAT_OUTPUT, local_iface.port));
 
     FlowTable::ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, rm);
+
+    if (FlowTable::snapshot != NULL) {
+        if (mod == RMT_DELETE) {
+            FlowTable::snapshot->erase(rec);
+        } else {
+            FlowTable::snapshot->store(rec);
+        }
+    }
     return 0;
 }
 
@@ -640,13 +1726,16 @@ void FlowTable::updateNHLFE(nhlfe_msg_t *nhlfe_msg) {
 
     // Get our interface for packet egress.
     Interface iface;
-    map<string, HostEntry>::iterator iter;
-    iter = FlowTable::hostTable.find(gwIP.toString());
-    if (iter == FlowTable::hostTable.end()) {
-        std::cerr << "Failed to locate interface for LSP" << std::endl;
-        return;
-    } else {
-        iface = iter->second.interface;
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        map<string, HostEntry>::iterator iter;
+        iter = FlowTable::hostTable.find(gwIP.toString());
+        if (iter == FlowTable::hostTable.end()) {
+            std::cerr << "Failed to locate interface for LSP" << std::endl;
+            return;
+        } else {
+            iface = getInterface(iter->second.interface);
+        }
     }
 
     if (is_port_down(iface.port)) {
@@ -655,7 +1744,7 @@ void FlowTable::updateNHLFE(nhlfe_msg_t *nhlfe_msg) {
     }
 
     // Get the MAC address corresponding to our gateway.
-    const MACAddress& gwMAC = findHost(gwIP);
+    const MACAddress gwMAC = findHost(gwIP);
     if (gwMAC == FlowTable::MAC_ADDR_NONE) {
         std::cerr << "Failed to resolve gwMAC IP for NHLFE" << std::endl;
         return;
@@ -3,10 +3,14 @@
 
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
 #include <stdint.h>
+#include <sys/socket.h>
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
 #include "libnetlink.hh"
-#include "SyncQueue.h"
+#include "BatchQueue.h"
 
 #include "fpm.h"
 #include "fpm_lsp.h"
@@ -19,21 +23,58 @@
 
 #include "Interface.hh"
 #include "RouteEntry.hh"
+#include "RouteTable.hh"
 #include "HostEntry.hh"
+#include "PortState.hh"
+#include "FlowSnapshot.hh"
+#include "UpdateSource.hh"
 
 using namespace std;
 
-// TODO: recreate this module from scratch without all the static stuff.
-// It is a little bit challenging to devise a decent API due to netlink
+/* Upper bound on the number of interface records. A record is added for each
+ * interface, and again whenever one of its attributes changes. Records no
+ * entry refers to any longer are reclaimed once they run out. */
+#define MAX_INTERFACE_HANDLES 16384
+
+/* Handle of the current record of each interface, by ifindex. 0 means there
+ * is no such interface. */
+typedef boost::shared_ptr<const vector<InterfaceHandle> > InterfaceIndex;
+
+/**
+ * Flows for the routes of one kernel routing table.
+ *
+ * There is one instance per routing table we follow: the main table, plus the
+ * table of every VRF device that one of our interfaces belongs to. Each one
+ * keeps its own route index, and tags its RouteMods with its VRF.
+ *
+ * Everything else is shared by all tables and remains static: the neighbour
+ * table, the netlink sockets and the threads reading from them.
+ */
+// TODO: the shared state could move to a class of its own. It is a little
+// bit challenging to devise a decent API due to netlink
 class FlowTable {
     public:
-        static void HTPollingCb();
+        FlowTable(uint32_t table, uint32_t vrf);
+
         static void GWResolverCb();
+        static void ReconcilerCb();
 
         static void clear();
         static void interrupt();
-        static void start(uint64_t vm_id, map<string, Interface> interfaces, IPCMessageService* ipc, vector<uint32_t>* down_ports);
-        static void print_test();
+        static void routeStats(size_t& routes, size_t& bytes);
+        static void init(uint64_t vm_id, IPCMessageService* ipc,
+                         PortState* ports, FlowSnapshot* snapshot);
+        static void start(uint64_t vm_id, IPCMessageService* ipc,
+                          PortState* ports, FlowSnapshot* snapshot);
+        static void run(UpdateSource* neighbours, UpdateSource* routes);
+
+        static void setInterfaces(const vector<Interface>& interfaces);
+        static void addTable(uint32_t table, uint32_t vrf);
+
+        static MACAddress findHost(const IPAddress& host);
+
+        static void portDown(uint32_t port, uint32_t epoch);
+        static void portUp(uint32_t port, uint32_t epoch);
 
         static int updateHostTable(const struct sockaddr_nl*,
                                    struct nlmsghdr*, void*);
@@ -42,7 +83,6 @@ class FlowTable {
 #ifdef FPM_ENABLED
         static void updateNHLFE(nhlfe_msg_t *nhlfe_msg);
 #else
-        static void RTPollingCb();
         static int updateRouteTable(const struct sockaddr_nl*,
                                     struct nlmsghdr*, void*);
 #endif /* FPM_ENABLED */
@@ -55,44 +95,95 @@ class FlowTable {
         static int lroute;
 
         static const MACAddress MAC_ADDR_NONE;
-        static map<string, Interface> interfaces;
-        static vector<uint32_t>* down_ports;
+        static const Interface NO_INTERFACE;
+        static const Interface* interfaceRecords[MAX_INTERFACE_HANDLES];
+        /* Entries on their way to the route and host tables, by handle */
+        static uint32_t interfacePins[MAX_INTERFACE_HANDLES];
+        static uint32_t interfaceCount;
+        static InterfaceIndex interfaceIndex;
+        static list<InterfaceHandle> retiredInterfaces;
+        static vector<InterfaceHandle> freeInterfaces;
+        static PortState* ports;
+        static FlowSnapshot* snapshot;
         static IPCMessageService* ipc;
         static uint64_t vm_id;
 
         static boost::thread GWResolver;
         static boost::thread HTPolling;
+        static boost::thread RTPolling;
+        static boost::thread Reconciler;
         static struct rtnl_handle rthNeigh;
 
-#ifdef FPM_ENABLED
-        static boost::thread FPMClient;
-#else
-        static boost::thread RTPolling;
+#ifndef FPM_ENABLED
         static struct rtnl_handle rth;
 #endif /* FPM_ENABLED */
 
-        static SyncQueue< std::pair<RouteModType,RouteEntry> > pendingRoutes;
-        static list<RouteEntry> routeTable;
+        /* Kernel routing table and VRF of this instance */
+        uint32_t table;
+        uint32_t vrf;
+
+        /* Installed and parked routes, by prefix */
+        RouteTable routes;
+
+        RouteEntry routeEntry(uint32_t id) const;
+        void addRoute(const RouteEntry& re);
+        void removeRoute(const RouteEntry& re);
+        int installRoute(uint32_t id);
+        int withdrawRoute(uint32_t id);
+        int gatewayResolved(const string& host, bool changed);
+        int gatewayFailed(const string& host);
+        int withdrawPort(uint32_t port);
+        int reinstallPort(uint32_t port);
+        int sendToHw(RouteModType, const RouteEntry&);
+
+        /* Routing tables we follow, by kernel table id */
+        static map<uint32_t, FlowTable*> tables;
+        static FlowTable* getTable(uint32_t table);
+        static bool isGateway(const string& host);
+
+        static BatchQueue< std::pair<RouteModType,RouteEntry> > pendingRoutes;
         static map<string, HostEntry> hostTable;
-        static map<string, int> pendingNeighbours;
+        static list<string> hostAge;
+        static map<string, list<string>::iterator> hostAgeIndex;
+        static set<string> pendingNeighbours;
+        static vector<struct sockaddr_storage> ndProbes;
+        static int ndSocket4;
+        static int ndSocket6;
 
         static bool is_port_down(uint32_t port);
-        static int getInterface(const char *intf, const char *type,
-                                Interface& iface);
-
-        static int initiateND(const char *hostAddr);
+        static void dumpKernelState();
+        static void dumpRoutes(uint32_t table);
+        static void reconcile();
+        static InterfaceHandle addInterface(const Interface& iface);
+        static void reclaimInterfaces();
+        static Interface getInterface(InterfaceHandle handle);
+        static int findInterface(int ifindex, const char *type,
+                                 InterfaceHandle& handle);
+        static void releaseInterface(InterfaceHandle handle);
+
+        static void addHost(const HostEntry& he);
+        static void removeHost(const string& host);
+        static void neighbourResolved(const string& host, bool changed);
+        static void neighbourFailed(const string& host);
+        static void evictHosts();
+        static void touchHost(const string& host);
+        static void forgetHost(const string& host);
+        static void cancelND(const string& host);
+
+        static int initiateND(const IPAddress& host, const Interface& iface);
+        static void flushND();
+        static void sendProbes(int family, int& sock,
+                               vector<struct mmsghdr>& msgs);
         static int resolveGateway(const IPAddress&, const Interface&);
-        static const MACAddress& findHost(const IPAddress& host);
 
         static int setEthernet(RouteMod& rm, const Interface& local_iface,
                                const MACAddress& gateway);
         static int setIP(RouteMod& rm, const IPAddress& addr,
                          const IPAddress& mask);
-        static int sendToHw(RouteModType, const RouteEntry&);
         static int sendToHw(RouteModType, const HostEntry&);
         static int sendToHw(RouteModType, const IPAddress& addr,
                             const IPAddress& mask, const Interface&,
-                            const MACAddress& gateway);
+                            const MACAddress& gateway, uint32_t vrf);
 };
 
 #endif /* FLOWTABLE_HH_ */
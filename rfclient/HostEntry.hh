@@ -9,8 +9,17 @@ class HostEntry {
     public:
         IPAddress address;
         MACAddress hwaddress;
-        Interface interface;
+        InterfaceHandle interface;
+        /* Last NUD state reported by the kernel (NUD_REACHABLE, NUD_STALE..) */
+        uint16_t state;
 
+        HostEntry() {
+            this->interface = 0;
+            this->state = 0;
+        }
+
+        /* The NUD state is deliberately left out: a neighbour moving between
+         * REACHABLE and STALE does not change what we install in hardware. */
         bool operator==(const HostEntry& other) const {
             return (this->address == other.address) and
                 (this->hwaddress == other.hwaddress) and
@@ -4,27 +4,38 @@
 #include "types/IPAddress.h"
 #include "types/MACAddress.h"
 
+/* Small integer standing for an Interface registered with FlowTable */
+typedef uint16_t InterfaceHandle;
+
 class Interface {
     public:
         uint32_t port;
+        /* Kernel index of the interface, 0 if unknown */
+        int ifindex;
         string name;
         IPAddress address;
         IPAddress netmask;
         MACAddress hwaddress;
         bool active;
+        /* Table of the VRF the interface belongs to, 0 if none */
+        uint32_t vrf;
 
         Interface() {
+            this->ifindex = 0;
             this->active = false;
+            this->vrf = 0;
         }
 
         Interface& operator=(const Interface& other) {
             if (this != &other) {
                 this->port = other.port;
+                this->ifindex = other.ifindex;
                 this->name = other.name;
                 this->address = other.address;
                 this->netmask = other.netmask;
                 this->hwaddress = other.hwaddress;
                 this->active = other.active;
+                this->vrf = other.vrf;
             }
             return *this;
         }
@@ -32,11 +43,13 @@ class Interface {
         bool operator==(const Interface& other) const {
             return
                 (this->port == other.port) and
+                (this->ifindex == other.ifindex) and
                 (this->name == other.name) and
                 (this->address == other.address) and
                 (this->netmask == other.netmask) and
                 (this->hwaddress == other.hwaddress) and
-                (this->active == other.active);
+                (this->active == other.active) and
+                (this->vrf == other.vrf);
         }
 };
 
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "defs.h"
+#include "InterfaceManager.hh"
+
+#define MAPPING_PACKET_SIZE 23
+
+/* Attribute of a VRF device holding its routing table (linux >= 4.3) */
+#ifndef IFLA_VRF_TABLE
+  #define IFLA_VRF_TABLE 1
+#endif /* IFLA_VRF_TABLE */
+
+/* Link flags following the carrier, from <linux/if.h> */
+#ifndef IFF_LOWER_UP
+  #define IFF_LOWER_UP 0x10000
+#endif /* IFF_LOWER_UP */
+#ifndef IFF_DORMANT
+  #define IFF_DORMANT 0x20000
+#endif /* IFF_DORMANT */
+
+#define CARRIER_FLAGS (IFF_RUNNING | IFF_LOWER_UP | IFF_DORMANT)
+
+/**
+ * Compare two link states, leaving out the flags that follow the carrier:
+ * nothing we do with a link depends on them, and they change every time a
+ * cable is plugged in or out.
+ */
+bool LinkState::operator==(const LinkState& other) const {
+    return (this->ifindex == other.ifindex) and
+        (this->name == other.name) and
+        (memcmp(this->hwaddress, other.hwaddress, IFHWADDRLEN) == 0) and
+        ((this->flags & ~CARRIER_FLAGS) == (other.flags & ~CARRIER_FLAGS)) and
+        (this->master == other.master) and
+        (this->vrf_table == other.vrf_table);
+}
+
+InterfaceManager::InterfaceManager()
+    : source(&this->rth, InterfaceManager::updateLink, this) {
+    this->observer = NULL;
+    this->sock = -1;
+    this->rth.fd = -1;
+}
+
+InterfaceManager::~InterfaceManager() {
+    this->listener.interrupt();
+    if (this->listener.joinable()) {
+        this->listener.join();
+    }
+    if (this->rth.fd >= 0) {
+        rtnl_close(&this->rth);
+    }
+    if (this->sock >= 0) {
+        close(this->sock);
+    }
+}
+
+/**
+ * Subscribe to link notifications and dump the current link table.
+ *
+ * Returns 0 on success, or -1 if netlink cannot be used.
+ */
+int InterfaceManager::load() {
+    struct rtnl_handle rthDump;
+
+    /* Subscribe before dumping, so that no update is lost in between. */
+    if (rtnl_open(&this->rth, RTMGRP_LINK) < 0) {
+        fprintf(stderr, "Cannot open netlink socket for link updates\n");
+        return -1;
+    }
+
+    if (rtnl_open(&rthDump, 0) < 0) {
+        fprintf(stderr, "Cannot open netlink socket to dump links\n");
+        rtnl_close(&this->rth);
+        this->rth.fd = -1;
+        return -1;
+    }
+
+    int ret = 0;
+    if (rtnl_wilddump_request(&rthDump, AF_UNSPEC, RTM_GETLINK) < 0 ||
+        rtnl_dump_filter(&rthDump, InterfaceManager::updateLink, this,
+                         NULL, NULL) < 0) {
+        fprintf(stderr, "Failed to dump the link table\n");
+        ret = -1;
+    }
+
+    rtnl_close(&rthDump);
+    return ret;
+}
+
+/**
+ * Start following link updates in the background, notifying 'observer' of
+ * every change. load() must have been called first.
+ */
+void InterfaceManager::start(LinkObserver* observer) {
+    this->observer = observer;
+    this->listener = boost::thread(&NetlinkSource::run, &this->source);
+}
+
+int InterfaceManager::updateLink(const struct sockaddr_nl*,
+                                 struct nlmsghdr* n, void* arg) {
+    ((InterfaceManager*) arg)->update(n);
+    return 0;
+}
+
+void InterfaceManager::update(struct nlmsghdr* n) {
+    struct ifinfomsg *ifi = (struct ifinfomsg *) NLMSG_DATA(n);
+
+    if (n->nlmsg_type != RTM_NEWLINK && n->nlmsg_type != RTM_DELLINK) {
+        return;
+    }
+
+    LinkState link;
+    link.ifindex = ifi->ifi_index;
+    link.flags = ifi->ifi_flags;
+    link.master = 0;
+    link.vrf_table = 0;
+    memset(link.hwaddress, 0, IFHWADDRLEN);
+
+    bool is_vrf = false;
+    struct rtattr *rta = IFLA_RTA(ifi);
+    int len = IFLA_PAYLOAD(n);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            link.name = (const char *) RTA_DATA(rta);
+            break;
+        case IFLA_ADDRESS:
+            if (RTA_PAYLOAD(rta) == IFHWADDRLEN) {
+                memcpy(link.hwaddress, RTA_DATA(rta), IFHWADDRLEN);
+            }
+            break;
+        case IFLA_MASTER:
+            link.master = *(int *) RTA_DATA(rta);
+            break;
+        case IFLA_LINKINFO: {
+            struct rtattr *info = (struct rtattr *) RTA_DATA(rta);
+            int info_len = RTA_PAYLOAD(rta);
+            for (; RTA_OK(info, info_len); info = RTA_NEXT(info, info_len)) {
+                if (info->rta_type == IFLA_INFO_KIND) {
+                    is_vrf = strcmp((const char *) RTA_DATA(info), "vrf") == 0;
+                } else if (info->rta_type == IFLA_INFO_DATA) {
+                    struct rtattr *data = (struct rtattr *) RTA_DATA(info);
+                    int data_len = RTA_PAYLOAD(info);
+                    for (; RTA_OK(data, data_len);
+                         data = RTA_NEXT(data, data_len)) {
+                        if (data->rta_type == IFLA_VRF_TABLE) {
+                            link.vrf_table = *(uint32_t *) RTA_DATA(data);
+                        }
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (!is_vrf) {
+        link.vrf_table = 0;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        map<int, LinkState>::iterator iter = this->links.find(link.ifindex);
+
+        if (n->nlmsg_type == RTM_DELLINK) {
+            if (iter == this->links.end()) {
+                return;
+            }
+            this->names.erase(iter->second.name);
+            this->links.erase(iter);
+        } else {
+            /* Most notifications are about statistics or carrier changes,
+             * which operator== leaves out. */
+            if (iter != this->links.end() && iter->second == link) {
+                return;
+            }
+            if (iter != this->links.end()) {
+                this->names.erase(iter->second.name);
+            }
+            this->links[link.ifindex] = link;
+            this->names[link.name] = link.ifindex;
+        }
+    }
+
+    if (this->observer != NULL) {
+        this->observer->linksChanged();
+    }
+}
+
+/**
+ * Get the number of the port an interface stands for, from its name: ethN is
+ * port N. Returns 0 if the interface is not a port, as is the case of eth0,
+ * which connects rfclient to RFServer, and of sub-interfaces such as
+ * eth1.100.
+ */
+uint32_t InterfaceManager::port_number(const string& name) {
+    if (name == DEFAULT_RFCLIENT_INTERFACE) {
+        return 0;
+    }
+
+    size_t pos = name.find_first_of("0123456789");
+    if (pos == string::npos || pos == 0 ||
+        name.find_first_not_of("0123456789", pos) != string::npos) {
+        return 0;
+    }
+    return strtoul(name.c_str() + pos, NULL, 10);
+}
+
+/**
+ * Get the interfaces that stand for ports, by port number, tagged with the
+ * VRF they belong to if any.
+ */
+void InterfaceManager::get_ports(map<int, Interface>& ports) const {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    map<int, LinkState>::const_iterator iter = this->links.begin();
+    for (; iter != this->links.end(); iter++) {
+        const LinkState& link = iter->second;
+        uint32_t port = InterfaceManager::port_number(link.name);
+        if (port == 0 || (link.flags & IFF_LOOPBACK) || link.vrf_table != 0) {
+            continue;
+        }
+
+        Interface interface;
+        interface.port = port;
+        interface.ifindex = link.ifindex;
+        interface.name = link.name;
+        interface.hwaddress = MACAddress(link.hwaddress);
+        interface.active = true;
+
+        map<int, LinkState>::const_iterator master;
+        master = this->links.find(link.master);
+        if (master != this->links.end()) {
+            interface.vrf = master->second.vrf_table;
+        }
+
+        ports[port] = interface;
+    }
+}
+
+/**
+ * Send a mapping packet for each of the given ports, all in one go.
+ *
+ * Interfaces that are unknown or down are skipped, since the packet could not
+ * reach RFVS. On return, 'sent' tells which packets were sent.
+ *
+ * Returns the number of packets sent.
+ */
+int InterfaceManager::send_mappings(const vector<PortMapping>& mappings,
+                                    uint64_t vm_id, vector<bool>& sent) {
+    vector<char> buffers(mappings.size() * MAPPING_PACKET_SIZE, 0);
+    vector<struct sockaddr_ll> addrs(mappings.size());
+    vector<struct iovec> iovs(mappings.size());
+    vector<struct mmsghdr> msgs;
+    vector<size_t> index;
+    uint16_t ethType = htons(RF_ETH_PROTO);
+
+    sent.assign(mappings.size(), false);
+
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        for (size_t i = 0; i < mappings.size(); i++) {
+            map<string, int>::const_iterator name;
+            name = this->names.find(mappings[i].name);
+            if (name == this->names.end()) {
+                continue;
+            }
+            map<int, LinkState>::const_iterator link;
+            link = this->links.find(name->second);
+            if (!(link->second.flags & IFF_UP)) {
+                continue;
+            }
+
+            /* Null destination address, the address of the interface as
+             * source, then the VM id and the port. */
+            char *buffer = &buffers[i * MAPPING_PACKET_SIZE];
+            uint8_t port = mappings[i].port;
+            memcpy(buffer + IFHWADDRLEN, link->second.hwaddress, IFHWADDRLEN);
+            memcpy(buffer + 2 * IFHWADDRLEN, &ethType, sizeof(ethType));
+            memcpy(buffer + 14, &vm_id, sizeof(vm_id));
+            memcpy(buffer + 22, &port, sizeof(port));
+
+            memset(&addrs[i], 0, sizeof(struct sockaddr_ll));
+            addrs[i].sll_family = AF_PACKET;
+            addrs[i].sll_protocol = ethType;
+            addrs[i].sll_ifindex = link->second.ifindex;
+
+            iovs[i].iov_base = buffer;
+            iovs[i].iov_len = MAPPING_PACKET_SIZE;
+
+            struct mmsghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_hdr.msg_name = &addrs[i];
+            msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msg.msg_hdr.msg_iov = &iovs[i];
+            msg.msg_hdr.msg_iovlen = 1;
+            msgs.push_back(msg);
+            index.push_back(i);
+        }
+
+        /* Protocol 0: the socket is only used for sending, and must not
+         * queue up the packets it would otherwise receive. */
+        if (!msgs.empty() && this->sock < 0) {
+            this->sock = socket(AF_PACKET, SOCK_RAW, 0);
+            if (this->sock < 0) {
+                perror("socket() failed");
+                return 0;
+            }
+        }
+    }
+
+    int count = 0;
+    size_t done = 0;
+    while (done < msgs.size()) {
+        int n = sendmmsg(this->sock, &msgs[done], msgs.size() - done, 0);
+        if (n < 0) {
+            /* Skip the packet that failed, e.g. the interface went away. */
+            perror("sendmmsg() failed");
+            done++;
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            sent[index[done + i]] = true;
+        }
+        count += n;
+        done += n;
+    }
+    return count;
+}
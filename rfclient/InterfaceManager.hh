@@ -0,0 +1,88 @@
+#ifndef INTERFACEMANAGER_HH
+#define INTERFACEMANAGER_HH
+
+#include <stdint.h>
+#include <net/if.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "libnetlink.hh"
+#include "Interface.hh"
+#include "UpdateSource.hh"
+
+using namespace std;
+
+/* Link state of a local interface, as last reported by the kernel */
+struct LinkState {
+    int ifindex;
+    string name;
+    uint8_t hwaddress[IFHWADDRLEN];
+    unsigned int flags;
+    /* ifindex of the device this one is enslaved to, 0 if none */
+    int master;
+    /* Routing table of a VRF device, 0 for any other kind of device */
+    uint32_t vrf_table;
+
+    bool operator==(const LinkState& other) const;
+};
+
+/* A mapping packet to be sent to RFVS through a local interface */
+struct PortMapping {
+    string name;
+    uint32_t port;
+};
+
+/* Notified by InterfaceManager whenever the link table changes */
+class LinkObserver {
+    public:
+        virtual ~LinkObserver() {}
+        virtual void linksChanged() = 0;
+};
+
+/**
+ * Table of the local interfaces, kept up to date from netlink.
+ *
+ * The link table is dumped once by load(), then start() follows RTM_NEWLINK
+ * and RTM_DELLINK notifications, so looking up the index, address or flags of
+ * an interface never needs an ioctl. Links are keyed by ifindex, since names
+ * can change.
+ *
+ * Mapping packets are sent through a single packet socket, opened on first
+ * use and kept open. The outgoing interface is given per packet, so a batch
+ * for any number of ports goes out in one sendmmsg() call.
+ *
+ * All methods are thread-safe.
+ */
+class InterfaceManager {
+    public:
+        InterfaceManager();
+        ~InterfaceManager();
+
+        int load();
+        void start(LinkObserver* observer);
+
+        void get_ports(map<int, Interface>& ports) const;
+
+        int send_mappings(const vector<PortMapping>& mappings,
+                          uint64_t vm_id, vector<bool>& sent);
+
+        static uint32_t port_number(const string& name);
+        static int updateLink(const struct sockaddr_nl*, struct nlmsghdr*,
+                              void*);
+
+    private:
+        mutable boost::mutex mutex;
+        map<int, LinkState> links;
+        map<string, int> names;
+        LinkObserver* observer;
+        int sock;
+        struct rtnl_handle rth;
+        NetlinkSource source;
+        boost::thread listener;
+
+        void update(struct nlmsghdr* n);
+};
+
+#endif /* INTERFACEMANAGER_HH */
@@ -0,0 +1,68 @@
+#ifndef PORTSTATE_HH
+#define PORTSTATE_HH
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+
+/* Highest port number we keep state for. Ports above this are always up. */
+#define MAX_PORTS 4096
+
+/**
+ * Lock-free table holding the up/down state of every port.
+ *
+ * Each port has an epoch counter that is incremented on every state
+ * transition. Even epochs mean the port is up, odd epochs mean it is down, so
+ * ports start up. Readers that need to know whether a port has bounced since
+ * they last looked at it can compare epochs.
+ */
+class PortState {
+    public:
+        PortState() {
+            for (uint32_t i = 0; i < MAX_PORTS; i++) {
+                this->epochs[i].store(0, boost::memory_order_relaxed);
+            }
+        }
+
+        bool is_down(uint32_t port) const {
+            return (this->epoch(port) & 1) != 0;
+        }
+
+        uint32_t epoch(uint32_t port) const {
+            if (port >= MAX_PORTS) {
+                return 0;
+            }
+            return this->epochs[port].load(boost::memory_order_acquire);
+        }
+
+        /* Returns the epoch after the transition, which is unchanged if the
+         * port was already down. */
+        uint32_t set_down(uint32_t port) {
+            return this->transition(port, 1);
+        }
+
+        /* Returns the epoch after the transition, which is unchanged if the
+         * port was already up. */
+        uint32_t set_up(uint32_t port) {
+            return this->transition(port, 0);
+        }
+
+    private:
+        boost::atomic<uint32_t> epochs[MAX_PORTS];
+
+        uint32_t transition(uint32_t port, uint32_t down) {
+            if (port >= MAX_PORTS) {
+                return 0;
+            }
+
+            uint32_t current = this->epochs[port].load(boost::memory_order_acquire);
+            while ((current & 1) != down) {
+                if (this->epochs[port].compare_exchange_weak(current,
+                        current + 1, boost::memory_order_acq_rel)) {
+                    return current + 1;
+                }
+            }
+            return current;
+        }
+};
+
+#endif /* PORTSTATE_HH */
@@ -2,7 +2,6 @@
 #include <net/if_arp.h>
 #include <arpa/inet.h>
 #include <netpacket/packet.h>
-#include <ifaddrs.h>
 #include <syslog.h>
 #include <cstdlib>
 #include <boost/thread.hpp>
@@ -13,8 +12,6 @@
 #include "defs.h"
 #include "FlowTable.h"
 
-#define BUFFER_SIZE 23 /* Mapping packet size. */
-
 using namespace std;
 
 /* Get the MAC address of the interface. */
@@ -34,15 +31,15 @@ int get_hwaddr_byname(const char * ifname, uint8_t hwaddr[]) {
     strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
     ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
 
-    if (-1 == ioctl(sock, SIOCGIFHWADDR, &ifr)) {
+    int ret = ioctl(sock, SIOCGIFHWADDR, &ifr);
+    close(sock);
+    if (-1 == ret) {
         perror("ioctl(SIOCGIFHWADDR) ");
         return -1;
     }
 
     std::memcpy(hwaddr, ifr.ifr_ifru.ifru_hwaddr.sa_data, IFHWADDRLEN);
 
-    close(sock);
-
     return 0;
 }
 
@@ -64,22 +61,31 @@ uint64_t get_interface_id(const char *ifname) {
     return id;
 }
 
-RFClient::RFClient(uint64_t id, const string &address) {
+RFClient::RFClient(uint64_t id, const string &address,
+                   const string &snapshot_path, unsigned int stale_time) {
     this->id = id;
     syslog(LOG_INFO, "Starting RFClient (vm_id=%s)", to_string<uint64_t>(this->id).c_str());
     ipc = (IPCMessageService*) new MongoIPCMessageService(address, MONGO_DB_NAME, to_string<uint64_t>(this->id));
 
-    this->init_ports = 0;
-    this->load_interfaces();
-
-    for (map<int, Interface>::iterator it = this->interfaces.begin() ; it != this->interfaces.end(); it++) {
-        Interface i = it->second;
-        ifacesMap[i.name] = i;
+    this->use_snapshot = false;
+    if (!snapshot_path.empty()) {
+        if (this->snapshot.open(snapshot_path, this->id, stale_time) == 0) {
+            this->use_snapshot = true;
+        } else {
+            syslog(LOG_WARNING, "Cannot use snapshot %s, graceful restart "
+                   "disabled", snapshot_path.c_str());
+        }
+    }
 
-        PortRegister msg(this->id, i.port, i.hwaddress);
-        this->ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
-        syslog(LOG_INFO, "Registering client port (vm_port=%d)", i.port);
+    if (this->links.load() < 0) {
+        fprintf(stderr, "Cannot load the interfaces\n");
+        exit(EXIT_FAILURE);
     }
+    this->linksChanged();
+
+    this->links.start(this);
+    boost::thread t(&RFClient::MappingCb, this);
+    t.detach();
 
     this->startFlowTable();
 
@@ -87,7 +93,9 @@ RFClient::RFClient(uint64_t id, const string &address) {
 }
 
 void RFClient::startFlowTable() {
-    boost::thread t(&FlowTable::start, this->id, this->ifacesMap, this->ipc, &(this->down_ports));
+    FlowSnapshot* snapshot = this->use_snapshot ? &(this->snapshot) : NULL;
+    boost::thread t(&FlowTable::start, this->id, this->ipc, &(this->ports),
+                    snapshot);
     t.detach();
 }
 
@@ -102,17 +110,14 @@ bool RFClient::process(const string &, const string &, const string &, IPCMessag
             syslog(LOG_INFO,
                    "Received port configuration (vm_port=%d)",
                    vm_port);
-            vector<uint32_t>::iterator it;
-            for (it=down_ports.begin(); it < down_ports.end(); it++)
-                if (*it == vm_port)
-                    down_ports.erase(it);
-            send_port_map(vm_port);
+            uint32_t epoch = this->ports.set_up(vm_port);
+            this->pendingMappings.push(PendingMapping(vm_port, epoch));
         }
         else if (operation_id == 1) {
             syslog(LOG_INFO,
                    "Received port reset (vm_port=%d)",
                    vm_port);
-            down_ports.push_back(vm_port);
+            FlowTable::portDown(vm_port, this->ports.set_down(vm_port));
         }
     }
     else
@@ -121,65 +126,16 @@ bool RFClient::process(const string &, const string &, const string &, IPCMessag
     return true;
 }
 
-int RFClient::send_packet(const char ethName[], uint64_t vm_id, uint8_t port) {
-    char buffer[BUFFER_SIZE];
-    uint16_t ethType;
-    struct ifreq req;
-    struct sockaddr_ll sll;
-    uint8_t srcAddress[IFHWADDRLEN];
-    uint8_t dstAddress[IFHWADDRLEN] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-
-    int SockFd = socket(PF_PACKET, SOCK_RAW, htons(RF_ETH_PROTO));
-
-    strcpy(req.ifr_name, ethName);
-
-    if (ioctl(SockFd, SIOCGIFFLAGS, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
-        exit(1);
-    }
-
-    /* If the interface is down we can't send the packet. */
-    printf("FLAG %d\n", req.ifr_flags & IFF_UP);
-    if (!(req.ifr_flags & IFF_UP))
-        return -1;
-
-    /* Get the interface index. */
-    if (ioctl(SockFd, SIOCGIFINDEX, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
-        exit(1);
-    }
-
-    int ifindex = req.ifr_ifindex;
-
-    int addrLen = sizeof(struct sockaddr_ll);
-
-    if (ioctl(SockFd, SIOCGIFHWADDR, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
-        exit(1);
+/**
+ * Send the mapping packets of the ports that came up, gathering those that
+ * arrive together, e.g. when RFServer restarts and configures every port.
+ */
+void RFClient::MappingCb() {
+    while (true) {
+        list<PendingMapping> batch;
+        this->pendingMappings.wait_and_pop_all(batch);
+        this->send_port_maps(batch);
     }
-    int i;
-    for (i = 0; i < IFHWADDRLEN; i++)
-        srcAddress[i] = (uint8_t) req.ifr_hwaddr.sa_data[i];
-
-    memset(&sll, 0, sizeof(struct sockaddr_ll));
-    sll.sll_family = PF_PACKET;
-    sll.sll_ifindex = ifindex;
-
-    if (bind(SockFd, (struct sockaddr *) &sll, addrLen) < 0) {
-        fprintf(stderr, "ERROR! bind() call has failed: %s\n", strerror(errno));
-        exit(1);
-    }
-
-    memset(buffer, 0, BUFFER_SIZE);
-
-    memcpy((void *) buffer, (void *) dstAddress, IFHWADDRLEN);
-    memcpy((void *) (buffer + IFHWADDRLEN), (void *) srcAddress, IFHWADDRLEN);
-    ethType = htons(RF_ETH_PROTO);
-    memcpy((void *) (buffer + 2 * IFHWADDRLEN), (void *) &ethType, sizeof(uint16_t));
-    memcpy((void *) (buffer + 14), (void *) &vm_id, sizeof(uint64_t));
-    memcpy((void *) (buffer + 22), (void *) &port, sizeof(uint8_t));
-    return (sendto(SockFd, buffer, BUFFER_SIZE, 0, (struct sockaddr *) &sll, (socklen_t) addrLen));
-
 }
 
 /* Set the MAC address of the interface. */
@@ -202,6 +158,7 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
 
     if (-1 == ioctl(sock, SIOCSIFFLAGS, &ifr)) {
         perror("ioctl(SIOCSIFFLAGS) ");
+        close(sock);
         return -1;
     }
 
@@ -210,6 +167,7 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
 
     if (-1 == ioctl(sock, SIOCSIFHWADDR, &ifr)) {
         perror("ioctl(SIOCSIFHWADDR) ");
+        close(sock);
         return -1;
     }
 
@@ -217,6 +175,7 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
 
     if (-1 == ioctl(sock, SIOCSIFFLAGS, &ifr)) {
         perror("ioctl(SIOCSIFFLAGS) ");
+        close(sock);
         return -1;
     }
 
@@ -225,55 +184,92 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
     return 0;
 }
 
-/* Get all names of the interfaces in the system. */
-void RFClient::load_interfaces() {
-    struct ifaddrs *ifaddr, *ifa;
-    int family;
-    int intfNum;
+/**
+ * Bring our interfaces in line with the link table: register the ports that
+ * showed up, changed address or moved to another VRF with RFServer, hand
+ * FlowTable the new set and have it follow the routing tables of their VRFs.
+ *
+ * Ports that go away are only forgotten: RFServer keeps their registration,
+ * which is still valid if they come back.
+ */
+void RFClient::linksChanged() {
+    boost::lock_guard<boost::mutex> lock(this->interfacesMutex);
+    map<int, Interface> current;
+    this->links.get_ports(current);
+
+    vector<Interface> published;
+    set<uint32_t> vrfs;
+    map<int, Interface>::iterator iter = current.begin();
+    for (; iter != current.end(); iter++) {
+        Interface& i = iter->second;
+        published.push_back(i);
+        if (i.vrf != 0) {
+            vrfs.insert(i.vrf);
+        }
+
+        map<int, Interface>::iterator old = this->interfaces.find(i.port);
+        if (old != this->interfaces.end() &&
+            old->second.hwaddress == i.hwaddress &&
+            old->second.vrf == i.vrf) {
+            continue;
+        }
 
-    if (getifaddrs(&ifaddr) == -1) {
-        perror("getifaddrs");
-        exit( EXIT_FAILURE);
+        PortRegister msg(this->id, i.port, i.hwaddress, i.vrf);
+        this->ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
+        syslog(LOG_INFO, "Registering client port (vm_port=%d, vrf=%u)",
+               i.port, i.vrf);
     }
 
-    /* Walk through linked list, maintaining head pointer so we
-     can free list later. */
-    intfNum = 0;
-    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-        family = ifa->ifa_addr->sa_family;
-
-        if (family == AF_PACKET && strcmp(ifa->ifa_name, "eth0") != 0 && strcmp(ifa->ifa_name, "lo") != 0) {
-	        get_hwaddr_byname(ifa->ifa_name, hwaddress);
-	        string ifaceName = ifa->ifa_name;
-	        size_t pos = ifaceName.find_first_of("123456789");
-	        string port_num = ifaceName.substr(pos, ifaceName.length() - pos + 1);
-	        uint32_t port_id = atoi(port_num.c_str());
-
-	        Interface interface;
-	        interface.port = port_id;
-	        interface.name = ifaceName;
-	        interface.hwaddress = MACAddress(hwaddress);
-	        interface.active = true;
-
-	        printf("Loaded interface %s\n", interface.name.c_str());
-
-	        this->interfaces[interface.port] = interface;
-	        intfNum++;
+    for (iter = this->interfaces.begin(); iter != this->interfaces.end();
+         iter++) {
+        if (current.find(iter->first) == current.end()) {
+            syslog(LOG_INFO, "Client port is gone (vm_port=%d)", iter->first);
         }
     }
 
-    /* Free list. */
-    freeifaddrs(ifaddr);
+    this->interfaces.swap(current);
+    FlowTable::setInterfaces(published);
+
+    /* The VRF id is the number of the routing table of the VRF device. */
+    set<uint32_t>::iterator vrf = vrfs.begin();
+    for (; vrf != vrfs.end(); vrf++) {
+        FlowTable::addTable(*vrf, *vrf);
+    }
 }
 
-void RFClient::send_port_map(uint32_t port) {
-    Interface i = this->interfaces[port];
-    if (send_packet(i.name.c_str(), this->id, i.port) == -1)
-        syslog(LOG_INFO, "Error sending mapping packet (vm_port=%d)",
-               i.port);
-    else
-        syslog(LOG_INFO, "Mapping packet was sent to RFVS (vm_port=%d)",
-               i.port);
+void RFClient::send_port_maps(const list<PendingMapping>& batch) {
+    vector<PortMapping> mappings;
+    list<PendingMapping>::const_iterator iter = batch.begin();
+    {
+        boost::lock_guard<boost::mutex> lock(this->interfacesMutex);
+        for (; iter != batch.end(); iter++) {
+            PortMapping mapping;
+            map<int, Interface>::iterator i;
+            i = this->interfaces.find(iter->first);
+            if (i != this->interfaces.end()) {
+                mapping.name = i->second.name;
+            }
+            mapping.port = iter->first;
+            mappings.push_back(mapping);
+        }
+    }
+
+    vector<bool> sent;
+    this->links.send_mappings(mappings, this->id, sent);
+
+    size_t n = 0;
+    for (iter = batch.begin(); iter != batch.end(); iter++, n++) {
+        if (!sent[n])
+            syslog(LOG_INFO, "Error sending mapping packet (vm_port=%d)",
+                   iter->first);
+        else
+            syslog(LOG_INFO, "Mapping packet was sent to RFVS (vm_port=%d)",
+                   iter->first);
+
+        /* The mapping is sent first so that RFServer knows where to
+         * install the flows that follow. */
+        FlowTable::portUp(iter->first, iter->second);
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -281,8 +277,10 @@ int main(int argc, char* argv[]) {
     stringstream ss;
     string id;
     string address = MONGO_ADDRESS;
+    string snapshot_path = DEFAULT_SNAPSHOT_PATH;
+    unsigned int stale_time = DEFAULT_STALE_TIME;
 
-    while ((c = getopt (argc, argv, "n:i:a:")) != -1)
+    while ((c = getopt (argc, argv, "n:i:a:s:g:")) != -1)
         switch (c) {
             case 'n':
                 fprintf (stderr, "Custom naming not supported yet.");
@@ -305,8 +303,16 @@ int main(int argc, char* argv[]) {
             case 'a':
                 address = optarg;
                 break;
+            case 's':
+                /* An empty path disables the snapshot altogether. */
+                snapshot_path = optarg;
+                break;
+            case 'g':
+                stale_time = atoi(optarg);
+                break;
             case '?':
-                if (optopt == 'n' || optopt == 'i' || optopt == 'a')
+                if (optopt == 'n' || optopt == 'i' || optopt == 'a' ||
+                    optopt == 's' || optopt == 'g')
                     fprintf(stderr, "Option -%c requires an argument.\n", optopt);
                 else if (isprint(optopt))
                     fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -319,7 +325,8 @@ int main(int argc, char* argv[]) {
 
 
     openlog("rfclient", LOG_NDELAY | LOG_NOWAIT | LOG_PID, SYSLOGFACILITY);
-    RFClient s(get_interface_id(DEFAULT_RFCLIENT_INTERFACE), address);
+    RFClient s(get_interface_id(DEFAULT_RFCLIENT_INTERFACE), address,
+               snapshot_path, stale_time);
 
     return 0;
 }
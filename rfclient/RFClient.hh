@@ -7,28 +7,37 @@
 #include "ipc/RFProtocol.h"
 #include "ipc/RFProtocolFactory.h"
 #include "FlowTable.h"
+#include "InterfaceManager.hh"
+#include "SyncQueue.h"
 
-class RFClient : private RFProtocolFactory, private IPCMessageProcessor {
+/* A port that came up, with its epoch, waiting for its mapping packet */
+typedef std::pair<uint32_t, uint32_t> PendingMapping;
+
+class RFClient : private RFProtocolFactory, private IPCMessageProcessor,
+                 private LinkObserver {
     public:
-        RFClient(uint64_t id, const string &address);
+        RFClient(uint64_t id, const string &address,
+                 const string &snapshot_path, unsigned int stale_time);
 
     private:
         FlowTable* flowTable;
         IPCMessageService* ipc;
         uint64_t id;
 
-        map<string, Interface> ifacesMap;
+        /* Our ports, by port number */
         map<int, Interface> interfaces;
-        vector<uint32_t> down_ports;
-
-        uint8_t hwaddress[IFHWADDRLEN];
-        int init_ports;
+        boost::mutex interfacesMutex;
+        InterfaceManager links;
+        SyncQueue<PendingMapping> pendingMappings;
+        PortState ports;
+        FlowSnapshot snapshot;
+        bool use_snapshot;
 
         void startFlowTable();
         bool process(const string &from, const string &to, const string &channel, IPCMessage& msg);
 
-        int send_packet(const char ethName[], uint64_t vm_id, uint8_t port);
         int set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t flags);
-        void load_interfaces();
-        void send_port_map(uint32_t port);
+        void linksChanged();
+        void MappingCb();
+        void send_port_maps(const list<PendingMapping>& batch);
 };
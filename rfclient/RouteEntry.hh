@@ -9,13 +9,29 @@ class RouteEntry {
         IPAddress address;
         IPAddress gateway;
         IPAddress netmask;
-        Interface interface;
+        InterfaceHandle interface;
+        /* Kernel routing table the route belongs to */
+        uint32_t table;
+        /* Priority of the route in the kernel, lower is preferred */
+        uint32_t metric;
+        /* Set on a route that took the place of the one with the same prefix
+         * and metric (NLM_F_REPLACE). Not part of the route itself. */
+        bool replace;
+
+        RouteEntry() {
+            this->interface = 0;
+            this->table = 0;
+            this->metric = 0;
+            this->replace = false;
+        }
 
         bool operator==(const RouteEntry& other) const {
             return (this->address == other.address) and
                 (this->gateway == other.gateway) and
                 (this->netmask == other.netmask) and
-                (this->interface == other.interface);
+                (this->interface == other.interface) and
+                (this->table == other.table) and
+                (this->metric == other.metric);
         }
 };
 
@@ -0,0 +1,397 @@
+#include <cstring>
+
+#include "RouteTable.hh"
+
+/* Marks a slot of the index whose route was erased */
+#define TOMBSTONE 0xfffffffe
+
+/* Number of slots of the index of an empty table. Must be a power of two. */
+#define INITIAL_SLOTS 1024
+
+#define NO_SLOT ((size_t) -1)
+
+RouteTable::RouteTable() {
+    this->allocated = 0;
+    this->used = 0;
+    this->slots.assign(INITIAL_SLOTS, NO_ROUTE);
+    this->tombstones = 0;
+}
+
+RouteTable::~RouteTable() {
+    this->clear();
+}
+
+/**
+ * Get the id of the route for the prefix of 're', or NO_ROUTE if there is
+ * none.
+ */
+uint32_t RouteTable::find(const RouteEntry& re) const {
+    uint8_t prefix[16];
+    uint8_t prefix_len, flags;
+
+    RouteTable::key(re, prefix, prefix_len, flags);
+    size_t slot = this->lookup(prefix, prefix_len, flags);
+    return slot == NO_SLOT ? NO_ROUTE : this->slots[slot];
+}
+
+/**
+ * Store the given route, which must not be in the table yet, going out of
+ * 'port' with the given flags. Returns its id.
+ */
+uint32_t RouteTable::insert(const RouteEntry& re, uint32_t port,
+                            uint8_t flags) {
+    /* Keep the index at most 70% full, tombstones included. */
+    if ((this->used + this->tombstones + 1) * 10 > this->slots.size() * 7) {
+        size_t size = this->slots.size();
+        while ((this->used + 1) * 10 > size * 5) {
+            size *= 2;
+        }
+        this->rehash(size);
+    }
+
+    uint32_t id = this->allocate();
+    RouteRecord& rec = this->get(id);
+    uint8_t key_flags;
+    RouteTable::key(re, rec.prefix, rec.prefix_len, key_flags);
+    rec.flags = ROUTE_USED | key_flags | flags;
+    rec.interface = re.interface;
+    rec.metric = re.metric;
+    rec.nexthop = this->addNextHop(re.gateway);
+    rec.port = port;
+    this->link(id);
+
+    if (rec.interface >= this->interfaceRoutes.size()) {
+        this->interfaceRoutes.resize(rec.interface + 1, 0);
+    }
+    this->interfaceRoutes[rec.interface]++;
+
+    size_t mask = this->slots.size() - 1;
+    size_t slot = RouteTable::hash(rec.prefix, rec.prefix_len, key_flags) & mask;
+    while (this->slots[slot] != NO_ROUTE && this->slots[slot] != TOMBSTONE) {
+        slot = (slot + 1) & mask;
+    }
+    if (this->slots[slot] == TOMBSTONE) {
+        this->tombstones--;
+    }
+    this->slots[slot] = id;
+    this->used++;
+    return id;
+}
+
+/**
+ * Remove the route with the given id from the table.
+ */
+void RouteTable::erase(uint32_t id) {
+    RouteRecord& rec = this->get(id);
+    size_t slot = this->lookup(rec.prefix, rec.prefix_len,
+                               rec.flags & ROUTE_IPV6);
+    if (slot != NO_SLOT) {
+        this->slots[slot] = TOMBSTONE;
+        this->tombstones++;
+    }
+
+    this->unlink(id);
+    this->interfaceRoutes[rec.interface]--;
+    rec.flags = 0;
+    this->freeIds.push_back(id);
+    this->used--;
+}
+
+void RouteTable::clear() {
+    vector<RouteRecord*>::iterator chunk = this->chunks.begin();
+    for (; chunk != this->chunks.end(); chunk++) {
+        delete[] *chunk;
+    }
+
+    this->chunks.clear();
+    this->freeIds.clear();
+    this->allocated = 0;
+    this->used = 0;
+    this->slots.assign(INITIAL_SLOTS, NO_ROUTE);
+    this->tombstones = 0;
+    this->nexthops.clear();
+    this->nexthopIds.clear();
+    this->freeNextHops.clear();
+    this->portHeads.clear();
+    this->interfaceRoutes.clear();
+}
+
+RouteRecord& RouteTable::get(uint32_t id) {
+    return this->chunks[id / ROUTE_CHUNK_SIZE][id % ROUTE_CHUNK_SIZE];
+}
+
+const RouteRecord& RouteTable::get(uint32_t id) const {
+    return this->chunks[id / ROUTE_CHUNK_SIZE][id % ROUTE_CHUNK_SIZE];
+}
+
+/**
+ * Check whether 're' stands for the route with the given id: it goes through
+ * the same gateway with the same metric. The interface is left out, as it
+ * gets a new record whenever one of its attributes changes.
+ */
+bool RouteTable::matches(uint32_t id, const RouteEntry& re) const {
+    const RouteRecord& rec = this->get(id);
+    return (rec.metric == re.metric) and
+        (this->nexthops[rec.nexthop].address == re.gateway);
+}
+
+/**
+ * Check whether 're' should take the place of the route with the given id,
+ * for the same prefix: it goes through the same gateway with the same metric,
+ * the kernel replaced that route with it, or the kernel prefers it.
+ */
+bool RouteTable::replaces(uint32_t id, const RouteEntry& re) const {
+    const RouteRecord& rec = this->get(id);
+    if (re.metric != rec.metric) {
+        return re.metric < rec.metric;
+    }
+    return re.replace or this->matches(id, re);
+}
+
+/**
+ * Rebuild the RouteEntry of the route with the given id. The routing table
+ * of the entry is left untouched.
+ */
+void RouteTable::entry(uint32_t id, RouteEntry& re) const {
+    const RouteRecord& rec = this->get(id);
+    int version = (rec.flags & ROUTE_IPV6) ? IPV6 : IPV4;
+
+    re.address = IPAddress(version, rec.prefix);
+    re.netmask = IPAddress(version, (int) rec.prefix_len);
+    re.gateway = this->nexthops[rec.nexthop].address;
+    re.interface = rec.interface;
+    re.metric = rec.metric;
+}
+
+uint32_t RouteTable::end() const {
+    return this->allocated;
+}
+
+size_t RouteTable::size() const {
+    return this->used;
+}
+
+/**
+ * Get an estimate of the memory used by the table, in bytes. Next-hops are
+ * counted with a rough allowance for the map node and string of each one.
+ */
+size_t RouteTable::memory() const {
+    return this->chunks.size() * ROUTE_CHUNK_SIZE * sizeof(RouteRecord) +
+        this->chunks.capacity() * sizeof(RouteRecord*) +
+        this->freeIds.capacity() * sizeof(uint32_t) +
+        this->slots.capacity() * sizeof(uint32_t) +
+        this->nexthops.capacity() * sizeof(NextHop) +
+        this->nexthopIds.size() * 128 +
+        this->portHeads.size() * 48;
+}
+
+bool RouteTable::isNextHop(const string& host) const {
+    return this->nexthopIds.find(host) != this->nexthopIds.end();
+}
+
+/**
+ * Get the ids of the routes going through the given gateway.
+ */
+void RouteTable::routesVia(const string& host, vector<uint32_t>& ids) const {
+    map<string, uint32_t>::const_iterator iter = this->nexthopIds.find(host);
+    if (iter == this->nexthopIds.end()) {
+        return;
+    }
+
+    uint32_t id = this->nexthops[iter->second].head;
+    for (; id != NO_ROUTE; id = this->get(id).next) {
+        ids.push_back(id);
+    }
+}
+
+/**
+ * Get the ids of the routes going out of the given port.
+ */
+void RouteTable::routesOn(uint32_t port, vector<uint32_t>& ids) const {
+    map<uint32_t, uint32_t>::const_iterator iter = this->portHeads.find(port);
+    if (iter == this->portHeads.end()) {
+        return;
+    }
+
+    uint32_t id = iter->second;
+    for (; id != NO_ROUTE; id = this->get(id).port_next) {
+        ids.push_back(id);
+    }
+}
+
+/* FNV-1a */
+uint32_t RouteTable::hash(const uint8_t* prefix, uint8_t prefix_len,
+                          uint8_t flags) {
+    size_t len = (flags & ROUTE_IPV6) ? 16 : 4;
+    uint32_t h = 2166136261U;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ prefix[i]) * 16777619U;
+    }
+    h = (h ^ prefix_len) * 16777619U;
+    return (h ^ flags) * 16777619U;
+}
+
+void RouteTable::key(const RouteEntry& re, uint8_t* prefix,
+                     uint8_t& prefix_len, uint8_t& flags) {
+    memset(prefix, 0, 16);
+    re.address.toArray(prefix);
+    prefix_len = re.netmask.toPrefixLen();
+    flags = re.address.getVersion() == IPV6 ? ROUTE_IPV6 : 0;
+}
+
+/**
+ * Get the slot of the index holding the given prefix, or NO_SLOT if it is
+ * not in the table.
+ */
+size_t RouteTable::lookup(const uint8_t* prefix, uint8_t prefix_len,
+                          uint8_t flags) const {
+    size_t mask = this->slots.size() - 1;
+    size_t slot = RouteTable::hash(prefix, prefix_len, flags) & mask;
+
+    for (; this->slots[slot] != NO_ROUTE; slot = (slot + 1) & mask) {
+        if (this->slots[slot] == TOMBSTONE) {
+            continue;
+        }
+
+        const RouteRecord& rec = this->get(this->slots[slot]);
+        if (rec.prefix_len == prefix_len &&
+            (rec.flags & ROUTE_IPV6) == flags &&
+            memcmp(rec.prefix, prefix, sizeof(rec.prefix)) == 0) {
+            return slot;
+        }
+    }
+    return NO_SLOT;
+}
+
+/**
+ * Rebuild the index with 'size' slots, dropping the tombstones.
+ */
+void RouteTable::rehash(size_t size) {
+    vector<uint32_t> slots(size, NO_ROUTE);
+    size_t mask = size - 1;
+
+    vector<uint32_t>::iterator iter = this->slots.begin();
+    for (; iter != this->slots.end(); iter++) {
+        if (*iter == NO_ROUTE || *iter == TOMBSTONE) {
+            continue;
+        }
+
+        const RouteRecord& rec = this->get(*iter);
+        size_t slot = RouteTable::hash(rec.prefix, rec.prefix_len,
+                                       rec.flags & ROUTE_IPV6) & mask;
+        while (slots[slot] != NO_ROUTE) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = *iter;
+    }
+
+    this->slots.swap(slots);
+    this->tombstones = 0;
+}
+
+uint32_t RouteTable::allocate() {
+    if (!this->freeIds.empty()) {
+        uint32_t id = this->freeIds.back();
+        this->freeIds.pop_back();
+        return id;
+    }
+
+    if (this->allocated == this->chunks.size() * ROUTE_CHUNK_SIZE) {
+        this->chunks.push_back(new RouteRecord[ROUTE_CHUNK_SIZE]());
+    }
+    return this->allocated++;
+}
+
+/**
+ * Get the id of the next-hop entry for the given gateway, adding it if
+ * needed.
+ */
+uint32_t RouteTable::addNextHop(const IPAddress& gateway) {
+    string host = gateway.toString();
+    map<string, uint32_t>::iterator iter = this->nexthopIds.find(host);
+    if (iter != this->nexthopIds.end()) {
+        return iter->second;
+    }
+
+    uint32_t id;
+    if (!this->freeNextHops.empty()) {
+        id = this->freeNextHops.back();
+        this->freeNextHops.pop_back();
+    } else {
+        id = this->nexthops.size();
+        this->nexthops.push_back(NextHop());
+    }
+
+    NextHop& nh = this->nexthops[id];
+    nh.address = gateway;
+    nh.host = host;
+    nh.head = NO_ROUTE;
+    nh.count = 0;
+    this->nexthopIds[host] = id;
+    return id;
+}
+
+/* Add a route to the lists of its next-hop and of its port */
+void RouteTable::link(uint32_t id) {
+    RouteRecord& rec = this->get(id);
+    NextHop& nh = this->nexthops[rec.nexthop];
+
+    rec.prev = NO_ROUTE;
+    rec.next = nh.head;
+    if (nh.head != NO_ROUTE) {
+        this->get(nh.head).prev = id;
+    }
+    nh.head = id;
+    nh.count++;
+
+    map<uint32_t, uint32_t>::iterator head =
+        this->portHeads.insert(make_pair(rec.port, NO_ROUTE)).first;
+    rec.port_prev = NO_ROUTE;
+    rec.port_next = head->second;
+    if (head->second != NO_ROUTE) {
+        this->get(head->second).port_prev = id;
+    }
+    head->second = id;
+}
+
+/* Remove a route from the lists of its next-hop and of its port, and forget
+ * the next-hop or the port when no route uses it anymore. */
+void RouteTable::unlink(uint32_t id) {
+    RouteRecord& rec = this->get(id);
+    NextHop& nh = this->nexthops[rec.nexthop];
+
+    if (rec.port_prev != NO_ROUTE) {
+        this->get(rec.port_prev).port_next = rec.port_next;
+    } else if (rec.port_next != NO_ROUTE) {
+        this->portHeads[rec.port] = rec.port_next;
+    } else {
+        this->portHeads.erase(rec.port);
+    }
+    if (rec.port_next != NO_ROUTE) {
+        this->get(rec.port_next).port_prev = rec.port_prev;
+    }
+
+    if (rec.prev != NO_ROUTE) {
+        this->get(rec.prev).next = rec.next;
+    } else {
+        nh.head = rec.next;
+    }
+    if (rec.next != NO_ROUTE) {
+        this->get(rec.next).prev = rec.prev;
+    }
+
+    if (--nh.count == 0) {
+        this->nexthopIds.erase(nh.host);
+        nh.host.clear();
+        this->freeNextHops.push_back(rec.nexthop);
+    }
+}
+
+/**
+ * Check whether any route goes through the interface with the given handle.
+ */
+bool RouteTable::usesInterface(InterfaceHandle handle) const {
+    return handle < this->interfaceRoutes.size() &&
+        this->interfaceRoutes[handle] != 0;
+}
@@ -0,0 +1,123 @@
+#ifndef ROUTETABLE_HH
+#define ROUTETABLE_HH
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types/IPAddress.h"
+#include "RouteEntry.hh"
+
+using namespace std;
+
+#define NO_ROUTE 0xffffffff
+
+/* Route flags */
+#define ROUTE_USED      0x01    /* The record holds a route */
+#define ROUTE_IPV6      0x02    /* The prefix is an IPv6 one */
+#define ROUTE_INSTALLED 0x04    /* Sent to hardware, parked otherwise */
+
+/* Number of records per chunk of the route pool */
+#define ROUTE_CHUNK_SIZE 4096
+
+/**
+ * A route as stored in the route table. The gateway is shared by all the
+ * routes using it and kept in the next-hop table. Routes through the same
+ * next-hop are linked together, and so are routes out of the same port.
+ */
+struct RouteRecord {
+    uint8_t prefix[16];
+    uint8_t prefix_len;
+    uint8_t flags;
+    InterfaceHandle interface;
+    uint32_t metric;
+    uint32_t nexthop;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t port;
+    uint32_t port_prev;
+    uint32_t port_next;
+};
+
+/* A gateway, with the list of the routes going through it */
+struct NextHop {
+    IPAddress address;
+    string host;
+    uint32_t head;
+    uint32_t count;
+};
+
+/**
+ * Routes of one kernel routing table, by prefix. The table holds a single
+ * route per prefix: callers check with matches() that a route they are given
+ * is the one stored before acting on it.
+ *
+ * Routes are kept as fixed-size records, in a pool that grows by chunks so
+ * that it never needs to be copied, and are found through an open-addressing
+ * hash index holding record ids. A route costs about 50 bytes, against more
+ * than 400 bytes and a handful of allocations when stored as a RouteEntry in
+ * an ordered map.
+ *
+ * Record ids stay valid until the route is erased. Not thread-safe.
+ */
+class RouteTable {
+    public:
+        RouteTable();
+        ~RouteTable();
+
+        uint32_t find(const RouteEntry& re) const;
+        uint32_t insert(const RouteEntry& re, uint32_t port, uint8_t flags);
+        void erase(uint32_t id);
+        void clear();
+
+        RouteRecord& get(uint32_t id);
+        const RouteRecord& get(uint32_t id) const;
+        bool matches(uint32_t id, const RouteEntry& re) const;
+        bool replaces(uint32_t id, const RouteEntry& re) const;
+        void entry(uint32_t id, RouteEntry& re) const;
+
+        /* Ids below end() may hold a route, see ROUTE_USED */
+        uint32_t end() const;
+        size_t size() const;
+        size_t memory() const;
+
+        bool isNextHop(const string& host) const;
+        void routesVia(const string& host, vector<uint32_t>& ids) const;
+        void routesOn(uint32_t port, vector<uint32_t>& ids) const;
+        bool usesInterface(InterfaceHandle handle) const;
+
+    private:
+        vector<RouteRecord*> chunks;
+        vector<uint32_t> freeIds;
+        uint32_t allocated;
+        uint32_t used;
+
+        /* Hash index: record ids, NO_ROUTE for free slots */
+        vector<uint32_t> slots;
+        size_t tombstones;
+
+        vector<NextHop> nexthops;
+        map<string, uint32_t> nexthopIds;
+        vector<uint32_t> freeNextHops;
+
+        /* First route of the list of each port */
+        map<uint32_t, uint32_t> portHeads;
+
+        /* Number of routes on each interface, by handle */
+        vector<uint32_t> interfaceRoutes;
+
+        static uint32_t hash(const uint8_t* prefix, uint8_t prefix_len,
+                             uint8_t flags);
+        static void key(const RouteEntry& re, uint8_t* prefix,
+                        uint8_t& prefix_len, uint8_t& flags);
+        size_t lookup(const uint8_t* prefix, uint8_t prefix_len,
+                      uint8_t flags) const;
+        void rehash(size_t size);
+        uint32_t allocate();
+        uint32_t addNextHop(const IPAddress& gateway);
+        void link(uint32_t id);
+        void unlink(uint32_t id);
+};
+
+#endif /* ROUTETABLE_HH */
@@ -69,6 +69,16 @@ class SyncQueue {
             result = queue_.front();
             queue_.pop_front();
         }
+
+        /* Wait until the queue is not empty, then move all of its elements
+         * to the end of 'result'. */
+        void wait_and_pop_all(std::list<T>& result) {
+            ScopedLock lock(mutex_);
+            while (queue_.empty()) {
+                condition_.wait(lock);
+            }
+            result.splice(result.end(), queue_);
+        }
 };
 
 #endif /* __SYNC_QUEUE_H__ */
@@ -0,0 +1,125 @@
+#ifndef UPDATESOURCE_HH
+#define UPDATESOURCE_HH
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <boost/thread.hpp>
+
+#include "libnetlink.hh"
+
+/* Milliseconds between checks for interruption while waiting for updates */
+#define UPDATE_POLL_TIMEOUT 500
+
+/* Size of the buffer netlink messages are received into */
+#define NETLINK_BUFFER_SIZE 16384
+
+/**
+ * Where FlowTable gets its neighbour or route updates from.
+ *
+ * FlowTable::run() reads each source on a thread of its own. run() hands
+ * every update to FlowTable as it is read, and must return once the thread
+ * is interrupted. Tests and benchmarks provide their own sources to drive
+ * FlowTable without a kernel or a routing daemon.
+ */
+class UpdateSource {
+    public:
+        virtual ~UpdateSource() {}
+        virtual void run() = 0;
+
+        /**
+         * Wait until there is something to read from 'fd', or the calling
+         * thread is interrupted, in which case boost::thread_interrupted is
+         * thrown. Returns 0 once 'fd' is readable, -1 on error.
+         */
+        static int waitForInput(int fd) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+
+            while (true) {
+                boost::this_thread::interruption_point();
+
+                int ready = poll(&pfd, 1, UPDATE_POLL_TIMEOUT);
+                if (ready > 0) {
+                    return 0;
+                }
+                if (ready < 0 && errno != EINTR) {
+                    return -1;
+                }
+            }
+        }
+};
+
+/**
+ * Netlink socket, each message read from it passed on to 'filter' along with
+ * 'arg'.
+ *
+ * Does the job of rtnl_listen(), which blocks in recvmsg() and cannot be
+ * interrupted.
+ */
+class NetlinkSource : public UpdateSource {
+    public:
+        NetlinkSource(struct rtnl_handle* rth, rtnl_filter_t filter,
+                      void* arg = NULL) {
+            this->rth = rth;
+            this->filter = filter;
+            this->arg = arg;
+        }
+
+        void run() {
+            char buf[NETLINK_BUFFER_SIZE];
+            struct sockaddr_nl nladdr;
+            struct iovec iov;
+            struct msghdr msg;
+
+            while (true) {
+                if (UpdateSource::waitForInput(this->rth->fd) < 0) {
+                    perror("Failed to wait for netlink messages");
+                    return;
+                }
+
+                iov.iov_base = buf;
+                iov.iov_len = sizeof(buf);
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_name = &nladdr;
+                msg.msg_namelen = sizeof(nladdr);
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+
+                ssize_t len = recvmsg(this->rth->fd, &msg, 0);
+                if (len < 0) {
+                    int error = errno;
+                    if (error == EINTR || error == EAGAIN) {
+                        continue;
+                    }
+                    perror("Failed to receive netlink messages");
+                    /* The kernel dropped messages, but the socket is still
+                     * usable. */
+                    if (error == ENOBUFS) {
+                        continue;
+                    }
+                    return;
+                }
+                if (len == 0) {
+                    fprintf(stderr, "EOF on netlink socket\n");
+                    return;
+                }
+
+                struct nlmsghdr* h = (struct nlmsghdr*) buf;
+                int left = len;
+                for (; NLMSG_OK(h, (unsigned) left); h = NLMSG_NEXT(h, left)) {
+                    this->filter(&nladdr, h, this->arg);
+                }
+            }
+        }
+
+    private:
+        struct rtnl_handle* rth;
+        rtnl_filter_t filter;
+        void* arg;
+};
+
+#endif /* UPDATESOURCE_HH */
@@ -1,11 +1,14 @@
 #ifndef __CONVERTER_H__
 #define __CONVERTER_H__
 
+#include <stdint.h>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <stdexcept>
 #include <typeinfo>  
+
+#include "types/TextConversion.h"
  
 class conversionError : public std::runtime_error
 {
@@ -40,4 +43,52 @@ inline T string_to(std::string const& str)
    return val;
 }
 
+/* Unsigned integers make up most of the fields of IPC messages, so they skip
+ * iostreams altogether. */
+template<>
+inline std::string to_string<uint64_t>(uint64_t const& val)
+{
+   char buf[UINT64_STRLEN];
+   return std::string(buf, format_uint64(val, buf));
+}
+
+template<>
+inline std::string to_string<uint32_t>(uint32_t const& val)
+{
+   char buf[UINT64_STRLEN];
+   return std::string(buf, format_uint64(val, buf));
+}
+
+template<>
+inline std::string to_string<uint16_t>(uint16_t const& val)
+{
+   char buf[UINT64_STRLEN];
+   return std::string(buf, format_uint64(val, buf));
+}
+
+template<>
+inline void convert<uint64_t>(std::string const& str, uint64_t& val)
+{
+   if (!parse_uint64(str.c_str(), val))
+     throw conversionError("Error converting string to type");
+}
+
+template<>
+inline void convert<uint32_t>(std::string const& str, uint32_t& val)
+{
+   uint64_t v;
+   if (!parse_uint64(str.c_str(), v) || v > 0xffffffffU)
+     throw conversionError("Error converting string to type");
+   val = v;
+}
+
+template<>
+inline void convert<uint16_t>(std::string const& str, uint16_t& val)
+{
+   uint64_t v;
+   if (!parse_uint64(str.c_str(), v) || v > 0xffffU)
+     throw conversionError("Error converting string to type");
+   val = v;
+}
+
 #endif /* __CONVERTER_H__ */
@@ -41,6 +41,9 @@ typedef enum dp_config {
     DC_ICMP,                /* ICMP protocol */
     DC_LDP_PASSIVE,         /* LDP protocol */
     DC_LDP_ACTIVE,          /* LDP protocol */
+    DC_ICMPV6,              /* ICMPv6 protocol */
+    DC_RESYNC,              /* Read the flow table instead of clearing it */
+    DC_SWEEP,               /* Remove flows not confirmed since DC_RESYNC */
     DC_ALL = 255            /* Send all traffic to the controller */
 
 } DATAPATH_CONFIG_OPERATION;
@@ -40,6 +40,8 @@ DC_ICMP = 8			# ICMP protocol
 DC_LDP_PASSIVE = 9		# LDP protocol
 DC_LDP_ACTIVE = 10		# LDP protocol
 DC_ICMPV6 = 11			# ICMPv6 protocol
+DC_RESYNC = 12			# Read the flow table instead of clearing it
+DC_SWEEP = 13			# Remove flows not confirmed since DC_RESYNC
 DC_ALL = 255			# Send all traffic to the controller
 
 RMT_ADD = 0			# Add flow to datapath
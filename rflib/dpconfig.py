@@ -0,0 +1,82 @@
+from rflib.defs import *
+from rflib.ipc.RFProtocol import RouteMod
+from rflib.types.Match import *
+from rflib.types.Action import *
+from rflib.types.Option import *
+
+# Operations applied to a switch when it comes up, in the order they are
+# applied. The flow table is always cleared first.
+DATAPATH_BRINGUP = (DC_CLEAR_FLOW_TABLE, DC_DROP_ALL, DC_OSPF, DC_BGP_PASSIVE,
+                    DC_BGP_ACTIVE, DC_RIPV2, DC_ARP, DC_ICMP, DC_ICMPV6,
+                    DC_LDP_PASSIVE, DC_LDP_ACTIVE)
+
+# Operations applied to a switch that comes up in resync mode. The flows
+# already installed are read instead of being cleared, and those that are not
+# confirmed are removed later with DC_SWEEP.
+RESYNC_BRINGUP = (DC_RESYNC,) + DATAPATH_BRINGUP[1:]
+
+# Order in which the operations of a DatapathConfig message are applied
+CONFIG_ORDER = (DC_RESYNC,) + DATAPATH_BRINGUP + (DC_VM_INFO, DC_SWEEP)
+
+def operations_to_mask(operations):
+    """Pack a list of DC_* operations into a DatapathConfig bitmask."""
+    mask = 0
+    for operation_id in operations:
+        mask |= 1 << operation_id
+    return mask
+
+def mask_to_operations(mask):
+    """Unpack a DatapathConfig bitmask into DC_* operations, in the order
+    they must be applied."""
+    return [op for op in CONFIG_ORDER if mask & (1 << op)]
+
+def config_routemod(ct_id, dp_id, operation_id):
+    """Build the RouteMod that applies a DC_* operation to a datapath."""
+    rm = RouteMod(RMT_ADD, dp_id)
+
+    if operation_id == DC_CLEAR_FLOW_TABLE:
+        rm.set_mod(RMT_DELETE)
+        rm.add_option(Option.PRIORITY(PRIORITY_LOWEST))
+    elif operation_id == DC_DROP_ALL:
+        rm.add_option(Option.PRIORITY(PRIORITY_LOWEST + PRIORITY_BAND))
+        # No action specifies discard
+        pass
+    else:
+        rm.add_option(Option.PRIORITY(PRIORITY_HIGH))
+        if operation_id == DC_RIPV2:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_UDP))
+            rm.add_match(Match.IPV4(IPADDR_RIPv2, IPV4_MASK_EXACT))
+        elif operation_id == DC_OSPF:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_OSPF))
+        elif operation_id == DC_ARP:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_ARP))
+        elif operation_id == DC_ICMP:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_ICMP))
+        elif operation_id == DC_ICMPV6:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IPV6))
+            rm.add_match(Match.NW_PROTO(IPPROTO_ICMPV6))
+        elif operation_id == DC_BGP_PASSIVE:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
+            rm.add_match(Match.TP_DST(TPORT_BGP))
+        elif operation_id == DC_BGP_ACTIVE:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
+            rm.add_match(Match.TP_SRC(TPORT_BGP))
+        elif operation_id == DC_LDP_PASSIVE:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
+            rm.add_match(Match.TP_DST(TPORT_LDP))
+        elif operation_id == DC_LDP_ACTIVE:
+            rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
+            rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
+            rm.add_match(Match.TP_SRC(TPORT_LDP))
+        elif operation_id == DC_VM_INFO:
+            rm.add_match(Match.ETHERTYPE(RF_ETH_PROTO))
+        rm.add_action(Action.CONTROLLER())
+
+    rm.add_option(Option.CT_ID(ct_id))
+    return rm
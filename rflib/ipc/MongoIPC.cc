@@ -1,4 +1,5 @@
 #include "MongoIPC.h"
+#include "converter.h"
 #include <boost/thread.hpp>
 
 MongoIPCMessageService::MongoIPCMessageService(const string &address, const string db, const string id) {
@@ -88,3 +89,15 @@ IPCMessage* takeFromEnvelope(mongo::BSONObj envelope, IPCMessageFactory *factory
    msg->from_BSON(envelope[CONTENT_FIELD].Obj().objdata());
    return msg;
 }
+
+/**
+ * Read an integer field. Fields written as decimal strings, as was done before
+ * integers were stored natively, are also accepted so that old and new
+ * components can run side by side.
+ */
+uint64_t from_BSON_int(const mongo::BSONElement &element) {
+    if (element.type() == mongo::String) {
+        return string_to<uint64_t>(element.String());
+    }
+    return (uint64_t) element.numberLong();
+}
@@ -19,6 +19,10 @@
 mongo::BSONObj putInEnvelope(const string &from, const string &to, IPCMessage &msg);
 IPCMessage* takeFromEnvelope(mongo::BSONObj envelope, IPCMessageFactory *factory);
 
+/* Integer fields are stored as native BSON integers. Unsigned values are cast
+ * to the signed type of the same width, so that 64-bit ids fit. */
+uint64_t from_BSON_int(const mongo::BSONElement &element);
+
 /** An IPC message service that uses MongoDB as its backend. */
 class MongoIPCMessageService : public IPCMessageService {
     public:
@@ -31,6 +31,21 @@ def take_from_envelope(envelope, factory):
     msg.from_dict(envelope[CONTENT_FIELD]);
     return msg;
 
+def to_bson_int(value, bits):
+    """Store an unsigned integer field as the native BSON integer of the same
+    width. Values that do not fit the signed type wrap around, so that 64-bit
+    ids can be stored."""
+    value = int(value)
+    if value >= 1 << (bits - 1):
+        value -= 1 << bits
+    return value
+
+def from_bson_int(value, bits):
+    """Read an unsigned integer field stored by to_bson_int(). Fields written
+    as decimal strings, as was done before integers were stored natively, are
+    also accepted so that old and new components can run side by side."""
+    return int(value) & ((1 << bits) - 1)
+
 def format_address(address):
     try:
         tmp = address.split(":")
@@ -76,6 +91,16 @@ class MongoIPCMessageService(IPC.IPCMessageService):
         collection.insert(put_in_envelope(self.get_id(), to, msg))
         return True
 
+    def send_many(self, channel_id, to, msgs):
+        """Send several messages to the same recipient in a single insert."""
+        if not msgs:
+            return True
+        self._create_channel(self._producer_connection, channel_id)
+        collection = self._producer_connection[self._db][channel_id]
+        collection.insert([put_in_envelope(self.get_id(), to, msg)
+                           for msg in msgs])
+        return True
+
     def _listen_worker(self, channel_id, factory, processor):
         connection = mongo.Connection(*self.address)
         self._create_channel(connection, channel_id)
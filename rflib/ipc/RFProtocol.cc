@@ -1,17 +1,20 @@
 #include "RFProtocol.h"
 
 #include <mongo/client/dbclient.h>
+#include "MongoIPC.h"
 
 PortRegister::PortRegister() {
     set_vm_id(0);
     set_vm_port(0);
     set_hwaddress(MACAddress());
+    set_vrf(0);
 }
 
-PortRegister::PortRegister(uint64_t vm_id, uint32_t vm_port, MACAddress hwaddress) {
+PortRegister::PortRegister(uint64_t vm_id, uint32_t vm_port, MACAddress hwaddress, uint32_t vrf) {
     set_vm_id(vm_id);
     set_vm_port(vm_port);
     set_hwaddress(hwaddress);
+    set_vrf(vrf);
 }
 
 int PortRegister::get_type() {
@@ -42,18 +45,28 @@ void PortRegister::set_hwaddress(MACAddress hwaddress) {
     this->hwaddress = hwaddress;
 }
 
+uint32_t PortRegister::get_vrf() {
+    return this->vrf;
+}
+
+void PortRegister::set_vrf(uint32_t vrf) {
+    this->vrf = vrf;
+}
+
 void PortRegister::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_vm_id(string_to<uint64_t>(obj["vm_id"].String()));
-    set_vm_port(string_to<uint32_t>(obj["vm_port"].String()));
+    set_vm_id(from_BSON_int(obj["vm_id"]));
+    set_vm_port((uint32_t) from_BSON_int(obj["vm_port"]));
     set_hwaddress(MACAddress(obj["hwaddress"].String()));
+    set_vrf((uint32_t) from_BSON_int(obj["vrf"]));
 }
 
 const char* PortRegister::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("vm_id", to_string<uint64_t>(get_vm_id()));
-    _b.append("vm_port", to_string<uint32_t>(get_vm_port()));
+    _b.append("vm_id", (long long) get_vm_id());
+    _b.append("vm_port", (int) get_vm_port());
     _b.append("hwaddress", get_hwaddress().toString());
+    _b.append("vrf", (int) get_vrf());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -66,6 +79,7 @@ string PortRegister::str() {
     ss << "  vm_id: " << to_string<uint64_t>(get_vm_id()) << endl;
     ss << "  vm_port: " << to_string<uint32_t>(get_vm_port()) << endl;
     ss << "  hwaddress: " << get_hwaddress().toString() << endl;
+    ss << "  vrf: " << to_string<uint32_t>(get_vrf()) << endl;
     return ss.str();
 }
 
@@ -111,16 +125,16 @@ void PortConfig::set_operation_id(uint32_t operation_id) {
 
 void PortConfig::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_vm_id(string_to<uint64_t>(obj["vm_id"].String()));
-    set_vm_port(string_to<uint32_t>(obj["vm_port"].String()));
-    set_operation_id(string_to<uint32_t>(obj["operation_id"].String()));
+    set_vm_id(from_BSON_int(obj["vm_id"]));
+    set_vm_port((uint32_t) from_BSON_int(obj["vm_port"]));
+    set_operation_id((uint32_t) from_BSON_int(obj["operation_id"]));
 }
 
 const char* PortConfig::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("vm_id", to_string<uint64_t>(get_vm_id()));
-    _b.append("vm_port", to_string<uint32_t>(get_vm_port()));
-    _b.append("operation_id", to_string<uint32_t>(get_operation_id()));
+    _b.append("vm_id", (long long) get_vm_id());
+    _b.append("vm_port", (int) get_vm_port());
+    _b.append("operation_id", (int) get_operation_id());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -178,16 +192,16 @@ void DatapathPortRegister::set_dp_port(uint32_t dp_port) {
 
 void DatapathPortRegister::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_ct_id(string_to<uint64_t>(obj["ct_id"].String()));
-    set_dp_id(string_to<uint64_t>(obj["dp_id"].String()));
-    set_dp_port(string_to<uint32_t>(obj["dp_port"].String()));
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
+    set_dp_port((uint32_t) from_BSON_int(obj["dp_port"]));
 }
 
 const char* DatapathPortRegister::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("ct_id", to_string<uint64_t>(get_ct_id()));
-    _b.append("dp_id", to_string<uint64_t>(get_dp_id()));
-    _b.append("dp_port", to_string<uint32_t>(get_dp_port()));
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
+    _b.append("dp_port", (int) get_dp_port());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -235,14 +249,14 @@ void DatapathDown::set_dp_id(uint64_t dp_id) {
 
 void DatapathDown::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_ct_id(string_to<uint64_t>(obj["ct_id"].String()));
-    set_dp_id(string_to<uint64_t>(obj["dp_id"].String()));
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
 }
 
 const char* DatapathDown::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("ct_id", to_string<uint64_t>(get_ct_id()));
-    _b.append("dp_id", to_string<uint64_t>(get_dp_id()));
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -309,18 +323,18 @@ void VirtualPlaneMap::set_vs_port(uint32_t vs_port) {
 
 void VirtualPlaneMap::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_vm_id(string_to<uint64_t>(obj["vm_id"].String()));
-    set_vm_port(string_to<uint32_t>(obj["vm_port"].String()));
-    set_vs_id(string_to<uint64_t>(obj["vs_id"].String()));
-    set_vs_port(string_to<uint32_t>(obj["vs_port"].String()));
+    set_vm_id(from_BSON_int(obj["vm_id"]));
+    set_vm_port((uint32_t) from_BSON_int(obj["vm_port"]));
+    set_vs_id(from_BSON_int(obj["vs_id"]));
+    set_vs_port((uint32_t) from_BSON_int(obj["vs_port"]));
 }
 
 const char* VirtualPlaneMap::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("vm_id", to_string<uint64_t>(get_vm_id()));
-    _b.append("vm_port", to_string<uint32_t>(get_vm_port()));
-    _b.append("vs_id", to_string<uint64_t>(get_vs_id()));
-    _b.append("vs_port", to_string<uint32_t>(get_vs_port()));
+    _b.append("vm_id", (long long) get_vm_id());
+    _b.append("vm_port", (int) get_vm_port());
+    _b.append("vs_id", (long long) get_vs_id());
+    _b.append("vs_port", (int) get_vs_port());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -399,20 +413,20 @@ void DataPlaneMap::set_vs_port(uint32_t vs_port) {
 
 void DataPlaneMap::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_ct_id(string_to<uint64_t>(obj["ct_id"].String()));
-    set_dp_id(string_to<uint64_t>(obj["dp_id"].String()));
-    set_dp_port(string_to<uint32_t>(obj["dp_port"].String()));
-    set_vs_id(string_to<uint64_t>(obj["vs_id"].String()));
-    set_vs_port(string_to<uint32_t>(obj["vs_port"].String()));
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
+    set_dp_port((uint32_t) from_BSON_int(obj["dp_port"]));
+    set_vs_id(from_BSON_int(obj["vs_id"]));
+    set_vs_port((uint32_t) from_BSON_int(obj["vs_port"]));
 }
 
 const char* DataPlaneMap::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("ct_id", to_string<uint64_t>(get_ct_id()));
-    _b.append("dp_id", to_string<uint64_t>(get_dp_id()));
-    _b.append("dp_port", to_string<uint32_t>(get_dp_port()));
-    _b.append("vs_id", to_string<uint64_t>(get_vs_id()));
-    _b.append("vs_port", to_string<uint32_t>(get_vs_port()));
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
+    _b.append("dp_port", (int) get_dp_port());
+    _b.append("vs_id", (long long) get_vs_id());
+    _b.append("vs_port", (int) get_vs_port());
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -504,8 +518,8 @@ void RouteMod::add_option(const Option& option) {
 
 void RouteMod::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
-    set_mod(string_to<uint8_t>(obj["mod"].String()));
-    set_id(string_to<uint64_t>(obj["id"].String()));
+    set_mod((uint8_t) from_BSON_int(obj["mod"]));
+    set_id(from_BSON_int(obj["id"]));
     set_matches(MatchList::to_vector(obj["matches"].Array()));
     set_actions(ActionList::to_vector(obj["actions"].Array()));
     set_options(OptionList::to_vector(obj["options"].Array()));
@@ -513,8 +527,8 @@ void RouteMod::from_BSON(const char* data) {
 
 const char* RouteMod::to_BSON() {
     mongo::BSONObjBuilder _b;
-    _b.append("mod", to_string<uint16_t>(get_mod()));
-    _b.append("id", to_string<uint64_t>(get_id()));
+    _b.append("mod", (int) get_mod());
+    _b.append("id", (long long) get_id());
     _b.appendArray("matches", MatchList::to_BSON(get_matches()));
     _b.appendArray("actions", ActionList::to_BSON(get_actions()));
     _b.appendArray("options", OptionList::to_BSON(get_options()));
@@ -534,3 +548,230 @@ string RouteMod::str() {
     ss << "  options: " << OptionList::to_BSON(get_options()) << endl;
     return ss.str();
 }
+
+DatapathConfig::DatapathConfig() {
+    set_ct_id(0);
+    set_dp_id(0);
+    set_xid(0);
+    set_operations(0);
+}
+
+DatapathConfig::DatapathConfig(uint64_t ct_id, uint64_t dp_id, uint32_t xid, uint32_t operations) {
+    set_ct_id(ct_id);
+    set_dp_id(dp_id);
+    set_xid(xid);
+    set_operations(operations);
+}
+
+int DatapathConfig::get_type() {
+    return DATAPATH_CONFIG;
+}
+
+uint64_t DatapathConfig::get_ct_id() {
+    return this->ct_id;
+}
+
+void DatapathConfig::set_ct_id(uint64_t ct_id) {
+    this->ct_id = ct_id;
+}
+
+uint64_t DatapathConfig::get_dp_id() {
+    return this->dp_id;
+}
+
+void DatapathConfig::set_dp_id(uint64_t dp_id) {
+    this->dp_id = dp_id;
+}
+
+uint32_t DatapathConfig::get_xid() {
+    return this->xid;
+}
+
+void DatapathConfig::set_xid(uint32_t xid) {
+    this->xid = xid;
+}
+
+uint32_t DatapathConfig::get_operations() {
+    return this->operations;
+}
+
+void DatapathConfig::set_operations(uint32_t operations) {
+    this->operations = operations;
+}
+
+void DatapathConfig::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
+    set_xid((uint32_t) from_BSON_int(obj["xid"]));
+    set_operations((uint32_t) from_BSON_int(obj["operations"]));
+}
+
+const char* DatapathConfig::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
+    _b.append("xid", (int) get_xid());
+    _b.append("operations", (int) get_operations());
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string DatapathConfig::str() {
+    stringstream ss;
+    ss << "DatapathConfig" << endl;
+    ss << "  ct_id: " << to_string<uint64_t>(get_ct_id()) << endl;
+    ss << "  dp_id: " << to_string<uint64_t>(get_dp_id()) << endl;
+    ss << "  xid: " << to_string<uint32_t>(get_xid()) << endl;
+    ss << "  operations: " << to_string<uint32_t>(get_operations()) << endl;
+    return ss.str();
+}
+
+DatapathConfigAck::DatapathConfigAck() {
+    set_ct_id(0);
+    set_dp_id(0);
+    set_xid(0);
+}
+
+DatapathConfigAck::DatapathConfigAck(uint64_t ct_id, uint64_t dp_id, uint32_t xid) {
+    set_ct_id(ct_id);
+    set_dp_id(dp_id);
+    set_xid(xid);
+}
+
+int DatapathConfigAck::get_type() {
+    return DATAPATH_CONFIG_ACK;
+}
+
+uint64_t DatapathConfigAck::get_ct_id() {
+    return this->ct_id;
+}
+
+void DatapathConfigAck::set_ct_id(uint64_t ct_id) {
+    this->ct_id = ct_id;
+}
+
+uint64_t DatapathConfigAck::get_dp_id() {
+    return this->dp_id;
+}
+
+void DatapathConfigAck::set_dp_id(uint64_t dp_id) {
+    this->dp_id = dp_id;
+}
+
+uint32_t DatapathConfigAck::get_xid() {
+    return this->xid;
+}
+
+void DatapathConfigAck::set_xid(uint32_t xid) {
+    this->xid = xid;
+}
+
+void DatapathConfigAck::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
+    set_xid((uint32_t) from_BSON_int(obj["xid"]));
+}
+
+const char* DatapathConfigAck::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
+    _b.append("xid", (int) get_xid());
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string DatapathConfigAck::str() {
+    stringstream ss;
+    ss << "DatapathConfigAck" << endl;
+    ss << "  ct_id: " << to_string<uint64_t>(get_ct_id()) << endl;
+    ss << "  dp_id: " << to_string<uint64_t>(get_dp_id()) << endl;
+    ss << "  xid: " << to_string<uint32_t>(get_xid()) << endl;
+    return ss.str();
+}
+
+FlowBatchAck::FlowBatchAck() {
+    set_ct_id(0);
+    set_dp_id(0);
+    set_flows(0);
+    set_errors(0);
+}
+
+FlowBatchAck::FlowBatchAck(uint64_t ct_id, uint64_t dp_id, uint32_t flows, uint32_t errors) {
+    set_ct_id(ct_id);
+    set_dp_id(dp_id);
+    set_flows(flows);
+    set_errors(errors);
+}
+
+int FlowBatchAck::get_type() {
+    return FLOW_BATCH_ACK;
+}
+
+uint64_t FlowBatchAck::get_ct_id() {
+    return this->ct_id;
+}
+
+void FlowBatchAck::set_ct_id(uint64_t ct_id) {
+    this->ct_id = ct_id;
+}
+
+uint64_t FlowBatchAck::get_dp_id() {
+    return this->dp_id;
+}
+
+void FlowBatchAck::set_dp_id(uint64_t dp_id) {
+    this->dp_id = dp_id;
+}
+
+uint32_t FlowBatchAck::get_flows() {
+    return this->flows;
+}
+
+void FlowBatchAck::set_flows(uint32_t flows) {
+    this->flows = flows;
+}
+
+uint32_t FlowBatchAck::get_errors() {
+    return this->errors;
+}
+
+void FlowBatchAck::set_errors(uint32_t errors) {
+    this->errors = errors;
+}
+
+void FlowBatchAck::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_ct_id(from_BSON_int(obj["ct_id"]));
+    set_dp_id(from_BSON_int(obj["dp_id"]));
+    set_flows((uint32_t) from_BSON_int(obj["flows"]));
+    set_errors((uint32_t) from_BSON_int(obj["errors"]));
+}
+
+const char* FlowBatchAck::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("ct_id", (long long) get_ct_id());
+    _b.append("dp_id", (long long) get_dp_id());
+    _b.append("flows", (int) get_flows());
+    _b.append("errors", (int) get_errors());
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string FlowBatchAck::str() {
+    stringstream ss;
+    ss << "FlowBatchAck" << endl;
+    ss << "  ct_id: " << to_string<uint64_t>(get_ct_id()) << endl;
+    ss << "  dp_id: " << to_string<uint64_t>(get_dp_id()) << endl;
+    ss << "  flows: " << to_string<uint32_t>(get_flows()) << endl;
+    ss << "  errors: " << to_string<uint32_t>(get_errors()) << endl;
+    return ss.str();
+}
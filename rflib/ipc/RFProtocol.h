@@ -18,13 +18,16 @@ enum {
 	DATAPATH_DOWN,
 	VIRTUAL_PLANE_MAP,
 	DATA_PLANE_MAP,
-	ROUTE_MOD
+	ROUTE_MOD,
+	DATAPATH_CONFIG,
+	DATAPATH_CONFIG_ACK,
+	FLOW_BATCH_ACK
 };
 
 class PortRegister : public IPCMessage {
     public:
         PortRegister();
-        PortRegister(uint64_t vm_id, uint32_t vm_port, MACAddress hwaddress);
+        PortRegister(uint64_t vm_id, uint32_t vm_port, MACAddress hwaddress, uint32_t vrf);
 
         uint64_t get_vm_id();
         void set_vm_id(uint64_t vm_id);
@@ -35,6 +38,9 @@ class PortRegister : public IPCMessage {
         MACAddress get_hwaddress();
         void set_hwaddress(MACAddress hwaddress);
 
+        uint32_t get_vrf();
+        void set_vrf(uint32_t vrf);
+
         virtual int get_type();
         virtual void from_BSON(const char* data);
         virtual const char* to_BSON();
@@ -44,6 +50,7 @@ class PortRegister : public IPCMessage {
         uint64_t vm_id;
         uint32_t vm_port;
         MACAddress hwaddress;
+        uint32_t vrf;
 };
 
 class PortConfig : public IPCMessage {
@@ -215,4 +222,87 @@ class RouteMod : public IPCMessage {
         std::vector<Option> options;
 };
 
+class DatapathConfig : public IPCMessage {
+    public:
+        DatapathConfig();
+        DatapathConfig(uint64_t ct_id, uint64_t dp_id, uint32_t xid, uint32_t operations);
+
+        uint64_t get_ct_id();
+        void set_ct_id(uint64_t ct_id);
+
+        uint64_t get_dp_id();
+        void set_dp_id(uint64_t dp_id);
+
+        uint32_t get_xid();
+        void set_xid(uint32_t xid);
+
+        uint32_t get_operations();
+        void set_operations(uint32_t operations);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint64_t ct_id;
+        uint64_t dp_id;
+        uint32_t xid;
+        uint32_t operations;
+};
+
+class DatapathConfigAck : public IPCMessage {
+    public:
+        DatapathConfigAck();
+        DatapathConfigAck(uint64_t ct_id, uint64_t dp_id, uint32_t xid);
+
+        uint64_t get_ct_id();
+        void set_ct_id(uint64_t ct_id);
+
+        uint64_t get_dp_id();
+        void set_dp_id(uint64_t dp_id);
+
+        uint32_t get_xid();
+        void set_xid(uint32_t xid);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint64_t ct_id;
+        uint64_t dp_id;
+        uint32_t xid;
+};
+
+class FlowBatchAck : public IPCMessage {
+    public:
+        FlowBatchAck();
+        FlowBatchAck(uint64_t ct_id, uint64_t dp_id, uint32_t flows, uint32_t errors);
+
+        uint64_t get_ct_id();
+        void set_ct_id(uint64_t ct_id);
+
+        uint64_t get_dp_id();
+        void set_dp_id(uint64_t dp_id);
+
+        uint32_t get_flows();
+        void set_flows(uint32_t flows);
+
+        uint32_t get_errors();
+        void set_errors(uint32_t errors);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint64_t ct_id;
+        uint64_t dp_id;
+        uint32_t flows;
+        uint32_t errors;
+};
+
 #endif /* __RFPROTOCOL_H__ */
\ No newline at end of file
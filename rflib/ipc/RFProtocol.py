@@ -4,7 +4,7 @@ import pymongo as mongo
 from rflib.types.Match import Match
 from rflib.types.Action import Action
 from rflib.types.Option import Option
-from MongoIPC import MongoIPCMessage
+from MongoIPC import MongoIPCMessage, to_bson_int, from_bson_int
 
 format_id = lambda dp_id: hex(dp_id).rstrip('L')
 
@@ -15,12 +15,16 @@ DATAPATH_DOWN = 3
 VIRTUAL_PLANE_MAP = 4
 DATA_PLANE_MAP = 5
 ROUTE_MOD = 6
+DATAPATH_CONFIG = 7
+DATAPATH_CONFIG_ACK = 8
+FLOW_BATCH_ACK = 9
 
 class PortRegister(MongoIPCMessage):
-    def __init__(self, vm_id=None, vm_port=None, hwaddress=None):
+    def __init__(self, vm_id=None, vm_port=None, hwaddress=None, vrf=None):
         self.set_vm_id(vm_id)
         self.set_vm_port(vm_port)
         self.set_hwaddress(hwaddress)
+        self.set_vrf(vrf)
 
     def get_type(self):
         return PORT_REGISTER
@@ -31,7 +35,7 @@ class PortRegister(MongoIPCMessage):
     def set_vm_id(self, vm_id):
         vm_id = 0 if vm_id is None else vm_id
         try:
-            self.vm_id = int(vm_id)
+            self.vm_id = from_bson_int(vm_id, 64)
         except:
             self.vm_id = 0
 
@@ -41,7 +45,7 @@ class PortRegister(MongoIPCMessage):
     def set_vm_port(self, vm_port):
         vm_port = 0 if vm_port is None else vm_port
         try:
-            self.vm_port = int(vm_port)
+            self.vm_port = from_bson_int(vm_port, 32)
         except:
             self.vm_port = 0
 
@@ -55,16 +59,28 @@ class PortRegister(MongoIPCMessage):
         except:
             self.hwaddress = ""
 
+    def get_vrf(self):
+        return self.vrf
+
+    def set_vrf(self, vrf):
+        vrf = 0 if vrf is None else vrf
+        try:
+            self.vrf = from_bson_int(vrf, 32)
+        except:
+            self.vrf = 0
+
     def from_dict(self, data):
         self.set_vm_id(data["vm_id"])
         self.set_vm_port(data["vm_port"])
         self.set_hwaddress(data["hwaddress"])
+        self.set_vrf(data["vrf"])
 
     def to_dict(self):
         data = {}
-        data["vm_id"] = str(self.get_vm_id())
-        data["vm_port"] = str(self.get_vm_port())
+        data["vm_id"] = to_bson_int(self.get_vm_id(), 64)
+        data["vm_port"] = to_bson_int(self.get_vm_port(), 32)
         data["hwaddress"] = str(self.get_hwaddress())
+        data["vrf"] = to_bson_int(self.get_vrf(), 32)
         return data
 
     def from_bson(self, data):
@@ -79,6 +95,7 @@ class PortRegister(MongoIPCMessage):
         s += "  vm_id: " + format_id(self.get_vm_id()) + "\n"
         s += "  vm_port: " + str(self.get_vm_port()) + "\n"
         s += "  hwaddress: " + str(self.get_hwaddress()) + "\n"
+        s += "  vrf: " + str(self.get_vrf()) + "\n"
         return s
 
 class PortConfig(MongoIPCMessage):
@@ -96,7 +113,7 @@ class PortConfig(MongoIPCMessage):
     def set_vm_id(self, vm_id):
         vm_id = 0 if vm_id is None else vm_id
         try:
-            self.vm_id = int(vm_id)
+            self.vm_id = from_bson_int(vm_id, 64)
         except:
             self.vm_id = 0
 
@@ -106,7 +123,7 @@ class PortConfig(MongoIPCMessage):
     def set_vm_port(self, vm_port):
         vm_port = 0 if vm_port is None else vm_port
         try:
-            self.vm_port = int(vm_port)
+            self.vm_port = from_bson_int(vm_port, 32)
         except:
             self.vm_port = 0
 
@@ -116,7 +133,7 @@ class PortConfig(MongoIPCMessage):
     def set_operation_id(self, operation_id):
         operation_id = 0 if operation_id is None else operation_id
         try:
-            self.operation_id = int(operation_id)
+            self.operation_id = from_bson_int(operation_id, 32)
         except:
             self.operation_id = 0
 
@@ -127,9 +144,9 @@ class PortConfig(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["vm_id"] = str(self.get_vm_id())
-        data["vm_port"] = str(self.get_vm_port())
-        data["operation_id"] = str(self.get_operation_id())
+        data["vm_id"] = to_bson_int(self.get_vm_id(), 64)
+        data["vm_port"] = to_bson_int(self.get_vm_port(), 32)
+        data["operation_id"] = to_bson_int(self.get_operation_id(), 32)
         return data
 
     def from_bson(self, data):
@@ -161,7 +178,7 @@ class DatapathPortRegister(MongoIPCMessage):
     def set_ct_id(self, ct_id):
         ct_id = 0 if ct_id is None else ct_id
         try:
-            self.ct_id = int(ct_id)
+            self.ct_id = from_bson_int(ct_id, 64)
         except:
             self.ct_id = 0
 
@@ -171,7 +188,7 @@ class DatapathPortRegister(MongoIPCMessage):
     def set_dp_id(self, dp_id):
         dp_id = 0 if dp_id is None else dp_id
         try:
-            self.dp_id = int(dp_id)
+            self.dp_id = from_bson_int(dp_id, 64)
         except:
             self.dp_id = 0
 
@@ -181,7 +198,7 @@ class DatapathPortRegister(MongoIPCMessage):
     def set_dp_port(self, dp_port):
         dp_port = 0 if dp_port is None else dp_port
         try:
-            self.dp_port = int(dp_port)
+            self.dp_port = from_bson_int(dp_port, 32)
         except:
             self.dp_port = 0
 
@@ -192,9 +209,9 @@ class DatapathPortRegister(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["ct_id"] = str(self.get_ct_id())
-        data["dp_id"] = str(self.get_dp_id())
-        data["dp_port"] = str(self.get_dp_port())
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
+        data["dp_port"] = to_bson_int(self.get_dp_port(), 32)
         return data
 
     def from_bson(self, data):
@@ -225,7 +242,7 @@ class DatapathDown(MongoIPCMessage):
     def set_ct_id(self, ct_id):
         ct_id = 0 if ct_id is None else ct_id
         try:
-            self.ct_id = int(ct_id)
+            self.ct_id = from_bson_int(ct_id, 64)
         except:
             self.ct_id = 0
 
@@ -235,7 +252,7 @@ class DatapathDown(MongoIPCMessage):
     def set_dp_id(self, dp_id):
         dp_id = 0 if dp_id is None else dp_id
         try:
-            self.dp_id = int(dp_id)
+            self.dp_id = from_bson_int(dp_id, 64)
         except:
             self.dp_id = 0
 
@@ -245,8 +262,8 @@ class DatapathDown(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["ct_id"] = str(self.get_ct_id())
-        data["dp_id"] = str(self.get_dp_id())
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
         return data
 
     def from_bson(self, data):
@@ -278,7 +295,7 @@ class VirtualPlaneMap(MongoIPCMessage):
     def set_vm_id(self, vm_id):
         vm_id = 0 if vm_id is None else vm_id
         try:
-            self.vm_id = int(vm_id)
+            self.vm_id = from_bson_int(vm_id, 64)
         except:
             self.vm_id = 0
 
@@ -288,7 +305,7 @@ class VirtualPlaneMap(MongoIPCMessage):
     def set_vm_port(self, vm_port):
         vm_port = 0 if vm_port is None else vm_port
         try:
-            self.vm_port = int(vm_port)
+            self.vm_port = from_bson_int(vm_port, 32)
         except:
             self.vm_port = 0
 
@@ -298,7 +315,7 @@ class VirtualPlaneMap(MongoIPCMessage):
     def set_vs_id(self, vs_id):
         vs_id = 0 if vs_id is None else vs_id
         try:
-            self.vs_id = int(vs_id)
+            self.vs_id = from_bson_int(vs_id, 64)
         except:
             self.vs_id = 0
 
@@ -308,7 +325,7 @@ class VirtualPlaneMap(MongoIPCMessage):
     def set_vs_port(self, vs_port):
         vs_port = 0 if vs_port is None else vs_port
         try:
-            self.vs_port = int(vs_port)
+            self.vs_port = from_bson_int(vs_port, 32)
         except:
             self.vs_port = 0
 
@@ -320,10 +337,10 @@ class VirtualPlaneMap(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["vm_id"] = str(self.get_vm_id())
-        data["vm_port"] = str(self.get_vm_port())
-        data["vs_id"] = str(self.get_vs_id())
-        data["vs_port"] = str(self.get_vs_port())
+        data["vm_id"] = to_bson_int(self.get_vm_id(), 64)
+        data["vm_port"] = to_bson_int(self.get_vm_port(), 32)
+        data["vs_id"] = to_bson_int(self.get_vs_id(), 64)
+        data["vs_port"] = to_bson_int(self.get_vs_port(), 32)
         return data
 
     def from_bson(self, data):
@@ -358,7 +375,7 @@ class DataPlaneMap(MongoIPCMessage):
     def set_ct_id(self, ct_id):
         ct_id = 0 if ct_id is None else ct_id
         try:
-            self.ct_id = int(ct_id)
+            self.ct_id = from_bson_int(ct_id, 64)
         except:
             self.ct_id = 0
 
@@ -368,7 +385,7 @@ class DataPlaneMap(MongoIPCMessage):
     def set_dp_id(self, dp_id):
         dp_id = 0 if dp_id is None else dp_id
         try:
-            self.dp_id = int(dp_id)
+            self.dp_id = from_bson_int(dp_id, 64)
         except:
             self.dp_id = 0
 
@@ -378,7 +395,7 @@ class DataPlaneMap(MongoIPCMessage):
     def set_dp_port(self, dp_port):
         dp_port = 0 if dp_port is None else dp_port
         try:
-            self.dp_port = int(dp_port)
+            self.dp_port = from_bson_int(dp_port, 32)
         except:
             self.dp_port = 0
 
@@ -388,7 +405,7 @@ class DataPlaneMap(MongoIPCMessage):
     def set_vs_id(self, vs_id):
         vs_id = 0 if vs_id is None else vs_id
         try:
-            self.vs_id = int(vs_id)
+            self.vs_id = from_bson_int(vs_id, 64)
         except:
             self.vs_id = 0
 
@@ -398,7 +415,7 @@ class DataPlaneMap(MongoIPCMessage):
     def set_vs_port(self, vs_port):
         vs_port = 0 if vs_port is None else vs_port
         try:
-            self.vs_port = int(vs_port)
+            self.vs_port = from_bson_int(vs_port, 32)
         except:
             self.vs_port = 0
 
@@ -411,11 +428,11 @@ class DataPlaneMap(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["ct_id"] = str(self.get_ct_id())
-        data["dp_id"] = str(self.get_dp_id())
-        data["dp_port"] = str(self.get_dp_port())
-        data["vs_id"] = str(self.get_vs_id())
-        data["vs_port"] = str(self.get_vs_port())
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
+        data["dp_port"] = to_bson_int(self.get_dp_port(), 32)
+        data["vs_id"] = to_bson_int(self.get_vs_id(), 64)
+        data["vs_port"] = to_bson_int(self.get_vs_port(), 32)
         return data
 
     def from_bson(self, data):
@@ -451,7 +468,7 @@ class RouteMod(MongoIPCMessage):
     def set_mod(self, mod):
         mod = 0 if mod is None else mod
         try:
-            self.mod = int(mod)
+            self.mod = from_bson_int(mod, 32)
         except:
             self.mod = 0
 
@@ -461,7 +478,7 @@ class RouteMod(MongoIPCMessage):
     def set_id(self, id):
         id = 0 if id is None else id
         try:
-            self.id = int(id)
+            self.id = from_bson_int(id, 64)
         except:
             self.id = 0
 
@@ -513,8 +530,8 @@ class RouteMod(MongoIPCMessage):
 
     def to_dict(self):
         data = {}
-        data["mod"] = str(self.get_mod())
-        data["id"] = str(self.get_id())
+        data["mod"] = to_bson_int(self.get_mod(), 32)
+        data["id"] = to_bson_int(self.get_id(), 64)
         data["matches"] = self.get_matches()
         data["actions"] = self.get_actions()
         data["options"] = self.get_options()
@@ -541,3 +558,226 @@ class RouteMod(MongoIPCMessage):
         for option in self.get_options():
             s += "    " + str(Option.from_dict(option)) + "\n"
         return s
+
+class DatapathConfig(MongoIPCMessage):
+    def __init__(self, ct_id=None, dp_id=None, xid=None, operations=None):
+        self.set_ct_id(ct_id)
+        self.set_dp_id(dp_id)
+        self.set_xid(xid)
+        self.set_operations(operations)
+
+    def get_type(self):
+        return DATAPATH_CONFIG
+
+    def get_ct_id(self):
+        return self.ct_id
+
+    def set_ct_id(self, ct_id):
+        ct_id = 0 if ct_id is None else ct_id
+        try:
+            self.ct_id = from_bson_int(ct_id, 64)
+        except:
+            self.ct_id = 0
+
+    def get_dp_id(self):
+        return self.dp_id
+
+    def set_dp_id(self, dp_id):
+        dp_id = 0 if dp_id is None else dp_id
+        try:
+            self.dp_id = from_bson_int(dp_id, 64)
+        except:
+            self.dp_id = 0
+
+    def get_xid(self):
+        return self.xid
+
+    def set_xid(self, xid):
+        xid = 0 if xid is None else xid
+        try:
+            self.xid = from_bson_int(xid, 32)
+        except:
+            self.xid = 0
+
+    def get_operations(self):
+        return self.operations
+
+    def set_operations(self, operations):
+        operations = 0 if operations is None else operations
+        try:
+            self.operations = from_bson_int(operations, 32)
+        except:
+            self.operations = 0
+
+    def from_dict(self, data):
+        self.set_ct_id(data["ct_id"])
+        self.set_dp_id(data["dp_id"])
+        self.set_xid(data["xid"])
+        self.set_operations(data["operations"])
+
+    def to_dict(self):
+        data = {}
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
+        data["xid"] = to_bson_int(self.get_xid(), 32)
+        data["operations"] = to_bson_int(self.get_operations(), 32)
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "DatapathConfig\n"
+        s += "  ct_id: " + format_id(self.get_ct_id()) + "\n"
+        s += "  dp_id: " + format_id(self.get_dp_id()) + "\n"
+        s += "  xid: " + str(self.get_xid()) + "\n"
+        s += "  operations: " + str(self.get_operations()) + "\n"
+        return s
+
+class DatapathConfigAck(MongoIPCMessage):
+    def __init__(self, ct_id=None, dp_id=None, xid=None):
+        self.set_ct_id(ct_id)
+        self.set_dp_id(dp_id)
+        self.set_xid(xid)
+
+    def get_type(self):
+        return DATAPATH_CONFIG_ACK
+
+    def get_ct_id(self):
+        return self.ct_id
+
+    def set_ct_id(self, ct_id):
+        ct_id = 0 if ct_id is None else ct_id
+        try:
+            self.ct_id = from_bson_int(ct_id, 64)
+        except:
+            self.ct_id = 0
+
+    def get_dp_id(self):
+        return self.dp_id
+
+    def set_dp_id(self, dp_id):
+        dp_id = 0 if dp_id is None else dp_id
+        try:
+            self.dp_id = from_bson_int(dp_id, 64)
+        except:
+            self.dp_id = 0
+
+    def get_xid(self):
+        return self.xid
+
+    def set_xid(self, xid):
+        xid = 0 if xid is None else xid
+        try:
+            self.xid = from_bson_int(xid, 32)
+        except:
+            self.xid = 0
+
+    def from_dict(self, data):
+        self.set_ct_id(data["ct_id"])
+        self.set_dp_id(data["dp_id"])
+        self.set_xid(data["xid"])
+
+    def to_dict(self):
+        data = {}
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
+        data["xid"] = to_bson_int(self.get_xid(), 32)
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "DatapathConfigAck\n"
+        s += "  ct_id: " + format_id(self.get_ct_id()) + "\n"
+        s += "  dp_id: " + format_id(self.get_dp_id()) + "\n"
+        s += "  xid: " + str(self.get_xid()) + "\n"
+        return s
+
+class FlowBatchAck(MongoIPCMessage):
+    def __init__(self, ct_id=None, dp_id=None, flows=None, errors=None):
+        self.set_ct_id(ct_id)
+        self.set_dp_id(dp_id)
+        self.set_flows(flows)
+        self.set_errors(errors)
+
+    def get_type(self):
+        return FLOW_BATCH_ACK
+
+    def get_ct_id(self):
+        return self.ct_id
+
+    def set_ct_id(self, ct_id):
+        ct_id = 0 if ct_id is None else ct_id
+        try:
+            self.ct_id = from_bson_int(ct_id, 64)
+        except:
+            self.ct_id = 0
+
+    def get_dp_id(self):
+        return self.dp_id
+
+    def set_dp_id(self, dp_id):
+        dp_id = 0 if dp_id is None else dp_id
+        try:
+            self.dp_id = from_bson_int(dp_id, 64)
+        except:
+            self.dp_id = 0
+
+    def get_flows(self):
+        return self.flows
+
+    def set_flows(self, flows):
+        flows = 0 if flows is None else flows
+        try:
+            self.flows = from_bson_int(flows, 32)
+        except:
+            self.flows = 0
+
+    def get_errors(self):
+        return self.errors
+
+    def set_errors(self, errors):
+        errors = 0 if errors is None else errors
+        try:
+            self.errors = from_bson_int(errors, 32)
+        except:
+            self.errors = 0
+
+    def from_dict(self, data):
+        self.set_ct_id(data["ct_id"])
+        self.set_dp_id(data["dp_id"])
+        self.set_flows(data["flows"])
+        self.set_errors(data["errors"])
+
+    def to_dict(self):
+        data = {}
+        data["ct_id"] = to_bson_int(self.get_ct_id(), 64)
+        data["dp_id"] = to_bson_int(self.get_dp_id(), 64)
+        data["flows"] = to_bson_int(self.get_flows(), 32)
+        data["errors"] = to_bson_int(self.get_errors(), 32)
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "FlowBatchAck\n"
+        s += "  ct_id: " + format_id(self.get_ct_id()) + "\n"
+        s += "  dp_id: " + format_id(self.get_dp_id()) + "\n"
+        s += "  flows: " + str(self.get_flows()) + "\n"
+        s += "  errors: " + str(self.get_errors()) + "\n"
+        return s
@@ -16,6 +16,12 @@ IPCMessage* RFProtocolFactory::buildForType(int type) {
             return new DataPlaneMap();
         case ROUTE_MOD:
             return new RouteMod();
+        case DATAPATH_CONFIG:
+            return new DatapathConfig();
+        case DATAPATH_CONFIG_ACK:
+            return new DatapathConfigAck();
+        case FLOW_BATCH_ACK:
+            return new FlowBatchAck();
         default:
             return NULL;
     }
@@ -17,3 +17,9 @@ class RFProtocolFactory(IPC.IPCMessageFactory):
             return DataPlaneMap()
         if type_ == ROUTE_MOD:
             return RouteMod()
+        if type_ == DATAPATH_CONFIG:
+            return DatapathConfig()
+        if type_ == DATAPATH_CONFIG_ACK:
+            return DatapathConfigAck()
+        if type_ == FLOW_BATCH_ACK:
+            return FlowBatchAck()
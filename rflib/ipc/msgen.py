@@ -32,11 +32,12 @@ defaultValues = {
 "option[]": "std::vector<Option>()",
 }
 
+# Integers are stored as native BSON integers of the same width; see
+# from_BSON_int in MongoIPC.h
 exportType = {
-# Cast prevents C++ stringstreams from interpreting uint8_t as char
-"i8": "to_string<uint16_t>({0})",
-"i32": "to_string<uint32_t>({0})",
-"i64": "to_string<uint64_t>({0})",
+"i8": "(int) {0}",
+"i32": "(int) {0}",
+"i64": "(long long) {0}",
 "bool": "{0}",
 "ip": "{0}.toString()",
 "mac": "{0}.toString()",
@@ -47,9 +48,9 @@ exportType = {
 }
 
 importType = {
-"i8": "string_to<uint8_t>({0}.String())",
-"i32": "string_to<uint32_t>({0}.String())",
-"i64": "string_to<uint64_t>({0}.String())",
+"i8": "(uint8_t) from_BSON_int({0})",
+"i32": "(uint32_t) from_BSON_int({0})",
+"i64": "from_BSON_int({0})",
 "bool": "{0}.Bool()",
 "ip": "IPAddress(IPV4, {0}.String())",
 "mac": "MACAddress({0}.String())",
@@ -59,6 +60,12 @@ importType = {
 "option[]": "OptionList::to_vector({0}.Array())",
 }
 
+strType = dict(exportType)
+# Cast prevents C++ stringstreams from interpreting uint8_t as char
+strType["i8"] = "to_string<uint16_t>({0})"
+strType["i32"] = "to_string<uint32_t>({0})"
+strType["i64"] = "to_string<uint64_t>({0})"
+
 # Python
 pyTypesMap = {
 "match" : "Match",
@@ -80,9 +87,9 @@ pyDefaultValues = {
 }
 
 pyExportType = {
-"i8": "str({0})",
-"i32": "str({0})",
-"i64": "str({0})",
+"i8": "to_bson_int({0}, 32)",
+"i32": "to_bson_int({0}, 32)",
+"i64": "to_bson_int({0}, 64)",
 "bool": "bool({0})",
 "ip": "str({0})",
 "mac": "str({0})",
@@ -93,9 +100,9 @@ pyExportType = {
 }
 
 pyImportType = {
-"i8": "int({0})",
-"i32": "int({0})",
-"i64": "int({0})",
+"i8": "from_bson_int({0}, 32)",
+"i32": "from_bson_int({0}, 32)",
+"i64": "from_bson_int({0}, 64)",
 "bool": "bool({0})",
 "ip": "str({0})",
 "mac": "str({0})",
@@ -211,6 +218,7 @@ def genCPP(messages, fname):
     g.addLine("#include \"{0}.h\"".format(fname))
     g.blankLine()
     g.addLine("#include <mongo/client/dbclient.h>")
+    g.addLine("#include \"MongoIPC.h\"")
     g.blankLine()
     for name, msg in messages:
         g.addLine("{0}::{0}() {{".format(name))
@@ -294,7 +302,7 @@ def genCPP(messages, fname):
         g.addLine("ss << \"{0}\" << endl;".format(name))
         for t, f in msg:
             value = "get_{0}()".format(f)
-            g.addLine("ss << \"  {0}: \" << {1} << endl;".format(f, exportType[t].format(value)))
+            g.addLine("ss << \"  {0}: \" << {1} << endl;".format(f, strType[t].format(value)))
         g.addLine("return ss.str();")
         g.decreaseIndent()
         g.addLine("}")
@@ -363,7 +371,7 @@ def genPy(messages, fname):
     g.blankLine()
     for tlv in ["Match","Action","Option"]:
         g.addLine("from rflib.types.{0} import {0}".format(tlv))
-    g.addLine("from MongoIPC import MongoIPCMessage")
+    g.addLine("from MongoIPC import MongoIPCMessage, to_bson_int, from_bson_int")
     g.blankLine()
     g.addLine("format_id = lambda dp_id: hex(dp_id).rstrip('L')")
     g.blankLine()
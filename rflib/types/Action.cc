@@ -26,9 +26,8 @@ Action& Action::operator=(const Action& other) {
     return *this;
 }
 
-bool Action::operator==(const Action& other) {
-    return (this->getType() == other.getType() and
-            (memcmp(other.getValue(), this->getValue(), this->length) == 0));
+bool Action::operator==(const Action& other) const {
+    return TLV::operator==(other);
 }
 
 std::string Action::type_to_string() const {
@@ -25,7 +25,7 @@ class Action : public TLV {
         Action(ActionType, const IPAddress& addr, const IPAddress& mask);
 
         Action& operator=(const Action& other);
-        bool operator==(const Action& other);
+        bool operator==(const Action& other) const;
         virtual std::string type_to_string() const;
         virtual mongo::BSONObj to_BSON() const;
 
@@ -40,4 +40,14 @@ namespace ActionList {
     std::vector<Action> to_vector(std::vector<mongo::BSONElement> array);
 }
 
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<Action> {
+        size_t operator()(const Action& action) const {
+            return hash_value(action);
+        }
+    };
+}
+#endif
+
 #endif /* __ACTION_HH__ */
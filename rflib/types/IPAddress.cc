@@ -1,3 +1,5 @@
+#include <boost/functional/hash.hpp>
+
 #include "IPAddress.h"
 
 IPAddress::IPAddress() {
@@ -80,12 +82,10 @@ IPAddress::IPAddress(const int version, int prefix_len) {
 }
 
 IPAddress::~IPAddress() {
-    delete this->data;
 }
 
 IPAddress& IPAddress::operator=(const IPAddress &other) {
     if (this != &other) {
-        delete data;
         this->init(other.getVersion());
         other.toArray(this->data);
     }
@@ -97,6 +97,54 @@ bool IPAddress::operator==(const IPAddress &other) const {
         (memcmp(other.data, this->data, this->length) == 0));
 }
 
+bool IPAddress::operator!=(const IPAddress &other) const {
+    return !(*this == other);
+}
+
+/**
+ * Order addresses by version, then by value.
+ */
+bool IPAddress::operator<(const IPAddress &other) const {
+    if (this->version != other.version) {
+        return this->version < other.version;
+    }
+    return memcmp(this->data, other.data, this->length) < 0;
+}
+
+size_t hash_value(const IPAddress& addr) {
+    uint8_t data[16];
+    addr.toArray(data);
+
+    size_t seed = boost::hash_range(data, data + addr.getLength());
+    boost::hash_combine(seed, addr.getVersion());
+    return seed;
+}
+
+/**
+ * Compare two (address, mask) pairs, ignoring the host bits of the addresses.
+ * Returns a negative value, 0 or a positive value if the first prefix sorts
+ * before, the same as or after the second one.
+ *
+ * Prefixes are ordered by version, then by network address, then by mask,
+ * shorter prefixes first. A prefix thus sorts right before all the prefixes
+ * it covers, as in a depth-first walk of a prefix tree.
+ */
+int IPAddress::comparePrefix(const IPAddress& addr1, const IPAddress& mask1,
+                             const IPAddress& addr2, const IPAddress& mask2) {
+    if (addr1.version != addr2.version) {
+        return addr1.version < addr2.version ? -1 : 1;
+    }
+
+    for (size_t i = 0; i < addr1.length; i++) {
+        uint8_t net1 = addr1.data[i] & mask1.data[i];
+        uint8_t net2 = addr2.data[i] & mask2.data[i];
+        if (net1 != net2) {
+            return net1 < net2 ? -1 : 1;
+        }
+    }
+    return memcmp(mask1.data, mask2.data, addr1.length);
+}
+
 /**
  * Returns the in_addr (or in6_addr) structure for this IPAddress
  *
@@ -126,7 +174,9 @@ void IPAddress::toArray(uint8_t* array) const {
  */
 uint32_t IPAddress::toUint32() const {
     if (this->version == IPV4) {
-        return ntohl(((in_addr*) this->toInAddr())->s_addr);
+        uint32_t n;
+        memcpy(&n, this->data, sizeof(n));
+        return ntohl(n);
     }
     else {
         return 0;
@@ -134,21 +184,19 @@ uint32_t IPAddress::toUint32() const {
 }
 
 string IPAddress::toString() const {
-    char* dst = NULL;
-    void* n = this->toInAddr();
-    if (this->version == IPV4) {
-        dst = new char[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, n, dst, INET_ADDRSTRLEN);
-        delete (in_addr*) n;
-    }
-    else if (this->version == IPV6) {
-        dst = new char[INET6_ADDRSTRLEN];
-        inet_ntop(AF_INET6, n, dst, INET6_ADDRSTRLEN);
-        delete (in6_addr*) n;
+    char buf[IPV6_STRLEN];
+    return string(buf, this->toString(buf));
+}
+
+/**
+ * Write the text form of the address into 'buf', which must hold at least
+ * IPV6_STRLEN characters. Returns the length of the text.
+ */
+size_t IPAddress::toString(char* buf) const {
+    if (this->version == IPV6) {
+        return format_ipv6(this->data, buf);
     }
-    string result = string(dst != NULL? dst : "");
-    delete dst;
-    return result;
+    return format_ipv4(this->data, buf);
 }
 
 int IPAddress::toPrefixLen() const {
@@ -190,18 +238,18 @@ void IPAddress::init(const int version) {
     } else {
         throw "Constructing IPAddress with invalid version!";
     }
-    this->data = new uint8_t[this->length];
+    memset(this->data, 0, sizeof(this->data));
 }
 
+/**
+ * Set the address from its text form. The address is left all zeros if the
+ * text is not a valid address of this version.
+ */
 void IPAddress::data_from_string(const string &address) {
     if (this->version == IPV4) {
-        struct in_addr n;
-        inet_pton(AF_INET, address.c_str(), &n);
-        memcpy(this->data, &n.s_addr, 4);
+        parse_ipv4(address.c_str(), this->data);
     }
     else if (this->version == IPV6) {
-        struct in6_addr n6;
-        inet_pton(AF_INET6, address.c_str(), &n6);
-        memcpy(this->data, &n6.s6_addr, 16);
+        parse_ipv6(address.c_str(), this->data);
     }
 }
@@ -7,6 +7,12 @@
 #include <arpa/inet.h>
 #include <sstream>
 #include <string>
+#include <utility>
+#if __cplusplus >= 201103L
+#include <functional>
+#endif
+
+#include "TextConversion.h"
 
 enum { IPV4 = 4, IPV6 = 6 };
 
@@ -28,21 +34,56 @@ class IPAddress {
 
         IPAddress& operator=(const IPAddress& other);
         bool operator==(const IPAddress& other) const;
+        bool operator!=(const IPAddress& other) const;
+        bool operator<(const IPAddress& other) const;
         void* toInAddr() const;
         void toArray(uint8_t* array) const;
         uint32_t toUint32() const;
         string toString() const;
+        size_t toString(char* buf) const;
         int toPrefixLen() const;
         int toCIDRMask() const;
         int getVersion() const;
         size_t getLength() const;
 
+        static int comparePrefix(const IPAddress& addr1,
+                                 const IPAddress& mask1,
+                                 const IPAddress& addr2,
+                                 const IPAddress& mask2);
+
     private:
-        int version;
-        size_t length;
-        uint8_t* data;
+        /* Stored inline, so that addresses cost no allocation */
+        uint8_t version;
+        uint8_t length;
+        uint8_t data[16];
         void init(const int version);
         void data_from_string(const string &address);
 };
 
+size_t hash_value(const IPAddress& addr);
+
+/* An (address, mask) pair */
+typedef std::pair<IPAddress, IPAddress> IPPrefix;
+
+/**
+ * Strict weak ordering of prefixes, see IPAddress::comparePrefix(). Prefixes
+ * that only differ by host bits are equivalent.
+ */
+struct IPPrefixLess {
+    bool operator()(const IPPrefix& a, const IPPrefix& b) const {
+        return IPAddress::comparePrefix(a.first, a.second,
+                                        b.first, b.second) < 0;
+    }
+};
+
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<IPAddress> {
+        size_t operator()(const IPAddress& addr) const {
+            return hash_value(addr);
+        }
+    };
+}
+#endif
+
 #endif /* __IPADDRESS_H__ */
@@ -1,6 +1,11 @@
+#include <boost/functional/hash.hpp>
+
 #include "MACAddress.h"
+#include "TextConversion.h"
 
-MACAddress::MACAddress() {}
+MACAddress::MACAddress() {
+    memset(this->data, 0, IFHWADDRLEN);
+}
 
 MACAddress::MACAddress(const char* address) {
     string saddress(address);
@@ -30,30 +35,35 @@ bool MACAddress::operator==(const MACAddress &other) const {
     return memcmp(other.data, this->data, IFHWADDRLEN) == 0;
 }
 
+bool MACAddress::operator!=(const MACAddress &other) const {
+    return !(*this == other);
+}
+
+bool MACAddress::operator<(const MACAddress &other) const {
+    return memcmp(this->data, other.data, IFHWADDRLEN) < 0;
+}
+
+size_t hash_value(const MACAddress& addr) {
+    uint8_t data[IFHWADDRLEN];
+    addr.toArray(data);
+    return boost::hash_range(data, data + IFHWADDRLEN);
+}
+
 void MACAddress::toArray(uint8_t* array) const {
     memcpy(array, this->data, IFHWADDRLEN);
 }
         
 string MACAddress::toString() const {
-    stringstream ss;
-    ss << hex << setfill('0');
-    for (int i = 0; i < IFHWADDRLEN; i++) {
-        ss <<  setw(2) << (int) data[i]; 
-        if (i < IFHWADDRLEN - 1)
-            ss << ':';
-    }
-        
-    return ss.str();
+    char buf[MAC_STRLEN];
+    return string(buf, format_mac(this->data, buf));
 }
 
+/**
+ * Set the address from its text form. The address is all zeros if the text
+ * is not a valid MAC address.
+ */
 void MACAddress::data_from_string(const string &address) {
-    char sc;
-    int byte;
-    stringstream ss(address);
-    ss << hex;
-    for (int i = 0; i < IFHWADDRLEN; i++) {
-        ss >> byte;
-        ss >> sc;
-        this->data[i] = (uint8_t) byte;
+    if (!parse_mac(address.c_str(), this->data)) {
+        memset(this->data, 0, IFHWADDRLEN);
     }
 }
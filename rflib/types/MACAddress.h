@@ -8,6 +8,9 @@
 #include <sstream>
 #include <iomanip>
 #include <string>
+#if __cplusplus >= 201103L
+#include <functional>
+#endif
 
 using namespace std;
 
@@ -21,6 +24,8 @@ class MACAddress {
         
         MACAddress& operator=(const MACAddress &other);
         bool operator==(const MACAddress &other) const;
+        bool operator!=(const MACAddress &other) const;
+        bool operator<(const MACAddress &other) const;
         void toArray(uint8_t* array) const;
         string toString() const;
         
@@ -29,6 +34,18 @@ class MACAddress {
         void data_from_string(const string &address);
 };
 
+size_t hash_value(const MACAddress& addr);
+
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<MACAddress> {
+        size_t operator()(const MACAddress& addr) const {
+            return hash_value(addr);
+        }
+    };
+}
+#endif
+
 #endif /* __MACADDRESS_H__ */
 
 
@@ -31,9 +31,8 @@ Match& Match::operator=(const Match& other) {
     return *this;
 }
 
-bool Match::operator==(const Match& other) {
-    return (this->getType() == other.getType() and
-            (memcmp(other.getValue(), this->getValue(), this->length) == 0));
+bool Match::operator==(const Match& other) const {
+    return TLV::operator==(other);
 }
 
 std::string Match::type_to_string() const {
@@ -46,6 +45,8 @@ std::string Match::type_to_string() const {
         case RFMT_NW_PROTO:     return "RFMT_NW_PROTO";
         case RFMT_TP_SRC:       return "RFMT_TP_SRC";
         case RFMT_TP_DST:       return "RFMT_TP_DST";
+        case RFMT_INGRESS:      return "RFMT_INGRESS";
+        case RFMT_VRF:          return "RFMT_VRF";
         case RFMT_IN_PORT:      return "RFMT_IN_PORT";
         case RFMT_VLAN:         return "RFMT_VLAN";
         default:                return "UNKNOWN_MATCH";
@@ -68,6 +69,7 @@ size_t Match::type_to_length(uint8_t type) {
         case RFMT_VLAN:
             return sizeof(uint16_t);
         case RFMT_MPLS:
+        case RFMT_VRF:
         case RFMT_IN_PORT:
             return sizeof(uint32_t);
         default:                return 0;
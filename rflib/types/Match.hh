@@ -12,7 +12,10 @@ enum MatchType {
     RFMT_NW_PROTO = 6,   /* Match Network Protocol */
     RFMT_TP_SRC = 7,     /* Match Transport Layer Src Port */
     RFMT_TP_DST = 8,     /* Match Transport Layer Dest Port */
+    RFMT_INGRESS = 9,    /* Match any of a list of (Ethernet Destination,
+                            in port); variable length, built by RFServer */
     /* MSB = 1; Indicates optional feature. */
+    RFMT_VRF = 253,      /* Match VRF (kernel routing table) of the route */
     RFMT_IN_PORT = 254,  /* Match incoming port (Unimplemented) */
     RFMT_VLAN = 255      /* Match incoming VLAN (Unimplemented) */
 };
@@ -29,7 +32,7 @@ class Match : public TLV {
         Match(MatchType, const IPAddress& addr, const IPAddress& mask);
 
         Match& operator=(const Match& other);
-        bool operator==(const Match& other);
+        bool operator==(const Match& other) const;
         const ip_match* getIPv4() const;
         const ip6_match* getIPv6() const;
         virtual std::string type_to_string() const;
@@ -46,4 +49,14 @@ namespace MatchList {
     std::vector<Match> to_vector(std::vector<mongo::BSONElement> array);
 }
 
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<Match> {
+        size_t operator()(const Match& match) const {
+            return hash_value(match);
+        }
+    };
+}
+#endif
+
 #endif /* __MATCH_HH__ */
@@ -9,7 +9,9 @@ RFMT_ETHERTYPE = 5   # Match Ethernet type
 RFMT_NW_PROTO = 6    # Match Network Protocol
 RFMT_TP_SRC = 7      # Match Transport Layer Src Port
 RFMT_TP_DST = 8      # Match Transport Layer Dest Port
+RFMT_INGRESS = 9     # Match any of a list of (Ethernet Destination, in port)
 # MSB = 1; Indicates optional feature.
+RFMT_VRF = 253       # Match VRF (kernel routing table) of the route
 RFMT_IN_PORT = 254   # Match incoming port (Unimplemented)
 RFMT_VLAN = 255      # Match incoming VLAN (Unimplemented)
 
@@ -21,7 +23,11 @@ typeStrings = {
             RFMT_ETHERTYPE : "RFMT_ETHERTYPE",
             RFMT_NW_PROTO : "RFMT_NW_PROTO",
             RFMT_TP_SRC : "RFMT_TP_SRC",
-            RFMT_TP_DST : "RFMT_TP_DST"
+            RFMT_TP_DST : "RFMT_TP_DST",
+            RFMT_INGRESS : "RFMT_INGRESS",
+            RFMT_VRF : "RFMT_VRF",
+            RFMT_IN_PORT : "RFMT_IN_PORT",
+            RFMT_VLAN : "RFMT_VLAN"
         }
 
 class Match(TLV):
@@ -47,6 +53,17 @@ class Match(TLV):
     def MPLS(cls, label):
         return cls(RFMT_MPLS, label)
 
+    @classmethod
+    def INGRESS(cls, points):
+        """Match packets entering through any of the given points, a list of
+        (ethernet_dst, in_port) tuples. Proxies install one flow per point
+        unless the switch can do better."""
+        return cls(RFMT_INGRESS, points)
+
+    @classmethod
+    def VRF(cls, vrf):
+        return cls(RFMT_VRF, vrf)
+
     @classmethod
     def IN_PORT(cls, port):
         return cls(RFMT_IN_PORT, port)
@@ -86,12 +103,15 @@ class Match(TLV):
             return inet_pton(AF_INET6, value[0]) + inet_pton(AF_INET6, value[1])
         elif matchType == RFMT_ETHERNET:
             return ether_to_bin(value)
-        elif matchType in (RFMT_MPLS, RFMT_IN_PORT):
+        elif matchType in (RFMT_MPLS, RFMT_VRF, RFMT_IN_PORT):
             return int_to_bin(value, 32)
         elif matchType in (RFMT_VLAN, RFMT_ETHERTYPE, RFMT_TP_SRC, RFMT_TP_DST):
             return int_to_bin(value, 16)
         elif matchType == RFMT_NW_PROTO:
             return int_to_bin(value, 8)
+        elif matchType == RFMT_INGRESS:
+            return "".join([ether_to_bin(eth) + int_to_bin(port, 32)
+                            for (eth, port) in value])
         else:
             return None
 
@@ -109,9 +129,14 @@ class Match(TLV):
             return (inet_ntop(AF_INET6, self._value[:16]), inet_ntop(AF_INET6, self._value[16:]))
         elif self._type == RFMT_ETHERNET:
             return bin_to_ether(self._value)
-        elif self._type in (RFMT_MPLS, RFMT_IN_PORT, RFMT_VLAN, RFMT_ETHERTYPE,
-                            RFMT_NW_PROTO, RFMT_TP_SRC, RFMT_TP_DST):
+        elif self._type in (RFMT_MPLS, RFMT_VRF, RFMT_IN_PORT, RFMT_VLAN,
+                            RFMT_ETHERTYPE, RFMT_NW_PROTO, RFMT_TP_SRC,
+                            RFMT_TP_DST):
             return bin_to_int(self._value)
+        elif self._type == RFMT_INGRESS:
+            return [(bin_to_ether(self._value[i:i + 6]),
+                     bin_to_int(self._value[i + 6:i + 10]))
+                    for i in range(0, len(self._value), 10)]
         else:
             return None
 
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+
+#include "MatchKey.hh"
+
+/* Bytes of a match encoded in the key, before its value */
+#define MATCH_HEADER_SIZE 3
+
+namespace {
+    /* Location of an encoded match in the scratch buffer */
+    struct Entry {
+        const std::string* buf;
+        size_t offset;
+        size_t length;
+
+        bool operator<(const Entry& other) const {
+            int cmp = memcmp(buf->data() + offset,
+                             other.buf->data() + other.offset,
+                             std::min(length, other.length));
+            return cmp != 0 ? cmp < 0 : length < other.length;
+        }
+
+        bool operator==(const Entry& other) const {
+            return length == other.length &&
+                memcmp(buf->data() + offset, other.buf->data() + other.offset,
+                       length) == 0;
+        }
+    };
+}
+
+MatchKey::MatchKey() {}
+
+MatchKey::MatchKey(const std::vector<Match>& matches) {
+    std::string buf;
+    std::vector<Entry> entries(matches.size());
+
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Match& match = matches[i];
+        size_t length = match.getLength();
+
+        entries[i].buf = &buf;
+        entries[i].offset = buf.size();
+        entries[i].length = MATCH_HEADER_SIZE + length;
+
+        buf.push_back(match.getType());
+        buf.push_back((length >> 8) & 0xff);
+        buf.push_back(length & 0xff);
+        buf.append((const char*) match.getValue(), length);
+
+        /* The value of a prefix match is the address followed by the mask. */
+        if ((match.getType() == RFMT_IPV4 && length == sizeof(ip_match)) ||
+            (match.getType() == RFMT_IPV6 && length == sizeof(ip6_match))) {
+            size_t addr = entries[i].offset + MATCH_HEADER_SIZE;
+            size_t mask = addr + length / 2;
+            for (size_t j = 0; j < length / 2; j++) {
+                buf[addr + j] = buf[addr + j] & buf[mask + j];
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+    this->key.reserve(buf.size());
+    std::vector<Entry>::const_iterator iter = entries.begin();
+    for (; iter != entries.end(); iter++) {
+        this->key.append(buf, iter->offset, iter->length);
+    }
+}
+
+bool MatchKey::operator==(const MatchKey& other) const {
+    return this->key == other.key;
+}
+
+bool MatchKey::operator!=(const MatchKey& other) const {
+    return this->key != other.key;
+}
+
+bool MatchKey::operator<(const MatchKey& other) const {
+    return this->key < other.key;
+}
+
+const std::string& MatchKey::bytes() const {
+    return this->key;
+}
+
+bool MatchKey::empty() const {
+    return this->key.empty();
+}
+
+size_t hash_value(const MatchKey& key) {
+    return boost::hash_range(key.bytes().begin(), key.bytes().end());
+}
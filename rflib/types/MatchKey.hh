@@ -0,0 +1,49 @@
+#ifndef __MATCHKEY_HH__
+#define __MATCHKEY_HH__
+
+#include <string>
+#include <vector>
+#if __cplusplus >= 201103L
+#include <functional>
+#endif
+
+#include "Match.hh"
+
+/**
+ * Canonical key for the set of matches of a RouteMod.
+ *
+ * Match sets that select the same packets get the same key: the order of
+ * the matches does not matter, duplicates are dropped, and the host bits of
+ * IP prefix matches are cleared. The key is a single byte string holding,
+ * for each match in order, its type, its length on two bytes and its value,
+ * so it costs one allocation and compares with memcmp().
+ */
+class MatchKey {
+    public:
+        MatchKey();
+        MatchKey(const std::vector<Match>& matches);
+
+        bool operator==(const MatchKey& other) const;
+        bool operator!=(const MatchKey& other) const;
+        bool operator<(const MatchKey& other) const;
+
+        const std::string& bytes() const;
+        bool empty() const;
+
+    private:
+        std::string key;
+};
+
+size_t hash_value(const MatchKey& key);
+
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<MatchKey> {
+        size_t operator()(const MatchKey& key) const {
+            return hash_value(key);
+        }
+    };
+}
+#endif
+
+#endif /* __MATCHKEY_HH__ */
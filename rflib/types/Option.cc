@@ -28,9 +28,8 @@ Option& Option::operator=(const Option& other) {
     return *this;
 }
 
-bool Option::operator==(const Option& other) {
-    return (this->getType() == other.getType() and
-            (memcmp(other.getValue(), this->getValue(), this->length) == 0));
+bool Option::operator==(const Option& other) const {
+    return TLV::operator==(other);
 }
 
 std::string Option::type_to_string() const {
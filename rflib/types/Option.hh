@@ -23,7 +23,7 @@ class Option : public TLV {
         Option(OptionType, const uint64_t value);
 
         Option& operator=(const Option& other);
-        bool operator==(const Option& other);
+        bool operator==(const Option& other) const;
         virtual std::string type_to_string() const;
         virtual mongo::BSONObj to_BSON() const;
 
@@ -38,4 +38,14 @@ namespace OptionList {
     std::vector<Option> to_vector(std::vector<mongo::BSONElement> array);
 }
 
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<Option> {
+        size_t operator()(const Option& option) const {
+            return hash_value(option);
+        }
+    };
+}
+#endif
+
 #endif /* __OPTION_HH__ */
@@ -1,5 +1,6 @@
 #include <net/if.h>
 #include <boost/scoped_array.hpp>
+#include <boost/functional/hash.hpp>
 
 #include "TLV.hh"
 #include "endian.hh"
@@ -80,11 +81,36 @@ TLV& TLV::operator=(const TLV& other) {
     return *this;
 }
 
-bool TLV::operator==(const TLV& other) {
+bool TLV::operator==(const TLV& other) const {
     return (this->getType() == other.getType() and
+            this->getLength() == other.getLength() and
             (memcmp(other.getValue(), this->getValue(), this->length) == 0));
 }
 
+bool TLV::operator!=(const TLV& other) const {
+    return !(*this == other);
+}
+
+/**
+ * Order TLVs by type, then by length, then by value.
+ */
+bool TLV::operator<(const TLV& other) const {
+    if (this->getType() != other.getType()) {
+        return this->getType() < other.getType();
+    }
+    if (this->getLength() != other.getLength()) {
+        return this->getLength() < other.getLength();
+    }
+    return memcmp(this->getValue(), other.getValue(), this->length) < 0;
+}
+
+size_t hash_value(const TLV& tlv) {
+    size_t seed = boost::hash_range(tlv.getValue(),
+                                    tlv.getValue() + tlv.getLength());
+    boost::hash_combine(seed, tlv.getType());
+    return seed;
+}
+
 uint8_t TLV::getType() const {
     return this->type;
 }
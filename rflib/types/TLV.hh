@@ -6,6 +6,9 @@
 #include <cstring>
 #include <string>
 #include <vector>
+#if __cplusplus >= 201103L
+#include <functional>
+#endif
 #include <boost/shared_array.hpp>
 #include <mongo/client/dbclient.h>
 
@@ -40,7 +43,9 @@ class TLV {
         TLV(uint8_t, const IPAddress& addr, const IPAddress& mask);
 
         TLV& operator=(const TLV& other);
-        bool operator==(const TLV& other);
+        bool operator==(const TLV& other) const;
+        bool operator!=(const TLV& other) const;
+        bool operator<(const TLV& other) const;
         uint8_t getType() const;
         size_t getLength() const;
         uint8_t getUint8() const;
@@ -71,4 +76,16 @@ class TLV {
         void init(uint8_t type, size_t, boost::shared_array<uint8_t> value);
 };
 
+size_t hash_value(const TLV& tlv);
+
+#if __cplusplus >= 201103L
+namespace std {
+    template<> struct hash<TLV> {
+        size_t operator()(const TLV& tlv) const {
+            return hash_value(tlv);
+        }
+    };
+}
+#endif
+
 #endif /* __TLV_HH__ */
@@ -0,0 +1,354 @@
+#include <string.h>
+
+#include "TextConversion.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/* Decimal representation of 0 to 99, two characters each */
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Value of each character as a hexadecimal digit, -1 if it is not one */
+static const int8_t HEX_VALUES[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static inline int hex_value(char c) {
+    return HEX_VALUES[(uint8_t) c];
+}
+
+/* Write an octet in decimal, without leading zeros. */
+static inline char* put_octet(uint8_t value, char* p) {
+    if (value >= 100) {
+        *p++ = '0' + value / 100;
+        value %= 100;
+        memcpy(p, &DIGIT_PAIRS[value * 2], 2);
+        return p + 2;
+    } else if (value >= 10) {
+        memcpy(p, &DIGIT_PAIRS[value * 2], 2);
+        return p + 2;
+    }
+    *p++ = '0' + value;
+    return p;
+}
+
+/* Write a 16-bit word in hexadecimal, without leading zeros. */
+static inline char* put_hex16(uint16_t value, char* p) {
+    if (value >= 0x1000) {
+        *p++ = HEX_DIGITS[value >> 12];
+    }
+    if (value >= 0x100) {
+        *p++ = HEX_DIGITS[(value >> 8) & 0xf];
+    }
+    if (value >= 0x10) {
+        *p++ = HEX_DIGITS[(value >> 4) & 0xf];
+    }
+    *p++ = HEX_DIGITS[value & 0xf];
+    return p;
+}
+
+size_t format_mac(const uint8_t* mac, char* buf) {
+    char* p = buf;
+    for (int i = 0; i < 6; i++) {
+        if (i != 0) {
+            *p++ = ':';
+        }
+        *p++ = HEX_DIGITS[mac[i] >> 4];
+        *p++ = HEX_DIGITS[mac[i] & 0xf];
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+size_t format_ipv4(const uint8_t* addr, char* buf) {
+    char* p = buf;
+    for (int i = 0; i < 4; i++) {
+        if (i != 0) {
+            *p++ = '.';
+        }
+        p = put_octet(addr[i], p);
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+/**
+ * Format an IPv6 address as recommended by RFC 5952: the longest run of two
+ * or more zero words is elided, and IPv4-mapped and IPv4-compatible
+ * addresses end in dotted decimal, as inet_ntop() does.
+ */
+size_t format_ipv6(const uint8_t* addr, char* buf) {
+    uint16_t words[8];
+    for (int i = 0; i < 8; i++) {
+        words[i] = (addr[2 * i] << 8) | addr[2 * i + 1];
+    }
+
+    int best_base = -1, best_len = 0;
+    int cur_base = -1, cur_len = 0;
+    for (int i = 0; i <= 8; i++) {
+        if (i < 8 && words[i] == 0) {
+            if (cur_base == -1) {
+                cur_base = i;
+                cur_len = 0;
+            }
+            cur_len++;
+        } else if (cur_base != -1) {
+            if (cur_len > best_len) {
+                best_base = cur_base;
+                best_len = cur_len;
+            }
+            cur_base = -1;
+        }
+    }
+    if (best_len < 2) {
+        best_base = -1;
+    }
+
+    char* p = buf;
+    for (int i = 0; i < 8; i++) {
+        if (best_base != -1 && i >= best_base && i < best_base + best_len) {
+            if (i == best_base) {
+                *p++ = ':';
+            }
+            continue;
+        }
+        if (i != 0) {
+            *p++ = ':';
+        }
+        if (i == 6 && best_base == 0 &&
+            (best_len == 6 || (best_len == 5 && words[5] == 0xffff))) {
+            p += format_ipv4(addr + 12, p);
+            return p - buf;
+        }
+        p = put_hex16(words[i], p);
+    }
+    if (best_base != -1 && best_base + best_len == 8) {
+        *p++ = ':';
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+size_t format_uint64(uint64_t value, char* buf) {
+    /* Digits are produced from the end, two at a time. */
+    char tmp[UINT64_STRLEN];
+    char* p = tmp + sizeof(tmp);
+
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[value * 2], 2);
+    } else {
+        *--p = '0' + value;
+    }
+
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Parse a MAC address: six groups of one or two hexadecimal digits, separated
+ * by colons.
+ */
+bool parse_mac(const char* str, uint8_t* mac) {
+    uint8_t tmp[6];
+
+    for (int i = 0; i < 6; i++) {
+        if (i != 0 && *str++ != ':') {
+            return false;
+        }
+
+        int high = hex_value(*str++);
+        if (high < 0) {
+            return false;
+        }
+        int low = hex_value(*str);
+        if (low < 0) {
+            tmp[i] = high;
+        } else {
+            tmp[i] = (high << 4) | low;
+            str++;
+        }
+    }
+    if (*str != '\0') {
+        return false;
+    }
+
+    memcpy(mac, tmp, sizeof(tmp));
+    return true;
+}
+
+/**
+ * Parse an IPv4 address in dotted decimal. As with inet_pton(), there must be
+ * four parts with no leading zeros.
+ */
+bool parse_ipv4(const char* str, uint8_t* addr) {
+    uint8_t tmp[4];
+
+    for (int i = 0; i < 4; i++) {
+        if (i != 0 && *str++ != '.') {
+            return false;
+        }
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+
+        unsigned int value = *str++ - '0';
+        for (; *str >= '0' && *str <= '9'; str++) {
+            if (value == 0) {
+                return false;
+            }
+            value = value * 10 + (*str - '0');
+            if (value > 255) {
+                return false;
+            }
+        }
+        tmp[i] = value;
+    }
+    if (*str != '\0') {
+        return false;
+    }
+
+    memcpy(addr, tmp, sizeof(tmp));
+    return true;
+}
+
+/**
+ * Parse an IPv6 address, in any of the forms accepted by inet_pton().
+ */
+bool parse_ipv6(const char* str, uint8_t* addr) {
+    uint8_t tmp[16];
+    uint8_t* tp = tmp;
+    uint8_t* end = tmp + sizeof(tmp);
+    uint8_t* colon = NULL;
+
+    memset(tmp, 0, sizeof(tmp));
+
+    /* Leading :: requires some special handling. */
+    if (*str == ':' && *++str != ':') {
+        return false;
+    }
+
+    const char* token = str;
+    unsigned int value = 0;
+    int digits = 0;
+    char c;
+    while ((c = *str++) != '\0') {
+        int digit = hex_value(c);
+        if (digit >= 0) {
+            if (digits == 4) {
+                return false;
+            }
+            value = (value << 4) | digit;
+            digits++;
+            continue;
+        }
+
+        if (c == ':') {
+            token = str;
+            if (digits == 0) {
+                if (colon != NULL) {
+                    return false;
+                }
+                colon = tp;
+                continue;
+            } else if (*str == '\0' || tp + 2 > end) {
+                return false;
+            }
+            *tp++ = value >> 8;
+            *tp++ = value & 0xff;
+            value = 0;
+            digits = 0;
+            continue;
+        }
+
+        /* Trailing dotted decimal part, which ends the address. */
+        if (c == '.' && tp + 4 <= end && parse_ipv4(token, tp)) {
+            tp += 4;
+            digits = 0;
+            break;
+        }
+        return false;
+    }
+
+    if (digits != 0) {
+        if (tp + 2 > end) {
+            return false;
+        }
+        *tp++ = value >> 8;
+        *tp++ = value & 0xff;
+    }
+
+    if (colon != NULL) {
+        /* Move what follows the :: to the end, zeroing the gap. */
+        if (tp == end) {
+            return false;
+        }
+        size_t n = tp - colon;
+        memmove(end - n, colon, n);
+        memset(colon, 0, end - n - colon);
+        tp = end;
+    }
+    if (tp != end) {
+        return false;
+    }
+
+    memcpy(addr, tmp, sizeof(tmp));
+    return true;
+}
+
+/**
+ * Parse an unsigned decimal integer. Leading whitespace is skipped and
+ * parsing stops at the first character that is not a digit, as with
+ * operator>>. Fails if there is no digit or the value does not fit.
+ */
+bool parse_uint64(const char* str, uint64_t& value) {
+    while (*str == ' ' || (*str >= '\t' && *str <= '\r')) {
+        str++;
+    }
+    if (*str < '0' || *str > '9') {
+        return false;
+    }
+
+    uint64_t result = 0;
+    for (; *str >= '0' && *str <= '9'; str++) {
+        uint64_t digit = *str - '0';
+        if (result > (~(uint64_t) 0 - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+
+    value = result;
+    return true;
+}
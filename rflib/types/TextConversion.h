@@ -0,0 +1,35 @@
+#ifndef __TEXTCONVERSION_H__
+#define __TEXTCONVERSION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Conversion of addresses and integers to and from text.
+ *
+ * Formatters write into a caller-provided buffer of at least the size given
+ * below, terminate it with a NUL and return the length of the text. Parsers
+ * read a NUL-terminated string and return false if it is malformed, leaving
+ * the output untouched. Nothing here allocates memory or uses locales.
+ *
+ * Text is the same as from ether_ntoa() (with leading zeros), inet_ntop()
+ * and printf("%llu"), and is parsed as by inet_pton().
+ */
+
+/* Buffer sizes, terminating NUL included */
+#define MAC_STRLEN 18
+#define IPV4_STRLEN 16
+#define IPV6_STRLEN 46
+#define UINT64_STRLEN 21
+
+size_t format_mac(const uint8_t* mac, char* buf);
+size_t format_ipv4(const uint8_t* addr, char* buf);
+size_t format_ipv6(const uint8_t* addr, char* buf);
+size_t format_uint64(uint64_t value, char* buf);
+
+bool parse_mac(const char* str, uint8_t* mac);
+bool parse_ipv4(const char* str, uint8_t* addr);
+bool parse_ipv6(const char* str, uint8_t* addr);
+bool parse_uint64(const char* str, uint64_t& value);
+
+#endif /* __TEXTCONVERSION_H__ */
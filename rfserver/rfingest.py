@@ -0,0 +1,192 @@
+import time
+import logging
+import threading
+from collections import OrderedDict
+
+import rflib.ipc.IPC as IPC
+from rflib.ipc.RFProtocol import *
+from rflib.types.Match import *
+from rflib.types.Option import *
+
+# Messages waiting to be processed per channel, beyond which the listener of
+# that channel stops reading until the queue drains
+INGEST_QUEUE_SIZE = 4096
+
+# Seconds between reports of the queue metrics
+INGEST_REPORT_INTERVAL = 60
+
+# Message classes, in the order they are served
+INGEST_CONTROL = 0
+INGEST_ROUTE = 1
+
+def message_source(channel, from_, msg):
+    """Return the VM or datapath a message comes from. Messages forwarded by
+    the dispatcher of a sharded RFServer all come from RFServer itself, so
+    the sender of the envelope only serves for other messages."""
+    type_ = msg.get_type()
+    if type_ == ROUTE_MOD:
+        return ("vm", msg.get_id())
+    elif type_ in (PORT_REGISTER, VIRTUAL_PLANE_MAP):
+        return ("vm", msg.get_vm_id())
+    elif type_ in (DATAPATH_PORT_REGISTER, DATAPATH_DOWN,
+                   DATAPATH_CONFIG_ACK, FLOW_BATCH_ACK):
+        return ("dp", msg.get_ct_id(), msg.get_dp_id())
+    return (channel, from_)
+
+def route_key(rm):
+    """Key of a route on its datapath: the matches of its RouteMod, other
+    than the ingress points, and its priority."""
+    matches = sorted([(m['type'], str(m['value'])) for m in rm.get_matches()
+                      if m['type'] != RFMT_INGRESS])
+    priority = [str(o['value']) for o in rm.get_options()
+                if o['type'] == RFOT_PRIORITY]
+    return (tuple(matches), tuple(priority))
+
+def coalesce_key(msg):
+    """Key under which a queued message is replaced by a newer one: a
+    RouteMod by the next one for the same route of the same VM.
+
+    A flow is identified on the switch by its match and priority only, and
+    deletions do not name an output port. The latest RouteMod for a route
+    must therefore win whatever its output port: keeping an older deletion
+    for another port would remove the flow the newer addition installs."""
+    if msg.get_type() != ROUTE_MOD:
+        return None
+    return (msg.get_id(),) + route_key(msg)
+
+class ChannelStats:
+    def __init__(self):
+        self.depth = 0
+        self.max_depth = 0
+        self.received = 0
+        self.processed = 0
+        self.coalesced = 0
+        self.blocked = 0
+
+    def __str__(self):
+        return "depth=%d, max_depth=%d, received=%d, processed=%d, " \
+               "coalesced=%d, blocked=%d" % (self.depth, self.max_depth,
+                                             self.received, self.processed,
+                                             self.coalesced, self.blocked)
+
+class IngestPipeline(IPC.IPCMessageProcessor):
+    """Queues the messages received on the IPC channels and hands them to a
+    processor from a single thread.
+
+    Control messages (port and datapath registration, datapath down, ...)
+    are always processed before RouteMods, so a burst of routes does not
+    delay the handling of topology changes. Within each class, the sources
+    of the messages (the VM or datapath they are about) are served in turn,
+    one message each, so one VM cannot starve the others.
+
+    Each channel may hold up to INGEST_QUEUE_SIZE messages. When its queue
+    is full, the listener of the channel blocks, and the messages wait in
+    MongoDB. Messages are never dropped, but a message for which 'coalesce'
+    returns a key replaces the one with the same key still waiting from the
+    same source, keeping its place in the queue. This is used to keep only
+    the latest RouteMod for each route.
+    """
+
+    def __init__(self, processor, coalesce=None, log=None):
+        self.processor = processor
+        self.coalesce = coalesce
+        self.log = log or logging.getLogger("rfserver")
+        self.lock = threading.Lock()
+        self.ready = threading.Condition(self.lock)
+        self.space = threading.Condition(self.lock)
+        # class -> OrderedDict of source -> OrderedDict of key -> message,
+        # with sources in the order they are served
+        self.queues = {INGEST_CONTROL: OrderedDict(),
+                       INGEST_ROUTE: OrderedDict()}
+        self.stats = {}
+        self.seq = 0
+
+    def process(self, from_, to, channel, msg):
+        """Called by the listeners: queue a message, blocking while the queue
+        of its channel is full."""
+        with self.lock:
+            stats = self.stats.setdefault(channel, ChannelStats())
+            stats.received += 1
+            if stats.depth >= INGEST_QUEUE_SIZE:
+                stats.blocked += 1
+                self.log.warning("Ingest queue full, blocking channel %s" %
+                                 channel)
+                while stats.depth >= INGEST_QUEUE_SIZE:
+                    self.space.wait()
+
+            class_ = INGEST_CONTROL
+            key = None
+            if msg.get_type() == ROUTE_MOD:
+                class_ = INGEST_ROUTE
+            if self.coalesce is not None:
+                key = self.coalesce(msg)
+            if key is None:
+                self.seq += 1
+                key = self.seq
+
+            source = self.queues[class_].setdefault(
+                message_source(channel, from_, msg), OrderedDict())
+            if key in source:
+                stats.coalesced += 1
+            else:
+                stats.depth += 1
+                stats.max_depth = max(stats.max_depth, stats.depth)
+            source[key] = (from_, to, channel, msg)
+            self.ready.notify()
+        return True
+
+    def run(self):
+        """Process queued messages forever."""
+        reporter = threading.Thread(target=self._report)
+        reporter.daemon = True
+        reporter.start()
+
+        while True:
+            with self.lock:
+                item = self._next()
+                while item is None:
+                    self.ready.wait()
+                    item = self._next()
+                from_, to, channel, msg = item
+                self.stats[channel].depth -= 1
+                self.stats[channel].processed += 1
+                self.space.notify_all()
+
+            try:
+                self.processor.process(from_, to, channel, msg)
+            except Exception, e:
+                self.log.exception("Error processing message from %s: %s" %
+                                   (from_, e))
+
+    def get_stats(self):
+        """Return a copy of the metrics of each channel."""
+        with self.lock:
+            result = {}
+            for (channel, stats) in self.stats.items():
+                copy = ChannelStats()
+                copy.__dict__.update(stats.__dict__)
+                result[channel] = copy
+            return result
+
+    def _next(self):
+        # Must be called with the lock held
+        for class_ in (INGEST_CONTROL, INGEST_ROUTE):
+            sources = self.queues[class_]
+            if not sources:
+                continue
+            source, messages = sources.popitem(last=False)
+            key, item = messages.popitem(last=False)
+            if messages:
+                # Go to the back of the line
+                sources[source] = messages
+            return item
+        return None
+
+    def _report(self):
+        last = {}
+        while True:
+            time.sleep(INGEST_REPORT_INTERVAL)
+            for (channel, stats) in sorted(self.get_stats().items()):
+                if last.get(channel) != stats.received:
+                    self.log.info("Ingest %s: %s" % (channel, stats))
+                    last[channel] = stats.received
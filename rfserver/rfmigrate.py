@@ -0,0 +1,71 @@
+#!/usr/bin/env python
+#-*- coding:utf-8 -*-
+
+import sys
+import argparse
+
+import pymongo as mongo
+import pymongo.errors
+
+from rflib.defs import *
+from rflib.ipc.MongoIPC import format_address, to_bson_int
+
+TABLES = (RFTABLE_NAME, RFCONFIG_NAME, RFISL_NAME, RFISLCONF_NAME)
+
+def migrate_doc(doc):
+    """Return the fields of a table document written with decimal strings,
+    converted to native integers (None for missing values), as a dict of
+    field: (old, new)."""
+    changes = {}
+    for (k, v) in doc.items():
+        if k == "_id" or not isinstance(v, basestring):
+            continue
+        if v == "":
+            changes[k] = (v, None)
+        elif not k.endswith("eth_addr"):
+            changes[k] = (v, to_bson_int(v, 64))
+    return changes
+
+def migrate_table(collection, dry_run):
+    """Convert the documents of a collection. Each field is only updated if
+    it still holds the value that was read, so that changes RFServer makes
+    in the meantime are not overwritten."""
+    converted = 0
+    total = 0
+    for doc in collection.find():
+        total += 1
+        changes = migrate_doc(doc)
+        if not changes:
+            continue
+        converted += 1
+        if dry_run:
+            continue
+        for (k, (old, new)) in changes.items():
+            collection.update({"_id": doc["_id"], k: old},
+                              {"$set": {k: new}})
+    return (converted, total)
+
+if __name__ == "__main__":
+    description = 'Convert the RFServer tables to store ids and ports as ' \
+                  'native integers. RFServer reads both formats, so this ' \
+                  'can be run while it is running. Messages in the IPC ' \
+                  'channels are short-lived and are not converted.'
+    epilog = 'Report bugs to: https://github.com/CPqD/RouteFlow/issues'
+
+    parser = argparse.ArgumentParser(description=description, epilog=epilog)
+    parser.add_argument('-a', '--address', default=MONGO_ADDRESS,
+                        help='MongoDB address (default: %s)' % MONGO_ADDRESS)
+    parser.add_argument('-n', '--dry-run', action='store_true',
+                        help='only report what would be converted')
+
+    args = parser.parse_args()
+    try:
+        connection = mongo.Connection(*format_address(args.address))
+    except mongo.errors.PyMongoError, e:
+        sys.exit("Error connecting to MongoDB: %s" % e)
+
+    db = connection[MONGO_DB_NAME]
+    for name in TABLES:
+        converted, total = migrate_table(db[name], args.dry_run)
+        print("%s: %d of %d entries %s" % (name, converted, total,
+              "to convert" if args.dry_run else "converted"))
@@ -6,7 +6,9 @@ import logging
 import binascii
 import threading
 import time
+import copy
 import argparse
+import multiprocessing
 
 from bson.binary import Binary
 
@@ -18,42 +20,93 @@ from rflib.defs import *
 from rflib.types.Match import *
 from rflib.types.Action import *
 from rflib.types.Option import *
+from rflib.dpconfig import *
 
 from rftable import *
+from rfshard import *
+from rfingest import *
 
 # Register actions
 REGISTER_IDLE = 0
 REGISTER_ASSOCIATED = 1
 REGISTER_ISL = 2
 
+# Seconds to wait for a datapath to acknowledge its configuration before
+# sending the routes held for it anyway
+CONFIG_ACK_TIMEOUT = 5
+
+# Seconds given to clients to confirm the routes of a datapath that has been
+# resynchronized, before the others are removed
+RESYNC_TIME = 10
+
+def make_log(name):
+    log = logging.getLogger("rfserver")
+    log.setLevel(logging.INFO)
+    ch = logging.StreamHandler()
+    ch.setLevel(logging.INFO)
+    ch.setFormatter(logging.Formatter("%(levelname)s:" + name +
+                                      ":%(message)s"))
+    log.addHandler(ch)
+    return log
+
 class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
-    def __init__(self, configfile, islconffile):
-        self.rftable = RFTable()
-        self.isltable = RFISLTable()
-        self.config = RFConfig(configfile)
-        self.islconf = RFISLConf(islconffile)
+    def __init__(self, configfile, islconffile, shard=None, shards=None,
+                 resync=None):
+        # When sharded, this instance only holds and handles the VMs and
+        # datapaths that 'shards' assigns to 'shard'
+        owner = None
+        self.id = RFSERVER_ID
+        if shards is not None:
+            owner = lambda entry: shards.shard_for_entry(entry) == shard
+            self.id = worker_id(shard)
+
+        self.rftable = RFTable(owner=owner)
+        self.isltable = RFISLTable(owner=owner)
+        self.config = RFConfig(configfile, owner=owner)
+        self.islconf = RFISLConf(islconffile, owner=owner)
         self.configured_rfvs = []
+        self.configured_dps = set()
+        # Datapaths being configured: (ct_id, dp_id) -> (xid, timer, held
+        # RouteMods)
+        self.pending_configs = {}
+        self.config_xid = 0
+        self.config_lock = threading.Lock()
+        # In resync mode, seconds given to clients to confirm routes after a
+        # datapath comes up, or None to clear the flow table instead
+        self.resync = resync
+        # Routes sent to each datapath, replayed when it comes back up in
+        # resync mode: (ct_id, dp_id) -> {route key: RouteMod dict}
+        self.dp_routes = {}
+        # Datapaths being resynchronized: (ct_id, dp_id) -> (xid, timer,
+        # keys of the routes confirmed since)
+        self.resyncs = {}
+        self.resync_lock = threading.Lock()
+        # Flows confirmed by the proxies: (ct_id, dp_id) -> [installed,
+        # failed]
+        self.installed_flows = {}
+        # Ingress matches per (ct_id, dp_id, out_port, isl), valid as long as
+        # the tables stay at ingress_generation
+        self.ingress_cache = {}
+        self.ingress_generation = None
         # Logging
-        self.log = logging.getLogger("rfserver")
-        self.log.setLevel(logging.INFO)
-        ch = logging.StreamHandler()
-        ch.setLevel(logging.INFO)
-        ch.setFormatter(logging.Formatter(logging.BASIC_FORMAT))
-        self.log.addHandler(ch)
+        self.log = make_log(self.id)
 
         self.ipc = MongoIPC.MongoIPCMessageService(MONGO_ADDRESS,
                                                    MONGO_DB_NAME,
-                                                   RFSERVER_ID,
+                                                   self.id,
                                                    threading.Thread,
                                                    time.sleep)
-        self.ipc.listen(RFCLIENT_RFSERVER_CHANNEL, self, self, False)
-        self.ipc.listen(RFSERVER_RFPROXY_CHANNEL, self, self, True)
+        # Messages from both channels are queued and processed one at a time
+        self.pipeline = IngestPipeline(self, coalesce_key, self.log)
+        self.ipc.listen(RFCLIENT_RFSERVER_CHANNEL, self, self.pipeline, False)
+        self.ipc.listen(RFSERVER_RFPROXY_CHANNEL, self, self.pipeline, False)
+        self.pipeline.run()
 
     def process(self, from_, to, channel, msg):
         type_ = msg.get_type()
         if type_ == PORT_REGISTER:
             self.register_vm_port(msg.get_vm_id(), msg.get_vm_port(),
-                                  msg.get_hwaddress())
+                                  msg.get_hwaddress(), msg.get_vrf())
         elif type_ == ROUTE_MOD:
             self.register_route_mod(msg)
         elif type_ == DATAPATH_PORT_REGISTER:
@@ -62,6 +115,12 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                                   msg.get_dp_port())
         elif type_ == DATAPATH_DOWN:
             self.set_dp_down(msg.get_ct_id(), msg.get_dp_id())
+        elif type_ == DATAPATH_CONFIG_ACK:
+            self.end_dp_config(msg.get_ct_id(), msg.get_dp_id(),
+                               msg.get_xid(), True)
+        elif type_ == FLOW_BATCH_ACK:
+            self.flow_batch_installed(msg.get_ct_id(), msg.get_dp_id(),
+                                      msg.get_flows(), msg.get_errors())
         elif type_ == VIRTUAL_PLANE_MAP:
             self.map_port(msg.get_vm_id(), msg.get_vm_port(),
                           msg.get_vs_id(), msg.get_vs_port())
@@ -70,7 +129,19 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
         return True
 
     # Port register methods
-    def register_vm_port(self, vm_id, vm_port, eth_addr):
+    def register_vm_port(self, vm_id, vm_port, eth_addr, vrf):
+        # A port already known is registered again when its address or VRF
+        # changes, which only needs the entry updated.
+        entry = self.rftable.get_entry_by_vm_port(vm_id, vm_port)
+        if entry is not None and entry.get_status() != RFENTRY_IDLE_VM_PORT:
+            entry.eth_addr = eth_addr
+            entry.vrf = vrf
+            self.rftable.set_entry(entry)
+            self.log.info("Updating client port (vm_id=%s, vm_port=%i, "
+                          "eth_addr=%s, vrf=%i)" % (format_id(vm_id), vm_port,
+                                                    eth_addr, vrf))
+            return
+
         action = None
         config_entry = self.config.get_config_for_vm_port(vm_id, vm_port)
         if config_entry is None:
@@ -90,12 +161,12 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
         # Apply action
         if action == REGISTER_IDLE:
             self.rftable.set_entry(RFEntry(vm_id=vm_id, vm_port=vm_port,
-                                           eth_addr=eth_addr))
+                                           eth_addr=eth_addr, vrf=vrf))
             self.log.info("Registering client port as idle (vm_id=%s, "
                           "vm_port=%i, eth_addr=%s)" % (format_id(vm_id),
                                                         vm_port, eth_addr))
         elif action == REGISTER_ASSOCIATED:
-            entry.associate(vm_id, vm_port, eth_addr=eth_addr)
+            entry.associate(vm_id, vm_port, eth_addr=eth_addr, vrf=vrf)
             self.rftable.set_entry(entry)
             self.config_vm_port(vm_id, vm_port)
             self.log.info("Registering client port and associating to "
@@ -146,13 +217,10 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                     action_output.set_value(entry.dp_port)
                     rm.actions[i] = action_output.to_dict()
 
-                entries = self.rftable.get_entries(dp_id=entry.dp_id,
-                                                   ct_id=entry.ct_id)
-                entries.extend(self.isltable.get_entries(dp_id=entry.dp_id,
-                                                         ct_id=entry.ct_id))
                 rm.add_option(Option.CT_ID(entry.ct_id))
 
-                self._send_rm_with_matches(rm, entry.dp_port, entries)
+                self._send_rm_with_matches(rm, entry.ct_id, entry.dp_id,
+                                           entry.dp_port, True)
 
                 remote_dps = self.isltable.get_entries(rem_ct=entry.ct_id,
                                                        rem_id=entry.dp_id)
@@ -165,9 +233,8 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                         rm.add_action(Action.SET_ETH_SRC(r.eth_addr))
                         rm.add_action(Action.SET_ETH_DST(r.rem_eth_addr))
                         rm.add_action(Action.OUTPUT(r.dp_port))
-                        entries = self.rftable.get_entries(dp_id=r.dp_id,
-                                                           ct_id=r.ct_id)
-                        self._send_rm_with_matches(rm, r.dp_port, entries)
+                        self._send_rm_with_matches(rm, r.ct_id, r.dp_id,
+                                                   r.dp_port, False)
 
                 return
 
@@ -175,17 +242,47 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
         self.log.info("Received RouteMod with no Output Port - Dropping "
                       "(vm_id=%s)" % (format_id(vm_id)))
 
-    def _send_rm_with_matches(self, rm, out_port, entries):
-        #send entries matching external ports
-        for entry in entries:
-            if out_port != entry.dp_port:
-                if entry.get_status() == RFENTRY_ACTIVE or \
-                   entry.get_status() == RFISL_ACTIVE:
-                    rm.add_match(Match.ETHERNET(entry.eth_addr))
-                    rm.add_match(Match.IN_PORT(entry.dp_port))
-                    self.ipc.send(RFSERVER_RFPROXY_CHANNEL,
-                                  str(entry.ct_id), rm)
-                    rm.set_matches(rm.get_matches()[:-2])
+    def _send_rm_with_matches(self, rm, ct_id, dp_id, out_port, isl):
+        # Send a single RouteMod matching traffic from all the external ports
+        # of the route's VRF
+        vrf = 0
+        for match in rm.get_matches():
+            if match['type'] == RFMT_VRF:
+                vrf = Match.from_dict(match).get_value()
+        match = self._ingress_match(ct_id, dp_id, out_port, isl, vrf)
+        if match is not None:
+            rm.add_match(match)
+            if self.resync is not None:
+                self.record_route(rm, ct_id, dp_id)
+            if not self.hold_route_mod(rm, ct_id, dp_id):
+                self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), rm)
+            rm.set_matches(rm.get_matches()[:-1])
+
+    def _ingress_match(self, ct_id, dp_id, out_port, isl, vrf):
+        """Return the match for traffic entering datapath dp_id through any
+        active port of the given VRF other than out_port, including ISL ports
+        if isl is set. ISL ports carry traffic untagged and only count for the
+        main routing table (VRF 0). Returns None if there is no such port."""
+        generation = (self.rftable.generation, self.isltable.generation)
+        if generation != self.ingress_generation:
+            self.ingress_cache = {}
+            self.ingress_generation = generation
+
+        key = (ct_id, dp_id, out_port, isl, vrf)
+        if key in self.ingress_cache:
+            return self.ingress_cache[key]
+
+        entries = [entry for entry in self.rftable.get_dp_entries(ct_id, dp_id)
+                   if entry.get_vrf() == vrf]
+        if isl and vrf == 0:
+            entries.extend(self.isltable.get_dp_entries(ct_id, dp_id))
+        points = [(entry.eth_addr, entry.dp_port) for entry in entries
+                  if entry.dp_port != out_port and
+                     entry.get_status() in (RFENTRY_ACTIVE, RFISL_ACTIVE)]
+
+        match = Match.INGRESS(points) if points else None
+        self.ingress_cache[key] = match
+        return match
 
     # DatapathPortRegister methods
     def register_dp_port(self, ct_id, dp_id, dp_port):
@@ -285,53 +382,7 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                                                 entry.dp_port))
 
     def send_datapath_config_message(self, ct_id, dp_id, operation_id):
-        rm = RouteMod(RMT_ADD, dp_id)
-
-        if operation_id == DC_CLEAR_FLOW_TABLE:
-            rm.set_mod(RMT_DELETE)
-            rm.add_option(Option.PRIORITY(PRIORITY_LOWEST))
-        elif operation_id == DC_DROP_ALL:
-            rm.add_option(Option.PRIORITY(PRIORITY_LOWEST + PRIORITY_BAND))
-            # No action specifies discard
-            pass
-        else:
-            rm.add_option(Option.PRIORITY(PRIORITY_HIGH))
-            if operation_id == DC_RIPV2:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_UDP))
-                rm.add_match(Match.IPV4(IPADDR_RIPv2, IPV4_MASK_EXACT))
-            elif operation_id == DC_OSPF:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_OSPF))
-            elif operation_id == DC_ARP:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_ARP))
-            elif operation_id == DC_ICMP:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_ICMP))
-            elif operation_id == DC_ICMPV6:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IPV6))
-                rm.add_match(Match.NW_PROTO(IPPROTO_ICMPV6))
-            elif operation_id == DC_BGP_PASSIVE:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
-                rm.add_match(Match.TP_DST(TPORT_BGP))
-            elif operation_id == DC_BGP_ACTIVE:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
-                rm.add_match(Match.TP_SRC(TPORT_BGP))
-            elif operation_id == DC_LDP_PASSIVE:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
-                rm.add_match(Match.TP_DST(TPORT_LDP))
-            elif operation_id == DC_LDP_ACTIVE:
-                rm.add_match(Match.ETHERTYPE(ETHERTYPE_IP))
-                rm.add_match(Match.NW_PROTO(IPPROTO_TCP))
-                rm.add_match(Match.TP_SRC(TPORT_LDP))
-            elif operation_id == DC_VM_INFO:
-                rm.add_match(Match.ETHERTYPE(RF_ETH_PROTO))
-            rm.add_action(Action.CONTROLLER())
-
-        rm.add_option(Option.CT_ID(ct_id))
+        rm = config_routemod(ct_id, dp_id, operation_id)
         self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), rm)
 
     def config_dp(self, ct_id, dp_id):
@@ -341,38 +392,189 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
             self.configured_rfvs.append(dp_id)
             self.send_datapath_config_message(ct_id, dp_id, DC_ALL)
             self.log.info("Configuring RFVS (dp_id=%s)" % format_id(dp_id))
-        elif self.rftable.is_dp_registered(ct_id, dp_id) or \
-             self.isltable.is_dp_registered(ct_id, dp_id):
-            # Configure a normal switch. Clear the tables and install default
-            # flows.
-            self.send_datapath_config_message(ct_id, dp_id,
-                                              DC_CLEAR_FLOW_TABLE)
-            # TODO: enforce order: clear should always be executed first
-            self.send_datapath_config_message(ct_id, dp_id, DC_DROP_ALL)
-            self.send_datapath_config_message(ct_id, dp_id, DC_OSPF)
-            self.send_datapath_config_message(ct_id, dp_id, DC_BGP_PASSIVE)
-            self.send_datapath_config_message(ct_id, dp_id, DC_BGP_ACTIVE)
-            self.send_datapath_config_message(ct_id, dp_id, DC_RIPV2)
-            self.send_datapath_config_message(ct_id, dp_id, DC_ARP)
-            self.send_datapath_config_message(ct_id, dp_id, DC_ICMP)
-            self.send_datapath_config_message(ct_id, dp_id, DC_ICMPV6)
-            self.send_datapath_config_message(ct_id, dp_id, DC_LDP_PASSIVE)
-            self.send_datapath_config_message(ct_id, dp_id, DC_LDP_ACTIVE)
-            self.log.info("Configuring datapath (dp_id=%s)" % format_id(dp_id))
+        elif (ct_id, dp_id) not in self.configured_dps and \
+             (self.rftable.is_dp_registered(ct_id, dp_id) or
+              self.isltable.is_dp_registered(ct_id, dp_id)):
+            # Configure a normal switch: clear the tables, or read them in
+            # resync mode, and install default flows in a single transaction.
+            # Routes for this switch are held until the proxy acknowledges it.
+            operations = DATAPATH_BRINGUP
+            if self.resync is not None:
+                operations = RESYNC_BRINGUP
+            self.configured_dps.add((ct_id, dp_id))
+            with self.config_lock:
+                self.config_xid += 1
+                xid = self.config_xid
+                timer = threading.Timer(CONFIG_ACK_TIMEOUT,
+                                        self.end_dp_config,
+                                        (ct_id, dp_id, xid, False))
+                timer.daemon = True
+                self.pending_configs[(ct_id, dp_id)] = (xid, timer, [])
+            timer.start()
+            msg = DatapathConfig(ct_id=ct_id, dp_id=dp_id, xid=xid,
+                                 operations=operations_to_mask(operations))
+            self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), msg)
+            self.log.info("Configuring datapath (dp_id=%s, xid=%d)" %
+                          (format_id(dp_id), xid))
         return is_rfvs(dp_id)
 
+    def end_dp_config(self, ct_id, dp_id, xid, acked):
+        """Finish the configuration transaction 'xid' of a datapath, and send
+        the RouteMods held while it was in progress."""
+        with self.config_lock:
+            pending = self.pending_configs.get((ct_id, dp_id))
+            if pending is None or pending[0] != xid:
+                return
+            del self.pending_configs[(ct_id, dp_id)]
+        pending[1].cancel()
+
+        if acked:
+            self.log.info("Datapath configured (dp_id=%s, xid=%d)" %
+                          (format_id(dp_id), xid))
+        else:
+            self.log.warning("No configuration ack from datapath, sending "
+                             "routes anyway (dp_id=%s, xid=%d)" %
+                             (format_id(dp_id), xid))
+        if self.resync is not None:
+            self.start_resync(ct_id, dp_id, xid)
+        for data in pending[2]:
+            rm = RouteMod()
+            rm.from_dict(data)
+            self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), rm)
+
+    # Resync methods
+    def record_route(self, rm, ct_id, dp_id):
+        """Keep track of a RouteMod sent to a datapath, so that its routes
+        can be replayed when it comes back up."""
+        key = route_key(rm)
+        with self.resync_lock:
+            routes = self.dp_routes.setdefault((ct_id, dp_id), {})
+            if rm.get_mod() == RMT_DELETE:
+                routes.pop(key, None)
+            else:
+                routes[key] = copy.deepcopy(rm.to_dict())
+            resync = self.resyncs.get((ct_id, dp_id))
+            if resync is not None:
+                resync[2].add(key)
+
+    def start_resync(self, ct_id, dp_id, xid):
+        """Replay the routes last sent to a datapath that has come back up.
+
+        The proxy has loaded the flows left on the switch, so only the routes
+        that are missing or have changed are installed. Clients are given
+        'resync' seconds to confirm each route, after which end_resync()
+        removes the others."""
+        timer = threading.Timer(self.resync, self.end_resync,
+                                (ct_id, dp_id, xid))
+        timer.daemon = True
+        with self.resync_lock:
+            routes = self.dp_routes.get((ct_id, dp_id), {}).values()
+            old = self.resyncs.get((ct_id, dp_id))
+            self.resyncs[(ct_id, dp_id)] = (xid, timer, set())
+        if old is not None:
+            old[1].cancel()
+        timer.start()
+
+        for data in routes:
+            rm = RouteMod()
+            rm.from_dict(data)
+            self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), rm)
+        self.log.info("Resynchronizing datapath (dp_id=%s, routes=%d)" %
+                      (format_id(dp_id), len(routes)))
+
+    def end_resync(self, ct_id, dp_id, xid):
+        """Remove the routes of a datapath that have not been confirmed
+        since it was resynchronized, then have the proxy remove the flows
+        left on the switch that nobody sent."""
+        with self.resync_lock:
+            resync = self.resyncs.get((ct_id, dp_id))
+            if resync is None or resync[0] != xid:
+                return
+            del self.resyncs[(ct_id, dp_id)]
+            routes = self.dp_routes.get((ct_id, dp_id), {})
+            stale = [routes.pop(key) for key in routes.keys()
+                     if key not in resync[2]]
+
+        for data in stale:
+            rm = RouteMod()
+            rm.from_dict(data)
+            rm.set_mod(RMT_DELETE)
+            rm.set_actions(None)
+            self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), rm)
+
+        with self.config_lock:
+            self.config_xid += 1
+            xid = self.config_xid
+        msg = DatapathConfig(ct_id=ct_id, dp_id=dp_id, xid=xid,
+                             operations=operations_to_mask((DC_SWEEP,)))
+        self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(ct_id), msg)
+        self.log.info("Datapath resynchronized, removing %d stale routes "
+                      "(dp_id=%s)" % (len(stale), format_id(dp_id)))
+
+    def flow_batch_installed(self, ct_id, dp_id, flows, errors):
+        counts = self.installed_flows.setdefault((ct_id, dp_id), [0, 0])
+        counts[0] += flows - errors
+        counts[1] += errors
+        if errors > 0:
+            self.log.warning("Datapath failed to install %d of %d flows "
+                             "(dp_id=%s)" % (errors, flows, format_id(dp_id)))
+        else:
+            self.log.debug("Datapath installed %d flows (dp_id=%s)" %
+                           (flows, format_id(dp_id)))
+
+    def hold_route_mod(self, rm, ct_id, dp_id):
+        """Hold a RouteMod if the datapath is being configured. Returns True
+        if it was held, in which case it is sent once configuration ends."""
+        with self.config_lock:
+            pending = self.pending_configs.get((ct_id, dp_id))
+            if pending is None:
+                return False
+            pending[2].append(copy.deepcopy(rm.to_dict()))
+        return True
+
     # DatapathDown methods
     def set_dp_down(self, ct_id, dp_id):
+        self.configured_dps.discard((ct_id, dp_id))
+        self.installed_flows.pop((ct_id, dp_id), None)
+        with self.config_lock:
+            pending = self.pending_configs.pop((ct_id, dp_id), None)
+        if pending is not None:
+            # The routes held will be lost with the datapath anyway
+            pending[1].cancel()
+        with self.resync_lock:
+            resync = self.resyncs.pop((ct_id, dp_id), None)
+            if self.resync is None:
+                self.dp_routes.pop((ct_id, dp_id), None)
+        if resync is not None:
+            resync[1].cancel()
+
+        # Put every port registered in that datapath down at once, leaving
+        # only the associated VM ports, and reset those VM ports with one
+        # batch of messages per VM
+        updated, removed, resets = [], [], {}
         for entry in self.rftable.get_dp_entries(ct_id, dp_id):
-            # For every port registered in that datapath, put it down
-            self.set_dp_port_down(entry.ct_id, entry.dp_id, entry.dp_port)
+            if entry.vm_id is None:
+                removed.append(entry)
+                continue
+            resets.setdefault(entry.vm_id, []).append(entry.vm_port)
+            entry.make_idle(RFENTRY_IDLE_VM_PORT)
+            updated.append(entry)
+        self.rftable.update_many(updated, removed)
+
+        isl_entries = {}
         for entry in self.isltable.get_dp_entries(ct_id, dp_id):
             entry.make_idle(RFISL_IDLE_REMOTE)
-            self.isltable.set_entry(entry)
+            isl_entries[entry.id] = entry
         for entry in self.isltable.get_entries(rem_ct=ct_id, rem_id=dp_id):
+            entry = isl_entries.setdefault(entry.id, entry)
             entry.make_idle(RFISL_IDLE_DP_PORT)
-            self.isltable.set_entry(entry)
-        self.log.info("Datapath down (dp_id=%s)" % format_id(dp_id))
+        self.isltable.update_many(isl_entries.values())
+
+        for (vm_id, vm_ports) in resets.items():
+            self.reset_vm_ports(vm_id, vm_ports)
+        self.log.info("Datapath down (dp_id=%s, ports=%d, isl_ports=%d)" %
+                      (format_id(dp_id), len(updated) + len(removed),
+                       len(isl_entries)))
 
     def set_dp_port_down(self, ct_id, dp_id, dp_port):
         entry = self.rftable.get_entry_by_dp_port(ct_id, dp_id, dp_port)
@@ -388,12 +590,17 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                            (format_id(dp_id), dp_port))
 
     def reset_vm_port(self, vm_id, vm_port):
+        self.reset_vm_ports(vm_id, [vm_port])
+
+    def reset_vm_ports(self, vm_id, vm_ports):
         if vm_id is None:
             return
-        self.ipc.send(RFCLIENT_RFSERVER_CHANNEL, str(vm_id),
-                      PortConfig(vm_id=vm_id, vm_port=vm_port, operation_id=1))
-        self.log.info("Resetting client port (vm_id=%s, vm_port=%i)" %
-                      (format_id(vm_id), vm_port))
+        msgs = [PortConfig(vm_id=vm_id, vm_port=vm_port, operation_id=1)
+                for vm_port in vm_ports]
+        self.ipc.send_many(RFCLIENT_RFSERVER_CHANNEL, str(vm_id), msgs)
+        self.log.info("Resetting client ports (vm_id=%s, vm_ports=%s)" %
+                      (format_id(vm_id),
+                       ",".join([str(port) for port in vm_ports])))
 
     # PortMap methods
     def map_port(self, vm_id, vm_port, vs_id, vs_port):
@@ -423,9 +630,32 @@ if __name__ == "__main__":
                         help='VM-VS-DP mapping configuration file')
     parser.add_argument('-i', '--islconfig',
                         help='ISL mapping configuration file')
+    parser.add_argument('-r', '--resync', type=int, nargs='?',
+                        const=RESYNC_TIME, metavar='SECONDS',
+                        help='resynchronize the flow table of a datapath '
+                             'that comes up instead of clearing it, giving '
+                             'clients SECONDS to confirm its routes '
+                             '(default: %d)' % RESYNC_TIME)
+    parser.add_argument('-w', '--workers', type=int, default=1,
+                        help='number of worker processes to shard VMs and '
+                             'datapaths across (default: 1)')
 
     args = parser.parse_args()
     try:
-        RFServer(args.configfile, args.islconfig)
+        if args.workers > 1:
+            shards = ShardMap(args.workers, read_config(args.configfile),
+                              read_islconf(args.islconfig))
+            for shard in range(args.workers):
+                worker = multiprocessing.Process(target=RFServer,
+                                                 args=(args.configfile,
+                                                       args.islconfig,
+                                                       shard, shards,
+                                                       args.resync))
+                worker.daemon = True
+                worker.start()
+            make_log(RFSERVER_ID)
+            RFDispatcher(shards)
+        else:
+            RFServer(args.configfile, args.islconfig, resync=args.resync)
     except IOError:
         sys.exit("Error opening file: {}".format(args.configfile))
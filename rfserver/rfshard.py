@@ -0,0 +1,146 @@
+import bisect
+import hashlib
+import logging
+import threading
+import time
+
+import rflib.ipc.IPC as IPC
+import rflib.ipc.MongoIPC as MongoIPC
+from rflib.ipc.RFProtocol import *
+from rflib.ipc.RFProtocolFactory import RFProtocolFactory
+from rflib.defs import *
+
+# Points each worker gets on the hash ring
+VNODES = 64
+
+def worker_id(shard):
+    """IPC id of the rfserver worker that owns 'shard'."""
+    return "%s.%d" % (RFSERVER_ID, shard)
+
+def hash_key(key):
+    return int(hashlib.md5(key).hexdigest()[:16], 16)
+
+class ShardMap:
+    """Assigns datapaths and VMs to rfserver workers.
+
+    Datapaths are placed on a consistent hash ring by (ct_id, dp_id), so that
+    changing the number of workers only moves a fraction of them. A VM goes
+    with the datapaths its ports are mapped to in the configuration.
+
+    RFServer needs to see both ends of a VM-datapath association or of an
+    ISL at once, so datapaths that share a VM, or that are linked by an ISL,
+    are grouped and the whole group is placed by its lowest datapath. This
+    keeps every table lookup within one worker.
+
+    The map is built from the configuration files only, so every process
+    computes the same one without sharing any state.
+    """
+
+    def __init__(self, shards, config=[], islconf=[]):
+        self.shards = shards
+        self.ring = sorted([(hash_key("%d-%d" % (shard, vnode)), shard)
+                            for shard in range(shards)
+                            for vnode in range(VNODES)])
+        self.points = [point for (point, shard) in self.ring]
+
+        # Union-find over ("dp", ct_id, dp_id) and ("vm", vm_id) nodes
+        self.parent = {}
+        for entry in config:
+            self._union(("vm", entry.vm_id), ("dp", entry.ct_id, entry.dp_id))
+        for entry in islconf:
+            self._union(("dp", entry.ct_id, entry.dp_id),
+                        ("dp", entry.rem_ct, entry.rem_id))
+            self._union(("vm", entry.vm_id), ("dp", entry.ct_id, entry.dp_id))
+
+        # Place every group by its lowest datapath, or by its VM if it has
+        # no datapath
+        groups = {}
+        for node in self.parent:
+            root = self._find(node)
+            if root not in groups or node < groups[root]:
+                groups[root] = node
+        self.placement = {}
+        for node in self.parent:
+            self.placement[node] = self._ring_lookup(groups[self._find(node)])
+
+    def shard_for_dp(self, ct_id, dp_id):
+        node = ("dp", ct_id, dp_id)
+        if node in self.placement:
+            return self.placement[node]
+        return self._ring_lookup(node)
+
+    def shard_for_vm(self, vm_id):
+        node = ("vm", vm_id)
+        if node in self.placement:
+            return self.placement[node]
+        return self._ring_lookup(node)
+
+    def shard_for_entry(self, entry):
+        """Shard owning a table entry: the one of its datapath, or of its VM
+        while it has no datapath."""
+        if entry.dp_id is not None:
+            return self.shard_for_dp(entry.ct_id, entry.dp_id)
+        if getattr(entry, "rem_id", None) is not None:
+            return self.shard_for_dp(entry.rem_ct, entry.rem_id)
+        return self.shard_for_vm(entry.vm_id)
+
+    def shard_for_msg(self, msg):
+        """Shard that must process an IPC message sent to RFServer, or None
+        if the message is not for RFServer."""
+        type_ = msg.get_type()
+        if type_ == ROUTE_MOD:
+            return self.shard_for_vm(msg.get_id())
+        elif type_ in (PORT_REGISTER, VIRTUAL_PLANE_MAP):
+            return self.shard_for_vm(msg.get_vm_id())
+        elif type_ in (DATAPATH_PORT_REGISTER, DATAPATH_DOWN,
+                       DATAPATH_CONFIG_ACK, FLOW_BATCH_ACK):
+            return self.shard_for_dp(msg.get_ct_id(), msg.get_dp_id())
+        return None
+
+    def _ring_lookup(self, node):
+        if node[0] == "dp":
+            key = "dp:%d:%x" % (node[1], node[2])
+        else:
+            key = "vm:%x" % node[1]
+        i = bisect.bisect(self.points, hash_key(key)) % len(self.ring)
+        return self.ring[i][1]
+
+    def _find(self, node):
+        self.parent.setdefault(node, node)
+        while self.parent[node] != node:
+            self.parent[node] = self.parent[self.parent[node]]
+            node = self.parent[node]
+        return node
+
+    def _union(self, a, b):
+        a, b = self._find(a), self._find(b)
+        if a != b:
+            self.parent[max(a, b)] = min(a, b)
+
+
+class RFDispatcher(IPC.IPCMessageProcessor):
+    """Receives the messages sent to RFServer and forwards each one to the
+    worker owning its VM or datapath. Workers reply to clients and proxies
+    directly."""
+
+    def __init__(self, shards):
+        self.shards = shards
+        self.log = logging.getLogger("rfserver")
+
+        self.ipc = MongoIPC.MongoIPCMessageService(MONGO_ADDRESS,
+                                                   MONGO_DB_NAME,
+                                                   RFSERVER_ID,
+                                                   threading.Thread,
+                                                   time.sleep)
+        self.log.info("Dispatching to %d workers" % shards.shards)
+        self.ipc.listen(RFCLIENT_RFSERVER_CHANNEL, RFProtocolFactory(), self,
+                        False)
+        self.ipc.listen(RFSERVER_RFPROXY_CHANNEL, RFProtocolFactory(), self,
+                        True)
+
+    def process(self, from_, to, channel, msg):
+        shard = self.shards.shard_for_msg(msg)
+        if shard is None:
+            return False
+        self.ipc.send(channel, worker_id(shard), msg)
+        return True
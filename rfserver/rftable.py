@@ -1,8 +1,15 @@
+import copy
+import time
+import atexit
+import logging
+import threading
+
 import pymongo as mongo
+import pymongo.errors
 import bson
 
 from rflib.defs import *
-from rflib.ipc.MongoIPC import format_address
+from rflib.ipc.MongoIPC import format_address, to_bson_int, from_bson_int
 
 RFENTRY_IDLE_VM_PORT = 1
 RFENTRY_IDLE_DP_PORT = 2
@@ -12,6 +19,11 @@ RFISL_IDLE_DP_PORT = 5
 RFISL_IDLE_REMOTE = 6
 RFISL_ACTIVE = 7
 
+# Seconds that changes are held in memory before being written to MongoDB
+WRITE_BEHIND_DELAY = 0.5
+
+log = logging.getLogger("rfserver")
+
 RFENTRY = 0
 RFCONFIGENTRY = 1
 RFISLCONFENTRY = 2
@@ -30,32 +42,187 @@ class MongoTableEntryFactory:
             return RFISLConfEntry()
 
 class MongoTable:
-    def __init__(self, address, name, entry_type):
+    """Table of entries kept in memory and written back to MongoDB.
+
+    All entries are loaded when the table is created, and lookups are served
+    from memory. Queries on one of the field tuples listed in 'indexes' (or on
+    a superset of one) use a hash index; any other query scans the table.
+
+    Changes are applied to memory immediately and written to MongoDB by a
+    background thread every WRITE_BEHIND_DELAY seconds, so the collection is
+    only eventually consistent with the table. Entries handed out are copies:
+    changes to an entry only take effect once it is passed to set_entry.
+
+    'generation' is incremented on every change, so that data derived from
+    the table can be cached until it changes.
+
+    If 'owner' is given, only the entries from MongoDB for which it returns
+    True are loaded. This lets each rfserver worker hold its own shard.
+    """
+
+    indexes = ()
+
+    def __init__(self, address, name, entry_type, owner=None):
         self.address = format_address(address)
         self.connection = mongo.Connection(*self.address)
         self.data = self.connection[MONGO_DB_NAME][name]
         self.entry_type = entry_type
 
-    def get_entries(self, **kwargs):
-        for (k, v) in kwargs.items():
-            kwargs[k] = str(v)
-        results = self.data.find(kwargs)
-        entries = []
-        for result in results:
+        self.lock = threading.Lock()
+        self.generation = 0
+        self.entries = {}
+        self.order = {}
+        self.next_order = 0
+        self.index = {}
+        for fields in self.indexes:
+            self.index[fields] = {}
+
+        # Writes not yet made to MongoDB: entry id -> document to save, or
+        # None to remove it.
+        self.pending = {}
+        self.pending_clear = False
+        self.pending_cond = threading.Condition(self.lock)
+        self.write_lock = threading.Lock()
+
+        for result in self.data.find():
             entry = MongoTableEntryFactory.make(self.entry_type)
             entry.from_dict(result)
-            entries.append(entry)
-        return entries
+            if owner is None or owner(entry):
+                self._add(entry)
+
+        writer = threading.Thread(target=self._write_behind)
+        writer.daemon = True
+        writer.start()
+        atexit.register(self.flush)
+
+    def get_entries(self, **kwargs):
+        # A query on a missing value never matched an entry in MongoDB
+        for v in kwargs.values():
+            if v is None:
+                return []
+
+        with self.lock:
+            candidates = self._candidates(kwargs)
+            results = []
+            for entry in candidates:
+                for (k, v) in kwargs.items():
+                    if getattr(entry, k) != v:
+                        break
+                else:
+                    results.append(entry)
+            if len(results) > 1:
+                results.sort(key=lambda entry: self.order[entry.id])
+            return [copy.copy(entry) for entry in results]
 
     def set_entry(self, entry):
-        # TODO: enforce (*_id, *_port) uniqueness restriction
-        entry.id = self.data.save(entry.to_dict())
+        self.update_many([entry])
 
     def remove_entry(self, entry):
-        self.data.remove(entry.id)
+        self.update_many([], [entry])
+
+    def update_many(self, entries, removed=[]):
+        """Save 'entries' and remove 'removed' as a single change to the
+        table."""
+        # TODO: enforce (*_id, *_port) uniqueness restriction
+        for entry in entries:
+            if entry.id is None:
+                entry.id = bson.ObjectId()
+        with self.lock:
+            for entry in entries:
+                self._remove(entry.id)
+                self._add(copy.copy(entry))
+                self.pending[entry.id] = entry.to_dict()
+            for entry in removed:
+                self._remove(entry.id)
+                self.pending[entry.id] = None
+            self.generation += 1
+            self.pending_cond.notify()
 
     def clear(self):
-        self.data.remove()
+        with self.lock:
+            self.entries.clear()
+            self.order.clear()
+            for fields in self.indexes:
+                self.index[fields] = {}
+            self.generation += 1
+            self.pending.clear()
+            self.pending_clear = True
+            self.pending_cond.notify()
+
+    def flush(self):
+        """Write all pending changes to MongoDB now."""
+        with self.write_lock:
+            with self.lock:
+                clear, self.pending_clear = self.pending_clear, False
+                writes, self.pending = self.pending, {}
+            self._write(clear, writes)
+
+    def _candidates(self, query):
+        # Use the most specific index covered by the query
+        best = None
+        for fields in self.indexes:
+            if set(fields).issubset(query) and \
+               (best is None or len(fields) > len(best)):
+                best = fields
+        if best is None:
+            return self.entries.values()
+        key = tuple(query[f] for f in best)
+        return self.index[best].get(key, {}).values()
+
+    def _add(self, entry):
+        self.entries[entry.id] = entry
+        if entry.id not in self.order:
+            self.order[entry.id] = self.next_order
+            self.next_order += 1
+        for fields in self.indexes:
+            key = tuple(getattr(entry, f) for f in fields)
+            self.index[fields].setdefault(key, {})[entry.id] = entry
+
+    def _remove(self, id_):
+        entry = self.entries.pop(id_, None)
+        if entry is None:
+            return
+        for fields in self.indexes:
+            key = tuple(getattr(entry, f) for f in fields)
+            bucket = self.index[fields][key]
+            del bucket[id_]
+            if not bucket:
+                del self.index[fields][key]
+
+    def _write_behind(self):
+        while True:
+            with self.lock:
+                while not self.pending and not self.pending_clear:
+                    self.pending_cond.wait()
+            # Let more changes accumulate, they are coalesced per entry
+            time.sleep(WRITE_BEHIND_DELAY)
+            self.flush()
+
+    def _write(self, clear, writes):
+        try:
+            if clear:
+                self.data.remove()
+                clear = False
+            while writes:
+                id_, doc = writes.popitem()
+                try:
+                    if doc is None:
+                        self.data.remove(id_)
+                    else:
+                        self.data.save(doc)
+                except:
+                    writes[id_] = doc
+                    raise
+        except mongo.errors.PyMongoError, e:
+            log.warning("Failed to write %s, will retry: %s" %
+                        (self.data.name, e))
+            # Put back what was not written, unless it changed since
+            with self.lock:
+                self.pending_clear = self.pending_clear or clear
+                for (id_, doc) in writes.items():
+                    if id_ not in self.pending:
+                        self.pending[id_] = doc
+                self.pending_cond.notify()
 
     def __str__(self):
         s = ""
@@ -65,8 +232,13 @@ class MongoTable:
 
 
 class RFTable(MongoTable):
-    def __init__(self, address=MONGO_ADDRESS):
-        MongoTable.__init__(self, address, RFTABLE_NAME, RFENTRY)
+    indexes = (("vm_id", "vm_port"),
+               ("ct_id", "dp_id", "dp_port"),
+               ("vs_id", "vs_port"),
+               ("ct_id", "dp_id"))
+
+    def __init__(self, address=MONGO_ADDRESS, owner=None):
+        MongoTable.__init__(self, address, RFTABLE_NAME, RFENTRY, owner)
 
     def get_entry_by_vm_port(self, vm_id, vm_port):
         result = self.get_entries(vm_id=vm_id,
@@ -98,16 +270,15 @@ class RFTable(MongoTable):
 
 
 class RFConfig(MongoTable):
-    def __init__(self, ifile, address=MONGO_ADDRESS):
-        MongoTable.__init__(self, address, RFCONFIG_NAME, RFCONFIGENTRY)
-        # TODO: perform validation of config
-        configfile = file(ifile)
-        lines = configfile.readlines()[1:]
-        entries = [line.strip("\n").split(",") for line in lines]
-        for (a, b, c, d, e) in entries:
-            self.set_entry(RFConfigEntry(vm_id=int(a, 16), vm_port=int(b),
-                                         ct_id=int(c), dp_id=int(d, 16),
-                                         dp_port=int(e)))
+    indexes = (("vm_id", "vm_port"),
+               ("ct_id", "dp_id", "dp_port"))
+
+    def __init__(self, ifile, address=MONGO_ADDRESS, owner=None):
+        MongoTable.__init__(self, address, RFCONFIG_NAME, RFCONFIGENTRY,
+                            owner)
+        for entry in read_config(ifile):
+            if owner is None or owner(entry):
+                self.set_entry(entry)
 
     def get_config_for_vm_port(self, vm_id, vm_port):
         result = self.get_entries(vm_id=vm_id,
@@ -125,8 +296,11 @@ class RFConfig(MongoTable):
         return result[0]
 
 class RFISLTable(MongoTable):
-    def __init__(self, address=MONGO_ADDRESS):
-        MongoTable.__init__(self, address, RFISL_NAME, RFISLENTRY)
+    indexes = (("ct_id", "dp_id"),
+               ("rem_ct", "rem_id"))
+
+    def __init__(self, address=MONGO_ADDRESS, owner=None):
+        MongoTable.__init__(self, address, RFISL_NAME, RFISLENTRY, owner)
 
     def get_entry_by_addr(self, ct_id, dp_id, dp_port, eth_addr):
         result = self.get_entries(ct_id=ct_id, dp_id=dp_id, dp_port=dp_port,
@@ -149,39 +323,70 @@ class RFISLTable(MongoTable):
         return bool(self.get_dp_entries(ct_id, dp_id))
 
 class RFISLConf(MongoTable):
-    def __init__(self, ifile, address=MONGO_ADDRESS):
-        MongoTable.__init__(self, address, RFISLCONF_NAME, RFISLCONFENTRY)
-        # TODO: perform validation of config
-        try:
-            internalfile = file(ifile)
-        except:
-            # Default to no ISL config
-            return
-        lines = internalfile.readlines()[1:]
-        entries = [line.strip("\n").split(",") for line in lines]
-        for (a, b, c, d, e, f, g, h, i) in entries:
-            self.set_entry(RFISLConfEntry(vm_id=int(a, 16), ct_id=int(b),
-                                          dp_id=int(c, 16), dp_port=int(d),
-                                          eth_addr=e, rem_ct=int(f),
-                                          rem_id=int(g, 16), rem_port=int(h),
-                                          rem_eth_addr=i))
+    indexes = (("ct_id", "dp_id", "dp_port"),
+               ("rem_ct", "rem_id", "rem_port"))
+
+    def __init__(self, ifile, address=MONGO_ADDRESS, owner=None):
+        MongoTable.__init__(self, address, RFISLCONF_NAME, RFISLCONFENTRY,
+                            owner)
+        for entry in read_islconf(ifile):
+            if owner is None or owner(entry):
+                self.set_entry(entry)
 
     def get_entries_by_port(self, ct, id_, port):
         results = self.get_entries(ct_id=ct, dp_id=id_, dp_port=port)
         results.extend(self.get_entries(rem_ct=ct, rem_id=id_, rem_port=port))
         return results
 
-# Convenience functions for packing/unpacking to a dict for BSON representation
+# Configuration file parsing
+def read_config(ifile):
+    """Read the VM-VS-DP mapping configuration file into RFConfigEntries."""
+    # TODO: perform validation of config
+    configfile = file(ifile)
+    lines = configfile.readlines()[1:]
+    entries = [line.strip("\n").split(",") for line in lines]
+    return [RFConfigEntry(vm_id=int(a, 16), vm_port=int(b), ct_id=int(c),
+                          dp_id=int(d, 16), dp_port=int(e))
+            for (a, b, c, d, e) in entries]
+
+def read_islconf(ifile):
+    """Read the ISL mapping configuration file into RFISLConfEntries."""
+    # TODO: perform validation of config
+    try:
+        internalfile = file(ifile)
+    except:
+        # Default to no ISL config
+        return []
+    lines = internalfile.readlines()[1:]
+    entries = [line.strip("\n").split(",") for line in lines]
+    return [RFISLConfEntry(vm_id=int(a, 16), ct_id=int(b), dp_id=int(c, 16),
+                           dp_port=int(d), eth_addr=e, rem_ct=int(f),
+                           rem_id=int(g, 16), rem_port=int(h),
+                           rem_eth_addr=i)
+            for (a, b, c, d, e, f, g, h, i) in entries]
+
+# Convenience functions for packing/unpacking to a dict for BSON representation.
+# Ids and ports are stored as native 64-bit integers, and missing values as
+# null. Documents written with decimal strings, and "" for missing values, are
+# still read; rfmigrate.py converts them.
 def load_from_dict(src, obj, attr):
-    setattr(obj, attr, src[attr])
+    value = src.get(attr)
+    if value is None or value == "":
+        value = None
+    elif not attr.endswith("eth_addr"):
+        value = from_bson_int(value, 64)
+    setattr(obj, attr, value)
 
 def pack_into_dict(dest, obj, attr):
     value = getattr(obj, attr)
-    dest[attr] = "" if value is None else str(value)
+    if value is not None and not attr.endswith("eth_addr"):
+        value = to_bson_int(value, 64)
+    dest[attr] = value
 
 class RFEntry:
     def __init__(self, vm_id=None, vm_port=None, ct_id=None, dp_id=None,
-                 dp_port=None, vs_id=None, vs_port=None, eth_addr=None):
+                 dp_port=None, vs_id=None, vs_port=None, eth_addr=None,
+                 vrf=None):
         self.id = None
         self.vm_id = vm_id
         self.vm_port = vm_port
@@ -191,6 +396,8 @@ class RFEntry:
         self.vs_id = vs_id
         self.vs_port = vs_port
         self.eth_addr = eth_addr
+        # Routing table of the VRF the client port belongs to, 0 for none
+        self.vrf = vrf
 
     def _is_idle_vm_port(self):
         return (self.vm_id is not None and
@@ -223,8 +430,9 @@ class RFEntry:
             self.vs_id = None
             self.vs_port = None
             self.eth_addr = None
+            self.vrf = None
 
-    def associate(self, id_, port, ct_id=None, eth_addr=None):
+    def associate(self, id_, port, ct_id=None, eth_addr=None, vrf=None):
         if self._is_idle_vm_port():
             self.ct_id = ct_id
             self.dp_id = id_
@@ -233,6 +441,7 @@ class RFEntry:
             self.vm_id = id_
             self.vm_port = port
             self.eth_addr = eth_addr
+            self.vrf = vrf
         else:
             raise ValueError
 
@@ -240,6 +449,9 @@ class RFEntry:
         self.vs_id = vs_id
         self.vs_port = vs_port
 
+    def get_vrf(self):
+        return self.vrf or 0
+
     def get_status(self):
         if self._is_idle_vm_port():
             return RFENTRY_IDLE_VM_PORT
@@ -255,22 +467,18 @@ class RFEntry:
                "dp_id: %s\ndp_port: %s\n"\
                "vs_id: %s\nvs_port: %s\n"\
                "eth_addr: %s\nct_id: %s\n"\
-               "status:%s" % (str(self.vm_id),
-                              str(self.vm_port),
-                              str(self.dp_id),
-                              str(self.dp_port),
-                              str(self.vs_id),
-                              str(self.vs_port),
-                              str(self.eth_addr),
-                              str(self.ct_id),
-                              str(self.get_status()))
+               "vrf: %s\nstatus:%s" % (str(self.vm_id),
+                                       str(self.vm_port),
+                                       str(self.dp_id),
+                                       str(self.dp_port),
+                                       str(self.vs_id),
+                                       str(self.vs_port),
+                                       str(self.eth_addr),
+                                       str(self.ct_id),
+                                       str(self.vrf),
+                                       str(self.get_status()))
 
     def from_dict(self, data):
-        for k, v in data.items():
-            if str(v) is "":
-                data[k] = None
-            elif k != "_id" and k != "eth_addr": # All our data is int
-                data[k] = int(v)
         self.id = data["_id"]
         load_from_dict(data, self, "vm_id")
         load_from_dict(data, self, "vm_port")
@@ -280,6 +488,7 @@ class RFEntry:
         load_from_dict(data, self, "vs_id")
         load_from_dict(data, self, "vs_port")
         load_from_dict(data, self, "eth_addr")
+        load_from_dict(data, self, "vrf")
 
     def to_dict(self):
         data = {}
@@ -293,6 +502,7 @@ class RFEntry:
         pack_into_dict(data, self, "vs_id")
         pack_into_dict(data, self, "vs_port")
         pack_into_dict(data, self, "eth_addr")
+        pack_into_dict(data, self, "vrf")
         return data
 
 class RFISLEntry:
@@ -368,11 +578,6 @@ class RFISLEntry:
             return RFISL_ACTIVE
 
     def from_dict(self, data):
-        for k, v in data.items():
-            if str(v) is "":
-                data[k] = None
-            elif k != "_id" and not k.endswith("eth_addr"):
-                data[k] = int(v)
         self.id = data["_id"]
         load_from_dict(data, self, "vm_id")
         load_from_dict(data, self, "ct_id")
@@ -427,11 +632,6 @@ class RFISLConfEntry:
        return RFENTRY_ACTIVE
 
     def from_dict(self, data):
-        for k, v in data.items():
-            if str(v) is "":
-                data[k] = None
-            elif k != "_id" and not k.endswith("eth_addr"):
-                data[k] = int(v)
         self.id = data["_id"]
         load_from_dict(data, self, "vm_id")
         load_from_dict(data, self, "ct_id")
@@ -477,11 +677,6 @@ class RFConfigEntry:
                               str(self.ct_id))
 
     def from_dict(self, data):
-        for k, v in data.items():
-            if str(v) is "":
-                data[k] = None
-            elif k != "_id": # All our data is int
-                data[k] = int(v)
         self.id = data["_id"]
         load_from_dict(data, self, "vm_id")
         load_from_dict(data, self, "vm_port")
@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+#-*- coding:utf-8 -*-
+#
+# Run from this directory with the repository root on PYTHONPATH:
+#   PYTHONPATH=.. python test_rfingest.py
+
+import unittest
+
+from rflib.defs import *
+from rflib.ipc.RFProtocol import *
+from rflib.types.Match import *
+from rflib.types.Action import *
+from rflib.types.Option import *
+
+from rfingest import *
+
+VM_ID = 0x12a0a0a0a0a0
+
+class Recorder:
+    def __init__(self):
+        self.processed = []
+
+    def process(self, from_, to, channel, msg):
+        self.processed.append(msg)
+
+def route_mod(mod, port):
+    rm = RouteMod(mod=mod, id=VM_ID)
+    rm.add_match(Match.IPV4("172.16.0.0", "255.255.0.0"))
+    rm.add_option(Option.PRIORITY(PRIORITY_LOW))
+    if mod != RMT_DELETE:
+        rm.add_action(Action.OUTPUT(port))
+    return rm
+
+class IngestPipelineTest(unittest.TestCase):
+    def drain(self, pipeline):
+        while True:
+            item = pipeline._next()
+            if item is None:
+                return
+            pipeline.processor.process(*item)
+
+    def test_flap_keeps_latest_route_mod(self):
+        """A route moving from port 1 to port 2 and back while queued must
+        end up installed through port 1, not deleted."""
+        recorder = Recorder()
+        pipeline = IngestPipeline(recorder, coalesce_key)
+        for rm in (route_mod(RMT_DELETE, 1), route_mod(RMT_ADD, 2),
+                   route_mod(RMT_DELETE, 2), route_mod(RMT_ADD, 1)):
+            pipeline.process("rfclient", RFSERVER_ID,
+                             RFCLIENT_RFSERVER_CHANNEL, rm)
+        self.drain(pipeline)
+
+        self.assertEqual(len(recorder.processed), 1)
+        rm = recorder.processed[-1]
+        self.assertEqual(rm.get_mod(), RMT_ADD)
+        self.assertEqual([Action.from_dict(a).get_value()
+                          for a in rm.get_actions()], [1])
+
+    def test_routes_of_other_vms_are_kept(self):
+        recorder = Recorder()
+        pipeline = IngestPipeline(recorder, coalesce_key)
+        first = route_mod(RMT_ADD, 1)
+        second = route_mod(RMT_ADD, 1)
+        second.set_id(VM_ID + 1)
+        for rm in (first, second):
+            pipeline.process("rfclient", RFSERVER_ID,
+                             RFCLIENT_RFSERVER_CHANNEL, rm)
+        self.drain(pipeline)
+
+        self.assertEqual(len(recorder.processed), 2)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,163 @@
+#!/usr/bin/env python
+#-*- coding:utf-8 -*-
+
+# Mock OpenFlow 1.0 datapath, used to check how RFProxy handles the flow table
+# of a switch across reconnections.
+#
+# It connects to the controller, keeps the flows it is sent and answers
+# features, echo, barrier and flow stats requests. With --reconnect, it drops
+# the connection at the given times and connects again keeping its flows, as a
+# switch does when the controller fails over. For each connection it reports
+# the flow_mods received and the lowest number of flows installed: with
+# RFServer in resync mode, a reconnection should not empty the table.
+
+import os
+import sys
+import time
+import socket
+import struct
+import select
+import argparse
+
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "..", "pox"))
+
+from pox.lib.addresses import EthAddr
+from pox.openflow.libopenflow_01 import *
+from pox.openflow.libopenflow_01 import _message_type_to_class
+
+OFP_HEADER_LEN = 8
+
+class MockDatapath:
+    def __init__(self, dp_id, ports):
+        self.dp_id = dp_id
+        self.ports = ports
+        self.sock = None
+        self.buf = b""
+        # (match, priority) -> ofp_flow_stats
+        self.flows = {}
+        self.reset_counters()
+
+    def reset_counters(self):
+        self.flow_mods = {OFPFC_ADD: 0, OFPFC_MODIFY: 0,
+                          OFPFC_MODIFY_STRICT: 0, OFPFC_DELETE: 0,
+                          OFPFC_DELETE_STRICT: 0}
+        self.min_flows = len(self.flows)
+
+    def connect(self, address, port):
+        self.sock = socket.create_connection((address, port))
+        self.buf = b""
+        self.send(ofp_hello())
+
+    def disconnect(self):
+        if self.sock is not None:
+            self.sock.close()
+            self.sock = None
+
+    def send(self, msg):
+        self.sock.sendall(msg.pack())
+
+    def run(self, duration):
+        """Handle messages from the controller for 'duration' seconds.
+        Returns False if the controller closed the connection."""
+        end = time.time() + duration
+        while True:
+            timeout = end - time.time()
+            if timeout <= 0:
+                return True
+            ready, _, _ = select.select([self.sock], [], [], timeout)
+            if not ready:
+                continue
+            data = self.sock.recv(65536)
+            if not data:
+                return False
+            self.buf += data
+            while len(self.buf) >= OFP_HEADER_LEN:
+                length = struct.unpack("!H", self.buf[2:4])[0]
+                if len(self.buf) < length:
+                    break
+                raw, self.buf = self.buf[:length], self.buf[length:]
+                cls = _message_type_to_class.get(ord(raw[1]))
+                if cls is None:
+                    continue
+                msg = cls()
+                msg.unpack(raw)
+                self.handle(msg)
+
+    def handle(self, msg):
+        if isinstance(msg, ofp_features_request):
+            ports = [ofp_phy_port(port_no=port, name="eth%d" % port,
+                                  hw_addr=EthAddr(struct.pack("!HI", 2, port)))
+                     for port in self.ports]
+            self.send(ofp_features_reply(xid=msg.xid,
+                                         datapath_id=self.dp_id,
+                                         n_buffers=0, n_tables=1,
+                                         capabilities=OFPC_FLOW_STATS,
+                                         ports=ports))
+        elif isinstance(msg, ofp_echo_request):
+            self.send(ofp_echo_reply(xid=msg.xid, body=msg.body))
+        elif isinstance(msg, ofp_barrier_request):
+            self.send(ofp_barrier_reply(xid=msg.xid))
+        elif isinstance(msg, ofp_flow_mod):
+            self.flow_mod(msg)
+        elif isinstance(msg, ofp_stats_request) and \
+             msg.type == OFPST_FLOW:
+            self.send(ofp_stats_reply(xid=msg.xid, type=OFPST_FLOW,
+                                      body=self.flows.values()))
+
+    def flow_mod(self, msg):
+        self.flow_mods[msg.command] += 1
+        key = (msg.match.pack(flow_mod=True), msg.priority)
+        if msg.command in (OFPFC_ADD, OFPFC_MODIFY_STRICT):
+            self.flows[key] = ofp_flow_stats(match=msg.match,
+                                             priority=msg.priority,
+                                             idle_timeout=msg.idle_timeout,
+                                             hard_timeout=msg.hard_timeout,
+                                             actions=msg.actions)
+        elif msg.command == OFPFC_DELETE_STRICT:
+            self.flows.pop(key, None)
+        else:
+            for (key, flow) in self.flows.items():
+                if msg.match.matches_with_wildcards(flow.match):
+                    if msg.command == OFPFC_DELETE:
+                        del self.flows[key]
+                    else:
+                        flow.actions = msg.actions
+        self.min_flows = min(self.min_flows, len(self.flows))
+
+    def report(self, name):
+        print("%s: %d flows (lowest %d), received %d adds, %d deletes, "
+              "%d strict deletes" % (name, len(self.flows), self.min_flows,
+                                     self.flow_mods[OFPFC_ADD],
+                                     self.flow_mods[OFPFC_DELETE],
+                                     self.flow_mods[OFPFC_DELETE_STRICT]))
+        sys.stdout.flush()
+
+if __name__ == "__main__":
+    description = 'Mock OpenFlow 1.0 datapath that keeps its flows across ' \
+                  'reconnections to the controller'
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('-c', '--controller', default='127.0.0.1:6633',
+                        help='controller address (default: 127.0.0.1:6633)')
+    parser.add_argument('-d', '--dpid', type=lambda x: int(x, 0),
+                        default=0x99, help='datapath id (default: 0x99)')
+    parser.add_argument('-p', '--ports', type=int, default=4,
+                        help='number of ports (default: 4)')
+    parser.add_argument('-r', '--reconnect', type=float, action='append',
+                        default=[], metavar='SECONDS',
+                        help='reconnect after SECONDS, can be repeated')
+    parser.add_argument('-t', '--time', type=float, default=30,
+                        help='seconds to stay connected after the last '
+                             'reconnection (default: 30)')
+    args = parser.parse_args()
+
+    address, port = args.controller.rsplit(":", 1)
+    dp = MockDatapath(args.dpid, range(1, args.ports + 1))
+    durations = args.reconnect + [args.time]
+    for (i, duration) in enumerate(durations):
+        dp.reset_counters()
+        dp.connect(address, int(port))
+        if not dp.run(duration):
+            print("Controller closed the connection")
+        dp.disconnect()
+        dp.report("Connection %d" % (i + 1))
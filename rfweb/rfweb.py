@@ -67,9 +67,15 @@ db_conn = None
 # can be represented as an integer
 def format_id(value):
     try:
-        value = int(value)
+        value = MongoIPC.from_bson_int(value, 64)
         return defs.format_id(value)
-    except ValueError, TypeError:
+    except (ValueError, TypeError):
+        return value
+
+def format_port(value):
+    try:
+        return MongoIPC.from_bson_int(value, 64)
+    except (ValueError, TypeError):
         return value
     
 # TODO: make this function generate pretty output for any given message.
@@ -150,11 +156,11 @@ def pretiffy_rftable_entry(entry):
         
     # TODO: these field names should be defined somewhere else
     result["vm_id"] = format_id(entry["vm_id"])
-    result["vm_port"] = int(entry["vm_port"])
+    result["vm_port"] = format_port(entry["vm_port"])
     result["dp_id"] = format_id(entry["dp_id"])
-    result["dp_port"] = int(entry["dp_port"])
+    result["dp_port"] = format_port(entry["dp_port"])
     result["vs_id"] = format_id(entry["vs_id"])
-    result["vs_port"] = int(entry["vs_port"])
+    result["vs_port"] = format_port(entry["vs_port"])
     result["ct_id"] = format_id(entry["ct_id"])
     
     return result